@@ -34,6 +34,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "usb/usb_host.h"
+#include "ptouch_protocol.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,7 +43,8 @@ extern "C" {
 // Debug configuration
 #define PTOUCH_DEBUG_PACKET_BUFFER_SIZE    (8192)
 #define PTOUCH_DEBUG_MAX_PACKET_SIZE       (256)
-#define PTOUCH_DEBUG_MAX_HISTORY_ENTRIES   (100)
+#define PTOUCH_DEBUG_MAX_HISTORY_ENTRIES   (128)    // Packet history slots, a power of two
+#define PTOUCH_DEBUG_HISTORY_PAYLOAD       (128)    // Bytes of each packet kept: a whole bulk OUT packet
 
 // Debug levels
 typedef enum {
@@ -54,39 +56,32 @@ typedef enum {
     PTOUCH_DEBUG_LEVEL_VERBOSE
 } ptouch_debug_level_t;
 
+// Highest level compiled in, as a number (0 = NONE ... 5 = VERBOSE); set it
+// with -DPTOUCH_DEBUG_COMPILE_LEVEL in build_flags. Logging above it is
+// dead code: its arguments are never evaluated and no timestamp is taken.
+// At 0 packet capture and label statistics are compiled out as well.
+#ifndef PTOUCH_DEBUG_COMPILE_LEVEL
+#define PTOUCH_DEBUG_COMPILE_LEVEL 5
+#endif
+
+#define PTOUCH_DEBUG_COMPILED(level) (PTOUCH_DEBUG_COMPILE_LEVEL >= (level))
+
 // Packet direction
 typedef enum {
     PTOUCH_PACKET_DIR_OUT = 0,
     PTOUCH_PACKET_DIR_IN = 1
 } ptouch_packet_dir_t;
 
-// Protocol command types
-typedef enum {
-    PTOUCH_CMD_UNKNOWN = 0,
-    PTOUCH_CMD_INIT,
-    PTOUCH_CMD_STATUS_REQUEST,
-    PTOUCH_CMD_INFO,
-    PTOUCH_CMD_PACKBITS_ENABLE,
-    PTOUCH_CMD_RASTER_START,
-    PTOUCH_CMD_RASTER_LINE,
-    PTOUCH_CMD_PRECUT,
-    PTOUCH_CMD_FINALIZE,
-    PTOUCH_CMD_D460BT_MAGIC,
-    PTOUCH_CMD_D460BT_CHAIN,
-    PTOUCH_CMD_PAGE_FLAGS,
-    PTOUCH_CMD_FEED_PAPER,
-    PTOUCH_CMD_CUT_PAPER
-} ptouch_protocol_cmd_t;
-
 // Packet information structure
 typedef struct {
     int64_t timestamp;                              // Timestamp in microseconds
     ptouch_packet_dir_t direction;                  // IN or OUT
     uint8_t endpoint;                               // USB endpoint address
     size_t length;                                  // Data length
+    size_t captured;                                // Bytes of it in data
     uint8_t data[PTOUCH_DEBUG_MAX_PACKET_SIZE];     // Packet data
-    ptouch_protocol_cmd_t cmd_type;                 // Identified command type
-    char cmd_description[64];                       // Human-readable description
+    ptouch_protocol_cmd_t cmd_type;                 // First command in the packet
+    char cmd_description[96];                       // Commands in the packet, repeats folded
     bool is_error;                                  // Error flag
     uint32_t transfer_status;                       // USB transfer status
 } ptouch_packet_info_t;
@@ -103,13 +98,19 @@ typedef struct {
     uint64_t bytes_received;
     int64_t last_packet_time;
     int64_t first_packet_time;
+    uint32_t labels_sent;               // Labels fully transmitted
+    uint32_t labels_overlapped;         // Sent while the previous label was still printing
+    int64_t last_label_tx_us;           // Transmission time of the last label
+    int64_t last_label_overlap_us;      // Part of it hidden behind feed/cut
+    int64_t total_label_tx_us;
+    int64_t total_label_overlap_us;
 } ptouch_debug_stats_t;
 
 // Debug logger class
 typedef struct {
     bool enabled;
     ptouch_debug_level_t level;
-    void* packet_history;  // Simplified for now
+    void* packet_history;                           // Ring of recent packets, see ptouch_debug.c
     ptouch_debug_stats_t stats;
     bool console_enabled;
     bool web_enabled;
@@ -135,13 +136,18 @@ esp_err_t ptouch_debug_log_packet(ptouch_packet_dir_t direction,
 esp_err_t ptouch_debug_log_usb_transfer(const usb_transfer_t* transfer, 
                                         ptouch_packet_dir_t direction);
 
-// Protocol analysis functions
+// Protocol analysis functions. These look at data on its own; the packet
+// history and the packet log carry one parser across packets, so commands
+// split between transfers are decoded too.
 ptouch_protocol_cmd_t ptouch_debug_identify_command(const uint8_t* data, size_t length);
 const char* ptouch_debug_get_command_name(ptouch_protocol_cmd_t cmd);
-const char* ptouch_debug_get_command_description(const uint8_t* data, size_t length);
+// Every command in data, e.g. "Raster line x8, Print". Writes into buf and
+// returns it, so concurrent callers do not share a buffer.
+const char* ptouch_debug_get_command_description(const uint8_t* data, size_t length, char* buf, size_t size);
 
 // Statistics functions
 ptouch_debug_stats_t ptouch_debug_get_stats(void);
+void ptouch_debug_log_label(int64_t tx_us, int64_t overlap_us);
 void ptouch_debug_reset_stats(void);
 void ptouch_debug_print_stats(void);
 
@@ -159,18 +165,26 @@ void ptouch_debug_hex_dump(const char* tag, const uint8_t* data, size_t length);
 void ptouch_debug_print_transfer_status(uint32_t status);
 const char* ptouch_debug_get_transfer_status_string(uint32_t status);
 
-// Convenience macros
+// Convenience macros; compiled out at PTOUCH_DEBUG_COMPILE_LEVEL 0
 #define PTOUCH_DEBUG_LOG_PACKET_OUT(ep, data, len, status) \
-    ptouch_debug_log_packet(PTOUCH_PACKET_DIR_OUT, ep, data, len, status)
+    do { if (PTOUCH_DEBUG_COMPILED(PTOUCH_DEBUG_LEVEL_ERROR)) \
+         ptouch_debug_log_packet(PTOUCH_PACKET_DIR_OUT, ep, data, len, status); } while(0)
 
 #define PTOUCH_DEBUG_LOG_PACKET_IN(ep, data, len, status) \
-    ptouch_debug_log_packet(PTOUCH_PACKET_DIR_IN, ep, data, len, status)
+    do { if (PTOUCH_DEBUG_COMPILED(PTOUCH_DEBUG_LEVEL_ERROR)) \
+         ptouch_debug_log_packet(PTOUCH_PACKET_DIR_IN, ep, data, len, status); } while(0)
+
+// A label sent since tx_start; all of it overlapped the previous label if overlapped
+#define PTOUCH_DEBUG_LOG_LABEL(tx_start, overlapped) \
+    do { if (PTOUCH_DEBUG_COMPILED(PTOUCH_DEBUG_LEVEL_ERROR)) { \
+         int64_t tx_us_ = esp_timer_get_time() - (tx_start); \
+         ptouch_debug_log_label(tx_us_, (overlapped) ? tx_us_ : 0); } } while(0)
 
 #define PTOUCH_DEBUG_ENABLED() \
     (g_ptouch_debug_logger && g_ptouch_debug_logger->enabled)
 
-#define PTOUCH_DEBUG_LEVEL_CHECK(level) \
-    (PTOUCH_DEBUG_ENABLED() && g_ptouch_debug_logger->level >= level)
+#define PTOUCH_DEBUG_LEVEL_CHECK(lvl) \
+    (PTOUCH_DEBUG_COMPILED(lvl) && PTOUCH_DEBUG_ENABLED() && g_ptouch_debug_logger->level >= (lvl))
 
 // Conditional logging macros
 #define PTOUCH_LOGE(format, ...) \
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <atomic>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -50,6 +51,24 @@
 #define FLAG_HAS_PRECUT            (1 << 5)
 #define FLAG_D460BT_MAGIC          (1 << 6)
 
+// Status reply types and phases (ptouch_stat.status_type / phase_type)
+#define PTOUCH_STATUS_TYPE_REPLY        0x00
+#define PTOUCH_STATUS_TYPE_PRINTED      0x01
+#define PTOUCH_STATUS_TYPE_ERROR        0x02
+#define PTOUCH_STATUS_TYPE_PHASE_CHANGE 0x06
+#define PTOUCH_PHASE_EDITING            0x00
+#define PTOUCH_PHASE_PRINTING           0x01
+#define PTOUCH_ERROR_BUFFER_FULL        0x80  // Reported while the receive buffer is full
+
+// Waiting for the printer to accept the next label
+#define PTOUCH_DATA_READY_TIMEOUT_MS    10000
+#define PTOUCH_STATUS_POLL_MS           50
+#define PTOUCH_STATUS_MAX_MESSAGES      4     // Notifications skipped while waiting for a status reply
+#define PTOUCH_RECEIVE_TIMEOUT_MS       1000  // Status reply; the IN transfer stays queued after it
+
+// Raster lines per band reported to the step hook
+#define PTOUCH_TRACE_BAND_LINES         64
+
 // Page flags for printing
 typedef enum {
     FEED_NONE    = 0x0,
@@ -106,6 +125,32 @@ struct __attribute__((packed, aligned(4))) ptouch_stat {
     uint16_t reserved_2;
 };
 
+// USB traffic since the printer object was created, counted whether or
+// not debug logging is enabled
+typedef struct {
+    uint32_t transfers;                   // OUT and IN transfers submitted
+    uint32_t errors;                      // Transfers that failed; a read still queued is not one
+    uint32_t bytes_out;
+    int64_t busy_us;                      // Time spent waiting for transfers to complete
+} ptouch_usb_stats_t;
+
+// Steps of sending one label with printBitmap(), reported as each one ends
+typedef enum {
+    PTOUCH_STEP_STATUS = 0,               // Waiting until the printer can take data
+    PTOUCH_STEP_PREAMBLE,                 // Mode, compression, info and precut commands
+    PTOUCH_STEP_BAND,                     // Up to PTOUCH_TRACE_BAND_LINES raster lines; arg is the first
+    PTOUCH_STEP_FINALIZE                  // Print or chain command
+} ptouch_step_t;
+
+typedef void (*ptouch_step_cb_t)(ptouch_step_t step, int64_t start_us, int64_t end_us, uint32_t arg, void *ctx);
+
+// Outcome of waitForPrinted()
+typedef enum {
+    PTOUCH_WAIT_PRINTED = 0,
+    PTOUCH_WAIT_ERROR,                    // Printer reported an error or went away
+    PTOUCH_WAIT_TIMEOUT                   // No print-complete yet; says nothing about the label
+} ptouch_wait_t;
+
 // Main printer device class
 class PtouchPrinter {
 private:
@@ -118,6 +163,16 @@ private:
     bool is_initialized;                  // Initialization status
     bool verbose_mode;                    // Verbose logging
     bool usb_host_installed;              // USB Host driver status
+    bool chain_open;                      // Last label was chained, tape not ejected yet
+    std::atomic<bool> cancel_requested;   // Set from other tasks to abort printBitmap
+    uint32_t printed_count;               // Print-complete notifications seen since power-up
+    uint32_t printed_owed;                // Counted by expectPrinted() before they arrived
+    uint32_t printed_at_ready;            // printed_count when waitForDataReady() last succeeded
+    ptouch_usb_stats_t usb_stats;
+    usb_transfer_t *in_transfer;          // Kept for the connection, see usbReceive()
+    bool in_pending;                      // Submitted and not completed yet
+    ptouch_step_cb_t step_hook;           // Optional, for tracing
+    void *step_hook_ctx;
     
     // USB endpoint addresses
     uint8_t bulk_out_ep;                  // Bulk OUT endpoint address
@@ -125,7 +180,9 @@ private:
     
     // USB communication methods
     int usbSend(uint8_t *data, size_t len);
-    int usbReceive(uint8_t *data, size_t len);
+    int usbReceive(uint8_t *data, size_t len, uint32_t timeout_ms = PTOUCH_RECEIVE_TIMEOUT_MS);
+    void cancelReceive();
+    static void in_transfer_cb(usb_transfer_t *transfer);
     
     // Device management
     bool openDevice(uint16_t vid, uint16_t pid);
@@ -141,10 +198,15 @@ private:
     int sendInfoCommand(int size_x);
     int sendPreCutCommand(int precut);
     
+    bool readStatusMessage(uint32_t timeout_ms = PTOUCH_RECEIVE_TIMEOUT_MS);
+    
     // Raster data methods
     int rasterStart();
     int sendRasterLine(uint8_t *data, size_t len);
     void setRasterPixel(uint8_t* rasterline, size_t size, int pixel);
+    
+    // Report a finished step to the hook; returns the time it ended
+    int64_t traceStep(ptouch_step_t step, int64_t start_us, uint32_t arg = 0);
 
     // USB Host callback functions
     static void client_event_cb(const usb_host_client_event_msg_t *event_msg, void *arg);
@@ -173,12 +235,56 @@ public:
     const char* getTextColor() const;
     bool hasError() const;
     const char* getErrorDescription() const;
+    bool isPrinting() const;
+    
+    // Poll status until the printer can take more data. A label still
+    // feeding or cutting does not block; a full buffer or an error does.
+    bool waitForDataReady(uint32_t timeout_ms = PTOUCH_DATA_READY_TIMEOUT_MS);
+    
+    // Labels the printer has confirmed as printed. The counter only moves
+    // forward; waitForPrinted() blocks until it reaches target, the printer
+    // reports an error or the timeout expires. A timeout of 0 polls once.
+    // expectPrinted() moves the counter up to target for notifications
+    // that have not arrived, for a label taken as printed without one; they
+    // are dropped when they do arrive, so later targets stay in step.
+    // clearExpected() forgets them once the printer is known to be idle.
+    uint32_t getPrintedCount() const { return printed_count; }
+    // The count once waitForDataReady() had read the notifications queued
+    // ahead of its reply: the base for whatever is sent after it
+    uint32_t getPrintedAtReady() const { return printed_at_ready; }
+    ptouch_wait_t waitForPrinted(uint32_t target, uint32_t timeout_ms);
+    void expectPrinted(uint32_t target);
+    void clearExpected() { printed_owed = 0; }
+    
+    // Running USB counters; the difference across a call is its USB cost
+    const ptouch_usb_stats_t& getUsbStats() const { return usb_stats; }
+    
+    // Called from printBitmap() as each step ends, on the calling task
+    void setStepHook(ptouch_step_cb_t hook, void *ctx) { step_hook = hook; step_hook_ctx = ctx; }
     
     // Printing methods
     bool printImage(const uint8_t *imageData, int width, int height, bool chain = false);
     bool printBitmap(const uint8_t *bitmap, int width, int height, bool chain = false);
     bool printText(const char *text, int fontSize = 0, bool chain = false);
     
+    // Streamed printing, for labels that are never held in RAM as a whole:
+    // waitForDataReady(), beginRaster(), the raster lines, finalizePrint().
+    // sendRasterData() takes pre-encoded raster commands and forwards them
+    // as they are; they must be PackBits lines when usesPackBits() is true.
+    bool beginRaster(int lines, bool chain = false);
+    bool sendRasterRow(const uint8_t *row, size_t len);
+    bool sendRasterData(const uint8_t *data, size_t len);
+    bool usesPackBits() const;
+    
+    // Drop a label part-way and resynchronise the printer
+    bool abortPrint();
+    
+    // Cancellation. The only calls that are safe from another task: the
+    // raster loop checks the flag between lines, then resyncs the printer.
+    void requestCancel() { cancel_requested.store(true); }
+    void clearCancel() { cancel_requested.store(false); }
+    bool isCancelRequested() const { return cancel_requested.load(); }
+    
     // Utility methods
     void setVerbose(bool verbose);
     void listSupportedPrinters();
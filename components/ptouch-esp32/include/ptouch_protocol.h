@@ -0,0 +1,121 @@
+/*
+ * P-touch ESP32 Raster Protocol Parser
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PTOUCH_PROTOCOL_H
+#define PTOUCH_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PTOUCH_PROTOCOL_MAX_CODE    3   // Bytes that select a command: ESC 'i' 'z'
+#define PTOUCH_PROTOCOL_MAX_ARGS    10  // Fixed argument bytes: ESC 'i' 'z' print information
+
+// Protocol command types
+typedef enum {
+    PTOUCH_CMD_UNKNOWN = 0,
+    PTOUCH_CMD_INVALIDATE,              // 0x00 padding
+    PTOUCH_CMD_INIT,                    // ESC '@'
+    PTOUCH_CMD_STATUS_REQUEST,          // ESC 'i' 'S'
+    PTOUCH_CMD_INFO,                    // ESC 'i' 'z'
+    PTOUCH_CMD_RASTER_START,            // ESC 'i' 'a' or ESC 'i' 'R'
+    PTOUCH_CMD_PAGE_FLAGS,              // ESC 'i' 'M': auto cut, mirror
+    PTOUCH_CMD_ADVANCED_MODE,           // ESC 'i' 'K': half cut, no chain
+    PTOUCH_CMD_MARGIN,                  // ESC 'i' 'd'
+    PTOUCH_CMD_CUT_EVERY,               // ESC 'i' 'A'
+    PTOUCH_CMD_COMPRESSION,             // 'M'
+    PTOUCH_CMD_RASTER_LINE,             // 'G' or 'g', followed by line data
+    PTOUCH_CMD_ZERO_LINE,               // 'Z'
+    PTOUCH_CMD_PRINT,                   // 0x0C, more pages follow
+    PTOUCH_CMD_FINALIZE                 // 0x1A, print and eject
+} ptouch_protocol_cmd_t;
+
+// Where the length of a command's line data comes from
+typedef enum {
+    PTOUCH_LENGTH_NONE = 0,             // No data follows
+    PTOUCH_LENGTH_LE16,                 // Arguments n1 n2: n1 + 256 * n2 bytes
+    PTOUCH_LENGTH_SECOND                // Arguments 0 n: n bytes
+} ptouch_length_t;
+
+// One entry of a command table
+typedef struct {
+    uint8_t code[PTOUCH_PROTOCOL_MAX_CODE];
+    uint8_t code_len;
+    uint8_t args;                       // Fixed argument bytes after the code
+    ptouch_length_t length;
+    ptouch_protocol_cmd_t type;
+    const char *name;                   // Human-readable
+} ptouch_command_def_t;
+
+// The commands the Brother drivers and this firmware send
+extern const ptouch_command_def_t ptouch_protocol_commands[];
+extern const size_t ptouch_protocol_command_count;
+
+typedef enum {
+    PTOUCH_PARSE_MORE = 0,              // All input taken, no command ended in it
+    PTOUCH_PARSE_COMMAND,               // A command and its arguments are complete
+    PTOUCH_PARSE_DATA,                  // The bytes taken are line data of the last command
+    PTOUCH_PARSE_ERROR                  // No command starts with the bytes taken
+} ptouch_parse_event_t;
+
+// Splits a byte stream into commands, however it is cut into buffers.
+// Only the code and argument bytes of a command are looked at; line data
+// is handed back in chunks, so 0x1A inside a raster line is not mistaken
+// for the end of the job.
+typedef struct {
+    const ptouch_command_def_t *table;
+    size_t table_len;
+    uint8_t code[PTOUCH_PROTOCOL_MAX_CODE];
+    uint8_t code_len;                   // Code bytes read so far, 0 between commands
+    bool in_args;                       // Code matched def, its arguments are being read
+    uint8_t arg_len;                    // Argument bytes read so far
+    const ptouch_command_def_t *def;    // Last command matched
+    uint8_t args[PTOUCH_PROTOCOL_MAX_ARGS];
+    uint16_t length;                    // Line data following the last command
+    uint16_t remaining;                 // Line data still to come
+    const char *error;                  // Why the last PTOUCH_PARSE_ERROR happened
+} ptouch_parser_t;
+
+// table may be NULL for ptouch_protocol_commands
+void ptouch_parser_init(ptouch_parser_t *parser, const ptouch_command_def_t *table, size_t table_len);
+
+// Forget any partial command, e.g. when bytes of the stream were lost
+void ptouch_parser_reset(ptouch_parser_t *parser);
+
+// Takes bytes from data up to the next event and stores how many in
+// *used. After PTOUCH_PARSE_DATA the data[0..*used) are line data. After
+// PTOUCH_PARSE_ERROR the bytes taken are dropped and parsing starts over
+// with the next one. Call again with the rest of the buffer until it
+// returns PTOUCH_PARSE_MORE.
+ptouch_parse_event_t ptouch_parser_step(ptouch_parser_t *parser, const uint8_t *data, size_t len, size_t *used);
+
+// Between commands: the stream so far ends on a command boundary
+static inline bool ptouch_parser_idle(const ptouch_parser_t *parser)
+{
+    return parser->code_len == 0 && parser->remaining == 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PTOUCH_PROTOCOL_H
@@ -32,13 +32,43 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <argtable3/argtable3.h>
 
 static const char* TAG = "ptouch-debug";
 
+// Packet history: a ring of fixed slots written by the task doing USB I/O
+// and read from the console or web handlers without a lock. Each slot has
+// its own sequence number, odd while it is being written, so a reader
+// that races the writer sees the number change and skips the packet.
+_Static_assert((PTOUCH_DEBUG_MAX_HISTORY_ENTRIES & (PTOUCH_DEBUG_MAX_HISTORY_ENTRIES - 1)) == 0,
+               "History size must be a power of two");
+
+#define HISTORY_MASK (PTOUCH_DEBUG_MAX_HISTORY_ENTRIES - 1)
+
+typedef struct {
+    atomic_uint sequence;               // 2 * index + 2 once packet index is complete
+    int64_t timestamp;
+    uint32_t transfer_status;
+    uint16_t length;                    // Length of the packet, not of what was kept
+    uint8_t direction;
+    uint8_t endpoint;
+    uint8_t data[PTOUCH_DEBUG_HISTORY_PAYLOAD];
+} history_slot_t;
+
+typedef struct {
+    atomic_uint head;                   // Packets logged; the next one goes to head & HISTORY_MASK
+    atomic_uint start;                  // First packet still shown after a clear
+    history_slot_t slots[PTOUCH_DEBUG_MAX_HISTORY_ENTRIES];
+} packet_history_t;
+
 // Global debug logger instance
 ptouch_debug_logger_t* g_ptouch_debug_logger = NULL;
 
+// Follows the OUT stream for the packet log; used by the USB task only
+static ptouch_parser_t live_parser;
+
 // Console command argument structures
 static struct {
     struct arg_str *level;
@@ -76,8 +106,17 @@ esp_err_t ptouch_debug_init(ptouch_debug_level_t level) {
     g_ptouch_debug_logger->console_enabled = true;
     g_ptouch_debug_logger->web_enabled = false;
     
-    // Simplified packet history (disabled for now)
-    g_ptouch_debug_logger->packet_history = NULL;
+    // Packet history goes to PSRAM when there is some
+    packet_history_t* history = heap_caps_calloc(1, sizeof(packet_history_t), MALLOC_CAP_SPIRAM);
+    if (!history) {
+        history = heap_caps_calloc(1, sizeof(packet_history_t), MALLOC_CAP_8BIT);
+    }
+    if (!history) {
+        ESP_LOGW(TAG, "No memory for packet history");
+    }
+    g_ptouch_debug_logger->packet_history = history;
+    
+    ptouch_parser_init(&live_parser, NULL, 0);
     
     // Initialize statistics
     g_ptouch_debug_logger->stats.first_packet_time = esp_timer_get_time();
@@ -97,7 +136,7 @@ esp_err_t ptouch_debug_deinit(void) {
     // Unregister console commands
     ptouch_debug_unregister_console_commands();
     
-    // Clean up packet history (simplified)
+    heap_caps_free(g_ptouch_debug_logger->packet_history);
     g_ptouch_debug_logger->packet_history = NULL;
     
     // Free logger structure with proper heap_caps_free
@@ -131,140 +170,222 @@ ptouch_protocol_cmd_t ptouch_debug_identify_command(const uint8_t* data, size_t
         return PTOUCH_CMD_UNKNOWN;
     }
     
-    // Check for common command patterns
-    if (length >= 2) {
-        // ESC commands (0x1B)
-        if (data[0] == 0x1B) {
-            if (length >= 3 && data[1] == 0x69) {
-                switch (data[2]) {
-                    case 0x53: return PTOUCH_CMD_STATUS_REQUEST;  // ESC i S
-                    case 0x7A: return PTOUCH_CMD_INFO;            // ESC i z
-                    case 0x52: return PTOUCH_CMD_RASTER_START;    // ESC i R
-                    case 0x61: return PTOUCH_CMD_RASTER_START;    // ESC i a (P700)
-                    case 0x4D: return PTOUCH_CMD_PRECUT;          // ESC i M
-                    case 0x4B: return PTOUCH_CMD_D460BT_CHAIN;    // ESC i K
-                    case 0x64: return PTOUCH_CMD_D460BT_MAGIC;    // ESC i d
-                }
-            }
-            if (data[1] == 0x40) {
-                return PTOUCH_CMD_INIT;  // ESC @
-            }
-        }
-        
-        // PackBits enable command
-        if (data[0] == 0x4D && data[1] == 0x02) {
-            return PTOUCH_CMD_PACKBITS_ENABLE;
-        }
-        
-        // Raster line command
-        if (data[0] == 0x47) {
-            return PTOUCH_CMD_RASTER_LINE;
-        }
-        
-        // Single byte commands
-        if (length == 1) {
-            switch (data[0]) {
-                case 0x1A: return PTOUCH_CMD_FINALIZE;    // Print with feed
-                case 0x0C: return PTOUCH_CMD_CUT_PAPER;   // Form feed
-                case 0x5A: return PTOUCH_CMD_FEED_PAPER;  // Line feed
-            }
-        }
-    }
-    
-    // Check for long initialization sequence (100+ zeros + ESC @)
-    if (length >= 102) {
-        bool is_init = true;
-        for (size_t i = 0; i < 100; i++) {
-            if (data[i] != 0x00) {
-                is_init = false;
-                break;
-            }
-        }
-        if (is_init && data[100] == 0x1B && data[101] == 0x40) {
-            return PTOUCH_CMD_INIT;
-        }
+    ptouch_parser_t parser;
+    ptouch_parser_init(&parser, NULL, 0);
+    size_t used;
+    if (ptouch_parser_step(&parser, data, length, &used) != PTOUCH_PARSE_COMMAND) {
+        return PTOUCH_CMD_UNKNOWN;
     }
-    
-    return PTOUCH_CMD_UNKNOWN;
+    return parser.def->type;
 }
 
 const char* ptouch_debug_get_command_name(ptouch_protocol_cmd_t cmd) {
     switch (cmd) {
+        case PTOUCH_CMD_INVALIDATE:         return "INVALIDATE";
         case PTOUCH_CMD_INIT:               return "INIT";
         case PTOUCH_CMD_STATUS_REQUEST:     return "STATUS_REQ";
         case PTOUCH_CMD_INFO:               return "INFO";
-        case PTOUCH_CMD_PACKBITS_ENABLE:    return "PACKBITS_EN";
         case PTOUCH_CMD_RASTER_START:       return "RASTER_START";
+        case PTOUCH_CMD_PAGE_FLAGS:         return "PAGE_FLAGS";
+        case PTOUCH_CMD_ADVANCED_MODE:      return "ADVANCED_MODE";
+        case PTOUCH_CMD_MARGIN:             return "MARGIN";
+        case PTOUCH_CMD_CUT_EVERY:          return "CUT_EVERY";
+        case PTOUCH_CMD_COMPRESSION:        return "COMPRESSION";
         case PTOUCH_CMD_RASTER_LINE:        return "RASTER_LINE";
-        case PTOUCH_CMD_PRECUT:             return "PRECUT";
+        case PTOUCH_CMD_ZERO_LINE:          return "ZERO_LINE";
+        case PTOUCH_CMD_PRINT:              return "PRINT";
         case PTOUCH_CMD_FINALIZE:           return "FINALIZE";
-        case PTOUCH_CMD_D460BT_MAGIC:       return "D460BT_MAGIC";
-        case PTOUCH_CMD_D460BT_CHAIN:       return "D460BT_CHAIN";
-        case PTOUCH_CMD_PAGE_FLAGS:         return "PAGE_FLAGS";
-        case PTOUCH_CMD_FEED_PAPER:         return "FEED_PAPER";
-        case PTOUCH_CMD_CUT_PAPER:          return "CUT_PAPER";
         default:                            return "UNKNOWN";
     }
 }
 
-const char* ptouch_debug_get_command_description(const uint8_t* data, size_t length) {
-    static char desc[64];
-    ptouch_protocol_cmd_t cmd = ptouch_debug_identify_command(data, length);
-    
-    switch (cmd) {
-        case PTOUCH_CMD_INIT:
-            if (length >= 102) {
-                snprintf(desc, sizeof(desc), "Invalidate + Init (%zu bytes)", length);
-            } else {
-                snprintf(desc, sizeof(desc), "Init command");
-            }
-            break;
-        case PTOUCH_CMD_STATUS_REQUEST:
-            snprintf(desc, sizeof(desc), "Status request");
-            break;
-        case PTOUCH_CMD_INFO:
-            snprintf(desc, sizeof(desc), "Info command (%zu bytes)", length);
-            break;
-        case PTOUCH_CMD_PACKBITS_ENABLE:
-            snprintf(desc, sizeof(desc), "Enable PackBits compression");
-            break;
-        case PTOUCH_CMD_RASTER_START:
-            if (length >= 3 && data[1] == 0x69 && data[2] == 0x61) {
-                snprintf(desc, sizeof(desc), "Start raster mode (P700)");
-            } else {
-                snprintf(desc, sizeof(desc), "Start raster mode");
-            }
-            break;
-        case PTOUCH_CMD_RASTER_LINE:
-            snprintf(desc, sizeof(desc), "Raster line (%zu bytes)", length);
-            break;
-        case PTOUCH_CMD_PRECUT:
-            snprintf(desc, sizeof(desc), "Precut command");
-            break;
-        case PTOUCH_CMD_FINALIZE:
-            snprintf(desc, sizeof(desc), "Print and eject");
-            break;
-        case PTOUCH_CMD_D460BT_MAGIC:
-            snprintf(desc, sizeof(desc), "D460BT magic sequence");
-            break;
-        case PTOUCH_CMD_D460BT_CHAIN:
-            snprintf(desc, sizeof(desc), "D460BT chain command");
-            break;
-        case PTOUCH_CMD_FEED_PAPER:
-            snprintf(desc, sizeof(desc), "Feed paper (line feed)");
-            break;
-        case PTOUCH_CMD_CUT_PAPER:
-            snprintf(desc, sizeof(desc), "Cut paper (form feed)");
-            break;
-        default:
-            snprintf(desc, sizeof(desc), "Unknown command (%zu bytes)", length);
-            break;
+static void append(char* desc, size_t size, size_t* out, const char* format, ...) {
+    if (*out + 1 >= size) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(desc + *out, size - *out, format, args);
+    va_end(args);
+    if (n > 0) {
+        *out = *out + n < size ? *out + n : size - 1;
+    }
+}
+
+// Commands are listed after the first list_start bytes of desc
+static void append_command(char* desc, size_t size, size_t* out, size_t list_start,
+                           const char* name, unsigned repeat) {
+    if (!name) {
+        return;
+    }
+    append(desc, size, out, *out > list_start ? ", %s" : "%s", name);
+    if (repeat > 1) {
+        append(desc, size, out, " x%u", repeat);
+    }
+}
+
+// Split one OUT packet into commands, carrying on from where the parser
+// stopped in the previous packet. Returns the first command, the one
+// continued from the previous packet if it started there; unknown bytes
+// are counted in *errors.
+static ptouch_protocol_cmd_t describe_commands(ptouch_parser_t* parser, const uint8_t* data, size_t length,
+                                               char* desc, size_t size, uint32_t* errors) {
+    static const char unknown[] = "Unknown";
+    ptouch_protocol_cmd_t first = PTOUCH_CMD_UNKNOWN;
+    bool have_first = false;
+    const char* name = NULL;            // Command being counted
+    unsigned repeat = 0;
+    size_t out = 0;
+    
+    desc[0] = '\0';
+    if (!ptouch_parser_idle(parser)) {
+        first = parser->def ? parser->def->type : PTOUCH_CMD_UNKNOWN;
+        have_first = true;
+        append(desc, size, &out, "(cont.) ");
+    }
+    size_t list_start = out;
+    
+    size_t pos = 0;
+    while (pos < length) {
+        size_t used;
+        ptouch_parse_event_t event = ptouch_parser_step(parser, data + pos, length - pos, &used);
+        pos += used;
+        if (event != PTOUCH_PARSE_COMMAND && event != PTOUCH_PARSE_ERROR) {
+            continue;
+        }
+        
+        const char* next = unknown;
+        if (event == PTOUCH_PARSE_COMMAND) {
+            next = parser->def->name;
+        } else if (errors) {
+            (*errors)++;
+        }
+        if (!have_first) {
+            first = event == PTOUCH_PARSE_COMMAND ? parser->def->type : PTOUCH_CMD_UNKNOWN;
+            have_first = true;
+        }
+        if (next == name) {
+            repeat++;
+            continue;
+        }
+        append_command(desc, size, &out, list_start, name, repeat);
+        name = next;
+        repeat = 1;
+    }
+    append_command(desc, size, &out, list_start, name, repeat);
+    if (out == list_start) {
+        append(desc, size, &out, list_start > 0 ? "Line data" : "Partial command");
+    }
+    if (!ptouch_parser_idle(parser)) {
+        append(desc, size, &out, " ...");
+    }
+    return first;
+}
+
+const char* ptouch_debug_get_command_description(const uint8_t* data, size_t length, char* desc, size_t size) {
+    if (!desc || size == 0) {
+        return "";
+    }
+    if (!data || length == 0) {
+        snprintf(desc, size, "No data");
+        return desc;
     }
     
+    ptouch_parser_t parser;
+    ptouch_parser_init(&parser, NULL, 0);
+    describe_commands(&parser, data, length, desc, size, NULL);
     return desc;
 }
 
+// Decode a logged packet. OUT packets go through the parser, which keeps
+// its place from one packet to the next; packets from the printer are
+// status replies and are not commands.
+static ptouch_protocol_cmd_t decode_packet(ptouch_parser_t* parser, ptouch_packet_dir_t direction,
+                                           const uint8_t* data, size_t length, size_t captured,
+                                           char* desc, size_t size, uint32_t* errors) {
+    if (length == 0) {
+        snprintf(desc, size, "No data");
+        return PTOUCH_CMD_UNKNOWN;
+    }
+    if (direction == PTOUCH_PACKET_DIR_IN) {
+        snprintf(desc, size, length == 32 ? "Printer status" : "Printer reply");
+        return PTOUCH_CMD_UNKNOWN;
+    }
+    
+    ptouch_protocol_cmd_t cmd = describe_commands(parser, data, captured, desc, size, errors);
+    if (captured < length) {
+        // The rest of the packet was not kept, so where the next command starts is not known
+        ptouch_parser_reset(parser);
+    }
+    return cmd;
+}
+
 // Packet logging functions
+// Single producer: only the task doing USB transfers logs packets
+static void history_record(int64_t timestamp, ptouch_packet_dir_t direction, uint8_t endpoint,
+                           const uint8_t* data, size_t length, uint32_t transfer_status) {
+    packet_history_t* history = g_ptouch_debug_logger->packet_history;
+    if (!history) {
+        return;
+    }
+    
+    unsigned index = atomic_load_explicit(&history->head, memory_order_relaxed);
+    history_slot_t* slot = &history->slots[index & HISTORY_MASK];
+    
+    atomic_store_explicit(&slot->sequence, 2 * index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->timestamp = timestamp;
+    slot->transfer_status = transfer_status;
+    slot->length = length > UINT16_MAX ? UINT16_MAX : (uint16_t)length;
+    slot->direction = (uint8_t)direction;
+    slot->endpoint = endpoint;
+    if (length > 0) {
+        memcpy(slot->data, data, length < PTOUCH_DEBUG_HISTORY_PAYLOAD ? length : PTOUCH_DEBUG_HISTORY_PAYLOAD);
+    }
+    atomic_store_explicit(&slot->sequence, 2 * index + 2, memory_order_release);
+    atomic_store_explicit(&history->head, index + 1, memory_order_release);
+}
+
+// Copy packet index out of the ring and decode it with parser, which
+// must have seen the packets before it. False if it was overwritten
+// before or during the copy; the parser then starts over.
+static bool history_read(const packet_history_t* history, unsigned index, ptouch_packet_info_t* packet,
+                         ptouch_parser_t* parser) {
+    const history_slot_t* slot = &history->slots[index & HISTORY_MASK];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != 2 * index + 2) {
+        ptouch_parser_reset(parser);
+        return false;
+    }
+    
+    memset(packet, 0, sizeof(*packet));
+    packet->timestamp = slot->timestamp;
+    packet->transfer_status = slot->transfer_status;
+    packet->length = slot->length;
+    packet->direction = (ptouch_packet_dir_t)slot->direction;
+    packet->endpoint = slot->endpoint;
+    packet->captured = packet->length < PTOUCH_DEBUG_HISTORY_PAYLOAD ? packet->length : PTOUCH_DEBUG_HISTORY_PAYLOAD;
+    memcpy(packet->data, slot->data, packet->captured);
+    
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != 2 * index + 2) {
+        ptouch_parser_reset(parser);
+        return false;
+    }
+    
+    // Decoded here rather than when logged
+    packet->is_error = packet->transfer_status != 0;
+    packet->cmd_type = decode_packet(parser, packet->direction, packet->data, packet->length, packet->captured,
+                                     packet->cmd_description, sizeof(packet->cmd_description), NULL);
+    return true;
+}
+
+// Oldest packet index still in the ring and not cleared
+static unsigned history_first(const packet_history_t* history, unsigned head) {
+    unsigned start = atomic_load_explicit(&history->start, memory_order_relaxed);
+    unsigned oldest = head > PTOUCH_DEBUG_MAX_HISTORY_ENTRIES ? head - PTOUCH_DEBUG_MAX_HISTORY_ENTRIES : 0;
+    return (int)(start - oldest) > 0 ? start : oldest;
+}
+
 esp_err_t ptouch_debug_log_packet(ptouch_packet_dir_t direction, 
                                   uint8_t endpoint,
                                   const uint8_t* data, 
@@ -274,30 +395,19 @@ esp_err_t ptouch_debug_log_packet(ptouch_packet_dir_t direction,
         return ESP_OK;
     }
     
-    if (!data || length == 0) {
+    // Failed transfers are logged without data
+    if ((!data && length > 0) || (length == 0 && transfer_status == 0)) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    // Create packet info
-    ptouch_packet_info_t packet_info = {0};
-    packet_info.timestamp = esp_timer_get_time();
-    packet_info.direction = direction;
-    packet_info.endpoint = endpoint;
-    packet_info.length = length > PTOUCH_DEBUG_MAX_PACKET_SIZE ? PTOUCH_DEBUG_MAX_PACKET_SIZE : length;
-    packet_info.transfer_status = transfer_status;
-    packet_info.is_error = (transfer_status != 0);
-    
-    // Copy data
-    memcpy(packet_info.data, data, packet_info.length);
-    
-    // Analyze protocol command
-    packet_info.cmd_type = ptouch_debug_identify_command(data, length);
-    strncpy(packet_info.cmd_description, ptouch_debug_get_command_description(data, length), 
-            sizeof(packet_info.cmd_description) - 1);
+    // Only the raw bytes are kept here; packets are decoded when the
+    // history is read, or below when they are printed as they pass
+    int64_t timestamp = esp_timer_get_time();
+    bool is_error = (transfer_status != 0);
     
     // Update statistics
     g_ptouch_debug_logger->stats.total_packets++;
-    g_ptouch_debug_logger->stats.last_packet_time = packet_info.timestamp;
+    g_ptouch_debug_logger->stats.last_packet_time = timestamp;
     
     if (direction == PTOUCH_PACKET_DIR_OUT) {
         g_ptouch_debug_logger->stats.packets_out++;
@@ -307,27 +417,32 @@ esp_err_t ptouch_debug_log_packet(ptouch_packet_dir_t direction,
         g_ptouch_debug_logger->stats.bytes_received += length;
     }
     
-    if (packet_info.is_error) {
+    if (is_error) {
         g_ptouch_debug_logger->stats.errors++;
     }
     
-    // Store in packet history (simplified - disabled for now)
-    // TODO: Implement simple circular buffer if needed
+    history_record(timestamp, direction, endpoint, data, length, transfer_status);
     
-    // Log packet based on debug level
-    const char* dir_str = (direction == PTOUCH_PACKET_DIR_OUT) ? "OUT" : "IN";
-    const char* cmd_name = ptouch_debug_get_command_name(packet_info.cmd_type);
-    
-    if (g_ptouch_debug_logger->level >= PTOUCH_DEBUG_LEVEL_INFO) {
+    // Log packet based on debug level. The parser only follows the stream
+    // while packets are printed, so it starts over when they are turned on.
+    if (PTOUCH_DEBUG_COMPILED(PTOUCH_DEBUG_LEVEL_INFO) &&
+        g_ptouch_debug_logger->level >= PTOUCH_DEBUG_LEVEL_INFO) {
+        char desc[96];
+        ptouch_protocol_cmd_t cmd = decode_packet(&live_parser, direction, data, length, length, desc, sizeof(desc),
+                                                  &g_ptouch_debug_logger->stats.protocol_errors);
         ESP_LOGI(TAG, "%s EP:0x%02X [%s] %s (%zu bytes)", 
-                dir_str, endpoint, cmd_name, packet_info.cmd_description, length);
+                (direction == PTOUCH_PACKET_DIR_OUT) ? "OUT" : "IN", endpoint,
+                ptouch_debug_get_command_name(cmd), desc, length);
+    } else {
+        ptouch_parser_reset(&live_parser);
     }
     
-    if (g_ptouch_debug_logger->level >= PTOUCH_DEBUG_LEVEL_DEBUG) {
+    if (PTOUCH_DEBUG_COMPILED(PTOUCH_DEBUG_LEVEL_DEBUG) &&
+        g_ptouch_debug_logger->level >= PTOUCH_DEBUG_LEVEL_DEBUG && length > 0) {
         ESP_LOG_BUFFER_HEX_LEVEL(TAG, data, length, ESP_LOG_DEBUG);
     }
     
-    if (packet_info.is_error) {
+    if (is_error) {
         ESP_LOGE(TAG, "Transfer error: %s", ptouch_debug_get_transfer_status_string(transfer_status));
     }
     
@@ -354,6 +469,29 @@ ptouch_debug_stats_t ptouch_debug_get_stats(void) {
     return g_ptouch_debug_logger->stats;
 }
 
+// Record one label's transmission and how much of it overlapped the
+// previous label's mechanical phase
+void ptouch_debug_log_label(int64_t tx_us, int64_t overlap_us) {
+    if (!PTOUCH_DEBUG_ENABLED()) {
+        return;
+    }
+    
+    ptouch_debug_stats_t* stats = &g_ptouch_debug_logger->stats;
+    stats->labels_sent++;
+    if (overlap_us > 0) {
+        stats->labels_overlapped++;
+    }
+    stats->last_label_tx_us = tx_us;
+    stats->last_label_overlap_us = overlap_us;
+    stats->total_label_tx_us += tx_us;
+    stats->total_label_overlap_us += overlap_us;
+    
+    if (g_ptouch_debug_logger->level >= PTOUCH_DEBUG_LEVEL_INFO) {
+        ESP_LOGI(TAG, "Label %lu sent in %lld ms, %lld ms overlapped with previous label",
+                 (unsigned long)stats->labels_sent, (long long)(tx_us / 1000), (long long)(overlap_us / 1000));
+    }
+}
+
 void ptouch_debug_reset_stats(void) {
     if (!g_ptouch_debug_logger) {
         return;
@@ -387,6 +525,15 @@ void ptouch_debug_print_stats(void) {
         printf("Packet rate: %.2f packets/sec\n", (double)stats->total_packets / duration_sec);
         printf("Throughput: %.2f bytes/sec\n", (double)(stats->bytes_sent + stats->bytes_received) / duration_sec);
     }
+    if (stats->labels_sent > 0) {
+        printf("Labels: %lu sent, %lu overlapped with feed/cut\n",
+               (unsigned long)stats->labels_sent, (unsigned long)stats->labels_overlapped);
+        printf("  Last label: %lld ms transfer, %lld ms overlapped\n",
+               (long long)(stats->last_label_tx_us / 1000), (long long)(stats->last_label_overlap_us / 1000));
+        printf("  Average: %lld ms transfer, %lld ms overlapped\n",
+               (long long)(stats->total_label_tx_us / stats->labels_sent / 1000),
+               (long long)(stats->total_label_overlap_us / stats->labels_sent / 1000));
+    }
     printf("===============================\n\n");
 }
 
@@ -494,11 +641,37 @@ void ptouch_debug_print_packet_history(size_t count) {
         return;
     }
     
+    packet_history_t* history = g_ptouch_debug_logger->packet_history;
+    if (!history) {
+        printf("No packet history available (out of memory)\n");
+        return;
+    }
+    
+    // Every packet still in the ring is decoded, so commands that started
+    // before the ones shown are followed into them
+    unsigned head = atomic_load_explicit(&history->head, memory_order_acquire);
+    unsigned first = history_first(history, head);
+    unsigned shown = head - first > count ? head - count : first;
+    
     printf("\n=== Packet History (last %zu packets) ===\n", count);
-    printf("No packet history available (feature disabled)\n");
-    printf("Use real-time logging or statistics instead:\n");
-    printf("  - debug_level verbose  # Enable verbose logging\n");
-    printf("  - debug_stats          # Show statistics\n");
+    ptouch_parser_t parser;
+    ptouch_parser_init(&parser, NULL, 0);
+    ptouch_packet_info_t packet;
+    for (unsigned index = first; index != head; index++) {
+        if (!history_read(history, index, &packet, &parser) || (int)(index - shown) < 0) {
+            continue;
+        }
+        printf("%10lld us %-3s EP:0x%02X [%s] %s (%zu bytes)%s%s\n",
+               (long long)packet.timestamp, packet.direction == PTOUCH_PACKET_DIR_OUT ? "OUT" : "IN",
+               packet.endpoint, ptouch_debug_get_command_name(packet.cmd_type), packet.cmd_description,
+               packet.length, packet.is_error ? " " : "",
+               packet.is_error ? ptouch_debug_get_transfer_status_string(packet.transfer_status) : "");
+        if (g_ptouch_debug_logger->level >= PTOUCH_DEBUG_LEVEL_VERBOSE) {
+            for (size_t i = 0; i < packet.captured; i++) {
+                printf("%02X%s", packet.data[i], (i + 1) % 16 == 0 || i + 1 == packet.captured ? "\n" : " ");
+            }
+        }
+    }
     printf("=====================================\n\n");
 }
 
@@ -507,8 +680,25 @@ esp_err_t ptouch_debug_get_packet_history(ptouch_packet_info_t* packets, size_t
         return ESP_ERR_INVALID_ARG;
     }
     
-    // Simplified - no packet history for now
+    // The newest max_count packets, oldest first
     *actual_count = 0;
+    packet_history_t* history = g_ptouch_debug_logger->packet_history;
+    if (!history || max_count == 0) {
+        return ESP_OK;
+    }
+    
+    // Older packets are decoded into the first entry and overwritten, to
+    // bring the parser up to the ones returned
+    unsigned head = atomic_load_explicit(&history->head, memory_order_acquire);
+    unsigned first = history_first(history, head);
+    unsigned shown = head - first > max_count ? head - max_count : first;
+    ptouch_parser_t parser;
+    ptouch_parser_init(&parser, NULL, 0);
+    for (unsigned index = first; index != head; index++) {
+        if (history_read(history, index, &packets[*actual_count], &parser) && (int)(index - shown) >= 0) {
+            (*actual_count)++;
+        }
+    }
     return ESP_OK;
 }
 
@@ -517,8 +707,12 @@ void ptouch_debug_clear_history(void) {
         return;
     }
     
-    // Simplified - no packet history to clear
-    // TODO: Implement if simple circular buffer is added
+    // The writer is never stopped; readers just start after this point
+    packet_history_t* history = g_ptouch_debug_logger->packet_history;
+    if (history) {
+        atomic_store_explicit(&history->start, atomic_load_explicit(&history->head, memory_order_acquire),
+                              memory_order_relaxed);
+    }
 }
 
 // Console command registration
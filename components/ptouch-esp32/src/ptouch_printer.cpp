@@ -72,7 +72,7 @@ static const pt_tape_info tape_info[] = {
 PtouchPrinter::PtouchPrinter() 
     : client_hdl(nullptr), device_hdl(nullptr), device_info(nullptr), 
       status(nullptr), tape_width_px(0), is_connected(false), is_initialized(false), 
-      verbose_mode(false), usb_host_installed(false), bulk_out_ep(0), bulk_in_ep(0) {
+      verbose_mode(false), usb_host_installed(false), chain_open(false), cancel_requested(false), printed_count(0), printed_owed(0), printed_at_ready(0), usb_stats(), in_transfer(nullptr), in_pending(false), step_hook(nullptr), step_hook_ctx(nullptr), bulk_out_ep(0), bulk_in_ep(0) {
     status = new ptouch_stat();
     memset(status, 0, sizeof(ptouch_stat));
     
@@ -351,11 +351,14 @@ bool PtouchPrinter::getEndpoints() {
 
 // Disconnect from printer
 void PtouchPrinter::disconnect() {
+    cancelReceive();
+    printed_owed = 0;
     if (is_connected) {
         releaseInterface();
         is_connected = false;
         is_initialized = false;
     }
+    chain_open = false;
     
     if (device_hdl) {
         usb_host_device_close(client_hdl, device_hdl);
@@ -415,9 +418,12 @@ int PtouchPrinter::usbSend(uint8_t *data, size_t len) {
     PTOUCH_DEBUG_LOG_PACKET_OUT(bulk_out_ep, data, len, 0);
     
     // Submit transfer
+    int64_t submitted_at = esp_timer_get_time();
+    usb_stats.transfers++;
     err = usb_host_transfer_submit(transfer);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to submit USB transfer: %s", esp_err_to_name(err));
+        usb_stats.errors++;
         usb_host_transfer_free(transfer);
         return -1;
     }
@@ -428,15 +434,18 @@ int PtouchPrinter::usbSend(uint8_t *data, size_t len) {
         usb_host_client_handle_events(client_hdl, 1);
         vTaskDelay(pdMS_TO_TICKS(1));
     }
+    usb_stats.busy_us += esp_timer_get_time() - submitted_at;
     
     int result = -1;
     if (transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
         result = transfer->actual_num_bytes;
+        usb_stats.bytes_out += result;
         if (verbose_mode) {
             ESP_LOGI(TAG, "Sent %d bytes to printer", result);
         }
     } else {
         ESP_LOGE(TAG, "USB transfer failed with status: %d", transfer->status);
+        usb_stats.errors++;
         // Log transfer error
         PTOUCH_DEBUG_LOG_PACKET_OUT(bulk_out_ep, data, len, transfer->status);
     }
@@ -445,64 +454,108 @@ int PtouchPrinter::usbSend(uint8_t *data, size_t len) {
     return result;
 }
 
-// Receive data from printer via USB
-int PtouchPrinter::usbReceive(uint8_t *data, size_t len) {
+// Receive data from printer via USB. One IN transfer is kept for the
+// connection: a read that times out leaves it queued and returns 0, so a
+// status the printer sends later completes that transfer and is returned
+// by the next read instead of being lost.
+int PtouchPrinter::usbReceive(uint8_t *data, size_t len, uint32_t timeout_ms) {
     if (!is_connected || !device_hdl) {
         ESP_LOGE(TAG, "Printer not connected");
         return -1;
     }
     
-    // Create USB transfer
-    usb_transfer_t *transfer = nullptr;
-    esp_err_t err = usb_host_transfer_alloc(len, 0, &transfer);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to allocate USB transfer: %s", esp_err_to_name(err));
+    if (len > PTOUCH_MAX_PACKET_SIZE) {
+        ESP_LOGE(TAG, "Receive buffer too large for single packet");
         return -1;
     }
     
-    // Fill transfer
-    transfer->device_handle = device_hdl;
-    transfer->bEndpointAddress = bulk_in_ep;
-    transfer->callback = nullptr;
-    transfer->context = this;
-    transfer->num_bytes = len;
+    esp_err_t err;
+    if (!in_transfer) {
+        err = usb_host_transfer_alloc(PTOUCH_MAX_PACKET_SIZE, 0, &in_transfer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to allocate USB transfer: %s", esp_err_to_name(err));
+            in_transfer = nullptr;
+            return -1;
+        }
+        in_transfer->device_handle = device_hdl;
+        in_transfer->bEndpointAddress = bulk_in_ep;
+        in_transfer->callback = in_transfer_cb;
+        in_transfer->context = this;
+    }
     
-    // Submit transfer
-    err = usb_host_transfer_submit(transfer);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to submit USB transfer: %s", esp_err_to_name(err));
-        usb_host_transfer_free(transfer);
-        return -1;
+    if (!in_pending) {
+        in_transfer->num_bytes = len;
+        in_pending = true;
+        usb_stats.transfers++;
+        err = usb_host_transfer_submit(in_transfer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to submit USB transfer: %s", esp_err_to_name(err));
+            in_pending = false;
+            usb_stats.errors++;
+            return -1;
+        }
     }
     
-    // Wait for completion
-    int attempts = 1000;
-    while (transfer->status == USB_TRANSFER_STATUS_COMPLETED + 1 && attempts-- > 0) {
+    // The callback runs from usb_host_client_handle_events() on this task
+    int64_t waited_from = esp_timer_get_time();
+    int64_t deadline = waited_from + (int64_t)timeout_ms * 1000;
+    while (true) {
         usb_host_client_handle_events(client_hdl, 1);
+        if (!in_pending || esp_timer_get_time() >= deadline) {
+            break;
+        }
         vTaskDelay(pdMS_TO_TICKS(1));
     }
+    usb_stats.busy_us += esp_timer_get_time() - waited_from;
+    
+    if (in_pending) {
+        return 0;
+    }
     
     int result = -1;
-    if (transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
-        result = transfer->actual_num_bytes;
-        memcpy(data, transfer->data_buffer, result);
+    if (in_transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
+        result = in_transfer->actual_num_bytes < (int)len ? in_transfer->actual_num_bytes : (int)len;
+        memcpy(data, in_transfer->data_buffer, result);
         if (verbose_mode && result > 0) {
             ESP_LOGI(TAG, "Received %d bytes from printer", result);
         }
         
         // Log incoming packet
         if (result > 0) {
-            PTOUCH_DEBUG_LOG_PACKET_IN(bulk_in_ep, transfer->data_buffer, result, 0);
+            PTOUCH_DEBUG_LOG_PACKET_IN(bulk_in_ep, in_transfer->data_buffer, result, 0);
         }
     } else {
+        usb_stats.errors++;
         // Log transfer error
-        PTOUCH_DEBUG_LOG_PACKET_IN(bulk_in_ep, nullptr, 0, transfer->status);
+        PTOUCH_DEBUG_LOG_PACKET_IN(bulk_in_ep, nullptr, 0, in_transfer->status);
     }
     
-    usb_host_transfer_free(transfer);
     return result;
 }
 
+void PtouchPrinter::in_transfer_cb(usb_transfer_t *transfer) {
+    static_cast<PtouchPrinter*>(transfer->context)->in_pending = false;
+}
+
+// Take back the IN transfer before the interface goes: a queued one is
+// flushed, which completes it as cancelled, and only then freed
+void PtouchPrinter::cancelReceive() {
+    if (in_pending && device_hdl) {
+        usb_host_endpoint_halt(device_hdl, bulk_in_ep);
+        usb_host_endpoint_flush(device_hdl, bulk_in_ep);
+        for (int i = 0; in_pending && i < 100; i++) {
+            usb_host_client_handle_events(client_hdl, 1);
+        }
+        usb_host_endpoint_clear(device_hdl, bulk_in_ep);
+    }
+    
+    // Still owned by the driver if the flush did not complete it
+    if (in_transfer && !in_pending) {
+        usb_host_transfer_free(in_transfer);
+        in_transfer = nullptr;
+    }
+}
+
 // Initialize printer (ported from original library)
 int PtouchPrinter::initPrinter() {
     if (!device_info) return -1;
@@ -534,6 +587,14 @@ int PtouchPrinter::initPrinter() {
     return 0;
 }
 
+// Drop a half-sent page: invalidate and re-initialise so the printer is
+// back at a command boundary
+bool PtouchPrinter::abortPrint() {
+    ESP_LOGW(TAG, "Print cancelled, resynchronising printer");
+    chain_open = false;
+    return initPrinter() == 0;
+}
+
 // Enable PackBits compression
 int PtouchPrinter::enablePackBits() {
     uint8_t cmd[] = {0x4d, 0x02};  // 4D 02 = enable packbits compression mode - FIXED
@@ -644,6 +705,35 @@ int PtouchPrinter::getDPI() const {
     return device_info ? device_info->dpi : 0;
 }
 
+// Read one 32-byte status message, a reply or an unsolicited notification
+bool PtouchPrinter::readStatusMessage(uint32_t timeout_ms) {
+    uint8_t response[32];
+    int received = usbReceive(response, sizeof(response), timeout_ms);
+    
+    if (received != 32) {
+        return false;
+    }
+    
+    memcpy(status, response, 32);
+    if (status->status_type == PTOUCH_STATUS_TYPE_PRINTED) {
+        // A late notification was counted when it was expected
+        if (printed_owed > 0) {
+            printed_owed--;
+        } else {
+            printed_count++;
+        }
+    }
+    
+    // Calculate tape width in pixels
+    for (int i = 0; tape_info[i].mm != 0; i++) {
+        if (tape_info[i].mm == status->media_width) {
+            tape_width_px = tape_info[i].px;
+            break;
+        }
+    }
+    return true;
+}
+
 // Get status from printer
 bool PtouchPrinter::getStatus() {
     if (!is_connected) return false;
@@ -653,35 +743,94 @@ bool PtouchPrinter::getStatus() {
         return false;
     }
     
-    uint8_t response[32];
-    int received = usbReceive(response, sizeof(response));
+    // Print-complete and phase-change notifications queued while a label
+    // was printing arrive ahead of the reply
+    for (int i = 0; i < PTOUCH_STATUS_MAX_MESSAGES; i++) {
+        if (!readStatusMessage()) {
+            return false;
+        }
+        if (status->status_type == PTOUCH_STATUS_TYPE_REPLY ||
+            status->status_type == PTOUCH_STATUS_TYPE_ERROR) {
+            break;
+        }
+    }
     
-    if (received == 32) {
-        memcpy(status, response, 32);
-        
-        // Calculate tape width in pixels
-        for (int i = 0; tape_info[i].mm != 0; i++) {
-            if (tape_info[i].mm == status->media_width) {
-                tape_width_px = tape_info[i].px;
-                break;
+    if (verbose_mode) {
+        ESP_LOGI(TAG, "Tape width: %d mm (%d px)", status->media_width, tape_width_px);
+        ESP_LOGI(TAG, "Media type: %s", getMediaType());
+        ESP_LOGI(TAG, "Tape color: %s", getTapeColor());
+    }
+    
+    return true;
+}
+
+// Wait for print-complete notifications
+ptouch_wait_t PtouchPrinter::waitForPrinted(uint32_t target, uint32_t timeout_ms) {
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    
+    // Signed difference so the counter may wrap
+    while ((int32_t)(printed_count - target) < 0) {
+        if (!is_connected) {
+            return PTOUCH_WAIT_ERROR;
+        }
+        int64_t left_ms = (deadline - esp_timer_get_time()) / 1000;
+        uint32_t poll_ms = left_ms <= 0 ? 0 : left_ms < PTOUCH_STATUS_POLL_MS ? (uint32_t)left_ms : PTOUCH_STATUS_POLL_MS;
+        if (readStatusMessage(poll_ms)) {
+            if (status->status_type == PTOUCH_STATUS_TYPE_ERROR || hasError()) {
+                ESP_LOGW(TAG, "Printer error while waiting for label: %s", getErrorDescription());
+                return PTOUCH_WAIT_ERROR;
             }
+            continue;
         }
-        
-        if (verbose_mode) {
-            ESP_LOGI(TAG, "Tape width: %d mm (%d px)", status->media_width, tape_width_px);
-            ESP_LOGI(TAG, "Media type: %s", getMediaType());
-            ESP_LOGI(TAG, "Tape color: %s", getTapeColor());
+        if (esp_timer_get_time() >= deadline) {
+            if (timeout_ms > 0) {
+                ESP_LOGW(TAG, "No print-complete status after %lu ms", (unsigned long)timeout_ms);
+            }
+            return PTOUCH_WAIT_TIMEOUT;
+        }
+        // A failed transfer is not retried at once
+        if (!in_pending) {
+            vTaskDelay(pdMS_TO_TICKS(PTOUCH_STATUS_POLL_MS));
         }
-        
-        return true;
     }
-    
-    return false;
+    return PTOUCH_WAIT_PRINTED;
+}
+
+void PtouchPrinter::expectPrinted(uint32_t target) {
+    if ((int32_t)(printed_count - target) < 0) {
+        printed_owed += target - printed_count;
+        printed_count = target;
+    }
 }
 
 // Check if printer has error
 bool PtouchPrinter::hasError() const {
-    return status && (status->error != 0);
+    return status && (status->error & ~PTOUCH_ERROR_BUFFER_FULL) != 0;
+}
+
+// Check if the printer is still printing, feeding or cutting a label
+bool PtouchPrinter::isPrinting() const {
+    return status && status->phase_type == PTOUCH_PHASE_PRINTING;
+}
+
+// Wait until the printer can accept the next label
+bool PtouchPrinter::waitForDataReady(uint32_t timeout_ms) {
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    
+    while (true) {
+        if (cancel_requested.load() || !getStatus() || hasError()) {
+            return false;
+        }
+        if (!(status->error & PTOUCH_ERROR_BUFFER_FULL)) {
+            printed_at_ready = printed_count;
+            return true;
+        }
+        if (esp_timer_get_time() >= deadline) {
+            ESP_LOGW(TAG, "Printer buffer still full after %lu ms", (unsigned long)timeout_ms);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(PTOUCH_STATUS_POLL_MS));
+    }
 }
 
 // Get error description
@@ -853,7 +1002,9 @@ bool PtouchPrinter::finalizePrint(bool chain) {
     // D460BT devices use a leading packet to indicate chaining instead
     uint8_t *cmd = (chain && (!(device_info->flags & FLAG_D460BT_MAGIC))) ? cmd_chain : cmd_eject;
     
-    return (usbSend(cmd, 1) > 0);
+    if (usbSend(cmd, 1) <= 0) return false;
+    chain_open = chain;
+    return true;
 }
 
 // Set page flags for printing
@@ -886,28 +1037,10 @@ bool PtouchPrinter::cutPaper() {
 
 // Print methods implementation
 
-// Print bitmap data
-bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bool chain) {
-    if (!is_connected || !bitmap || width <= 0 || height <= 0) {
-        ESP_LOGE(TAG, "Invalid print parameters");
-        return false;
-    }
-    
-    // Check if width exceeds printer capabilities
-    if (width > device_info->max_px) {
-        ESP_LOGE(TAG, "Image width (%d) exceeds printer max width (%d)", width, device_info->max_px);
-        return false;
-    }
-    
-    // Get printer status first
-    if (!getStatus()) {
-        ESP_LOGE(TAG, "Failed to get printer status");
-        return false;
-    }
-    
-    // Check for errors
-    if (hasError()) {
-        ESP_LOGE(TAG, "Printer error: %s", getErrorDescription());
+// Label header: mode, compression, info and precut, then raster mode
+bool PtouchPrinter::beginRaster(int lines, bool chain) {
+    if (!is_connected || !device_info) {
+        ESP_LOGE(TAG, "Printer not connected");
         return false;
     }
     
@@ -939,18 +1072,80 @@ bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bo
     
     // Send info command for newer printers
     if (device_info->flags & FLAG_USE_INFO_CMD) {
-        if (sendInfoCommand(height) != 0) {
+        if (sendInfoCommand(lines) != 0) {
             ESP_LOGE(TAG, "Failed to send info command");
             return false;
         }
     }
     
+    // Precut once at the start of a session; chained labels share it
+    if ((device_info->flags & FLAG_HAS_PRECUT) && !chain_open) {
+        if (sendPreCutCommand(1) != 0) {
+            ESP_LOGE(TAG, "Failed to send precut command");
+            return false;
+        }
+    }
+    
     // Start raster mode
     if (rasterStart() != 0) {
         ESP_LOGE(TAG, "Failed to start raster mode");
         return false;
     }
     
+    return true;
+}
+
+// Send one uncompressed raster line, wrapped in a raster line command
+bool PtouchPrinter::sendRasterRow(const uint8_t *row, size_t len) {
+    return sendRasterLine((uint8_t*)row, len) == 0;
+}
+
+// Forward pre-encoded raster commands unchanged. Command boundaries do not
+// matter to the printer, so the data is cut at packet size.
+bool PtouchPrinter::sendRasterData(const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t packet = len < PTOUCH_MAX_PACKET_SIZE ? len : PTOUCH_MAX_PACKET_SIZE;
+        if (usbSend((uint8_t*)data, packet) <= 0) {
+            return false;
+        }
+        data += packet;
+        len -= packet;
+    }
+    return true;
+}
+
+bool PtouchPrinter::usesPackBits() const {
+    return device_info && (device_info->flags & FLAG_RASTER_PACKBITS);
+}
+
+// Print bitmap data
+bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bool chain) {
+    if (!is_connected || !bitmap || width <= 0 || height <= 0) {
+        ESP_LOGE(TAG, "Invalid print parameters");
+        return false;
+    }
+    
+    // Check if width exceeds printer capabilities
+    if (width > device_info->max_px) {
+        ESP_LOGE(TAG, "Image width (%d) exceeds printer max width (%d)", width, device_info->max_px);
+        return false;
+    }
+    
+    // The previous label may still be feeding or cutting; start sending as
+    // soon as the printer has room instead of waiting for it to go idle
+    int64_t step_start = esp_timer_get_time();
+    if (!waitForDataReady()) {
+        ESP_LOGE(TAG, "Printer not ready: %s", getErrorDescription());
+        return false;
+    }
+    bool overlapped = isPrinting();
+    int64_t tx_start = traceStep(PTOUCH_STEP_STATUS, step_start);
+    
+    if (!beginRaster(height, chain)) {
+        return false;
+    }
+    step_start = traceStep(PTOUCH_STEP_PREAMBLE, tx_start);
+    
     // Calculate bytes per line
     int bytes_per_line = (width + 7) / 8;
     
@@ -962,10 +1157,18 @@ bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bo
     for (int y = 0; y < height; y++) {
         const uint8_t *line_data = bitmap + (y * bytes_per_line);
         
+        if (cancel_requested.load()) {
+            abortPrint();
+            return false;
+        }
+        
         if (sendRasterLine((uint8_t*)line_data, bytes_per_line) != 0) {
             ESP_LOGE(TAG, "Failed to send raster line %d", y);
             return false;
         }
+        if ((y + 1) % PTOUCH_TRACE_BAND_LINES == 0 || y + 1 == height) {
+            step_start = traceStep(PTOUCH_STEP_BAND, step_start, y - y % PTOUCH_TRACE_BAND_LINES);
+        }
     }
     
     // Finalize the print
@@ -973,6 +1176,9 @@ bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bo
         ESP_LOGE(TAG, "Failed to finalize print");
         return false;
     }
+    traceStep(PTOUCH_STEP_FINALIZE, step_start);
+    
+    PTOUCH_DEBUG_LOG_LABEL(tx_start, overlapped);
     
     if (verbose_mode) {
         ESP_LOGI(TAG, "Print completed successfully");
@@ -981,6 +1187,14 @@ bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bo
     return true;
 }
 
+int64_t PtouchPrinter::traceStep(ptouch_step_t step, int64_t start_us, uint32_t arg) {
+    int64_t now = esp_timer_get_time();
+    if (step_hook) {
+        step_hook(step, start_us, now, arg, step_hook_ctx);
+    }
+    return now;
+}
+
 // Print image data (wrapper for bitmap)
 bool PtouchPrinter::printImage(const uint8_t *imageData, int width, int height, bool chain) {
     return printBitmap(imageData, width, height, chain);
@@ -39,11 +39,15 @@ bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bo
         return false;
     }
     
-    // Get printer status and tape width
-    if (!getStatus()) {
-        ESP_LOGE(TAG, "Failed to get printer status");
+    // Get printer status and tape width; a previous label may still be
+    // feeding or cutting, which does not block sending this one
+    int64_t step_start = esp_timer_get_time();
+    if (!waitForDataReady()) {
+        ESP_LOGE(TAG, "Printer not ready: %s", getErrorDescription());
         return false;
     }
+    bool overlapped = isPrinting();
+    int64_t tx_start = traceStep(PTOUCH_STEP_STATUS, step_start);
     
     int max_pixels = getMaxWidth();
     int tape_width = getTapeWidth();
@@ -91,18 +95,25 @@ bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bo
         }
     }
     
-    // Send pre-cut command if supported
-    if (device_info->flags & FLAG_HAS_PRECUT) {
+    // Send pre-cut command once per session if supported
+    if ((device_info->flags & FLAG_HAS_PRECUT) && !chain_open) {
         if (sendPreCutCommand(1) != 0) {
             ESP_LOGE(TAG, "Failed to send precut command");
             return false;
         }
     }
     
+    step_start = traceStep(PTOUCH_STEP_PREAMBLE, tx_start);
+    
     // Send raster data line by line
     uint8_t raster_line[max_pixels / 8];
     
     for (int x = 0; x < width; x++) {
+        if (cancel_requested.load()) {
+            abortPrint();
+            return false;
+        }
+        
         memset(raster_line, 0, sizeof(raster_line));
         
         // Build raster line from bitmap
@@ -122,6 +133,9 @@ bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bo
             ESP_LOGE(TAG, "Failed to send raster line %d", x);
             return false;
         }
+        if ((x + 1) % PTOUCH_TRACE_BAND_LINES == 0 || x + 1 == width) {
+            step_start = traceStep(PTOUCH_STEP_BAND, step_start, x - x % PTOUCH_TRACE_BAND_LINES);
+        }
     }
     
     // Finalize print job
@@ -129,6 +143,9 @@ bool PtouchPrinter::printBitmap(const uint8_t *bitmap, int width, int height, bo
         ESP_LOGE(TAG, "Failed to finalize print");
         return false;
     }
+    traceStep(PTOUCH_STEP_FINALIZE, step_start);
+    
+    PTOUCH_DEBUG_LOG_LABEL(tx_start, overlapped);
     
     if (verbose_mode) {
         ESP_LOGI(TAG, "Print job completed successfully");
@@ -303,6 +320,7 @@ bool PtouchPrinter::finalizePrint(bool chain) {
             return false;
         }
     }
+    chain_open = chain;
     
     return true;
 } 
\ No newline at end of file
@@ -0,0 +1,129 @@
+/*
+ * P-touch ESP32 Raster Protocol Parser
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ptouch_protocol.h"
+#include <string.h>
+
+const ptouch_command_def_t ptouch_protocol_commands[] = {
+    {{0x00},           1, 0,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_INVALIDATE,     "Invalidate"},
+    {{0x1B, '@'},      2, 0,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_INIT,           "Initialize"},
+    {{0x1B, 'i', 'S'}, 3, 0,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_STATUS_REQUEST, "Status request"},
+    {{0x1B, 'i', 'z'}, 3, 10, PTOUCH_LENGTH_NONE,   PTOUCH_CMD_INFO,           "Print information"},
+    {{0x1B, 'i', 'a'}, 3, 1,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_RASTER_START,   "Command mode"},
+    {{0x1B, 'i', 'R'}, 3, 1,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_RASTER_START,   "Graphics mode"},
+    {{0x1B, 'i', 'M'}, 3, 1,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_PAGE_FLAGS,     "Various mode"},
+    {{0x1B, 'i', 'K'}, 3, 1,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_ADVANCED_MODE,  "Advanced mode"},
+    {{0x1B, 'i', 'd'}, 3, 2,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_MARGIN,         "Margin"},
+    {{0x1B, 'i', 'A'}, 3, 1,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_CUT_EVERY,      "Cut every n labels"},
+    {{'M'},            1, 1,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_COMPRESSION,    "Compression mode"},
+    {{'G'},            1, 2,  PTOUCH_LENGTH_LE16,   PTOUCH_CMD_RASTER_LINE,    "Raster line"},
+    {{'g'},            1, 2,  PTOUCH_LENGTH_SECOND, PTOUCH_CMD_RASTER_LINE,    "Raster line"},
+    {{'Z'},            1, 0,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_ZERO_LINE,      "Empty raster line"},
+    {{0x0C},           1, 0,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_PRINT,          "Print"},
+    {{0x1A},           1, 0,  PTOUCH_LENGTH_NONE,   PTOUCH_CMD_FINALIZE,       "Print and eject"},
+};
+
+const size_t ptouch_protocol_command_count = sizeof(ptouch_protocol_commands) / sizeof(ptouch_protocol_commands[0]);
+
+void ptouch_parser_init(ptouch_parser_t *parser, const ptouch_command_def_t *table, size_t table_len)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->table = table ? table : ptouch_protocol_commands;
+    parser->table_len = table ? table_len : ptouch_protocol_command_count;
+}
+
+void ptouch_parser_reset(ptouch_parser_t *parser)
+{
+    parser->code_len = 0;
+    parser->in_args = false;
+    parser->arg_len = 0;
+    parser->remaining = 0;
+}
+
+// The entry whose code is the bytes read so far. *partial is set when the
+// bytes only start a longer code.
+static const ptouch_command_def_t *lookup(const ptouch_parser_t *parser, bool *partial)
+{
+    *partial = false;
+    for (size_t i = 0; i < parser->table_len; i++) {
+        const ptouch_command_def_t *def = &parser->table[i];
+        if (def->code_len < parser->code_len || memcmp(def->code, parser->code, parser->code_len) != 0) {
+            continue;
+        }
+        if (def->code_len == parser->code_len) {
+            return def;
+        }
+        *partial = true;
+    }
+    return NULL;
+}
+
+static uint16_t data_length(const ptouch_parser_t *parser)
+{
+    switch (parser->def->length) {
+        case PTOUCH_LENGTH_LE16:   return parser->args[0] | (uint16_t)parser->args[1] << 8;
+        case PTOUCH_LENGTH_SECOND: return parser->args[1];
+        default:                   return 0;
+    }
+}
+
+ptouch_parse_event_t ptouch_parser_step(ptouch_parser_t *parser, const uint8_t *data, size_t len, size_t *used)
+{
+    if (parser->remaining > 0) {
+        size_t take = len < parser->remaining ? len : parser->remaining;
+        parser->remaining -= take;
+        *used = take;
+        return take > 0 ? PTOUCH_PARSE_DATA : PTOUCH_PARSE_MORE;
+    }
+
+    size_t i = 0;
+    while (i < len) {
+        uint8_t byte = data[i++];
+
+        if (!parser->in_args) {
+            parser->code[parser->code_len++] = byte;
+            bool partial;
+            const ptouch_command_def_t *def = lookup(parser, &partial);
+            if (!def) {
+                if (partial && parser->code_len < PTOUCH_PROTOCOL_MAX_CODE) {
+                    continue;
+                }
+                parser->error = "Unknown command";
+                ptouch_parser_reset(parser);
+                *used = i;
+                return PTOUCH_PARSE_ERROR;
+            }
+            parser->def = def;
+            parser->in_args = true;
+            parser->arg_len = 0;
+        } else {
+            parser->args[parser->arg_len++] = byte;
+        }
+
+        if (parser->arg_len == parser->def->args) {
+            parser->length = data_length(parser);
+            parser->remaining = parser->length;
+            parser->code_len = 0;
+            parser->in_args = false;
+            *used = i;
+            return PTOUCH_PARSE_COMMAND;
+        }
+    }
+    *used = i;
+    return PTOUCH_PARSE_MORE;
+}
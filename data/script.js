@@ -27,53 +27,55 @@ let printerConnected = false;
 class PtouchInterface {
     constructor() {
         this.websocket = null;
+        this.watchedJobs = new Set();   // Jobs submitted from this page
+        this.jobEvents = new Map();     // Last event per job; a job can finish before its POST returns
         this.printerConnected = false;
         this.currentTool = 'text';
         this.isDrawing = false;
         this.printQueue = [];
         this.canvasHistory = [];
         
-        // WebSocket not implemented yet, use HTTP polling
+        // Printer status and job progress are pushed over /ws
         this.initializeEventListeners();
         this.initializeCanvas();
-        this.refreshStatus();
-        
-        // Poll status every 5 seconds
-        setInterval(() => this.refreshStatus(), 5000);
+        this.initializeWebSocket();
     }
     
-    // WebSocket Management (disabled - not implemented in server)
+    // WebSocket Management
     initializeWebSocket() {
-        // WebSocket functionality not implemented in server yet
-        console.log('WebSocket functionality disabled - using HTTP polling instead');
-        return;
-        
-        // const protocol = window.location.protocol === 'https:' ? 'wss:' : 'ws:';
-        // const wsUrl = `${protocol}//${window.location.host}/ws`;
+        const protocol = window.location.protocol === 'https:' ? 'wss:' : 'ws:';
+        const wsUrl = `${protocol}//${window.location.host}/ws`;
         
-        // this.websocket = new WebSocket(wsUrl);
+        this.websocket = new WebSocket(wsUrl);
+        let opened = false;
         
-        // this.websocket.onopen = () => {
-        //     this.showToast('Connected to printer server', 'success');
-        //     this.updateConnectionStatus('Connected');
-        // };
+        this.websocket.onopen = () => {
+            opened = true;
+        };
         
-        // this.websocket.onmessage = (event) => {
-        //     const data = JSON.parse(event.data);
-        //     this.handleWebSocketMessage(data);
-        // };
+        // The server sends the current printer status right after the handshake
+        this.websocket.onmessage = (event) => {
+            const data = JSON.parse(event.data);
+            this.handleWebSocketMessage(data);
+        };
         
-        // this.websocket.onclose = () => {
-        //     this.showToast('Connection to server lost', 'error');
-        //     this.updateConnectionStatus('Disconnected');
-        //     // Attempt to reconnect after 5 seconds
-        //     setTimeout(() => this.initializeWebSocket(), 5000);
-        // };
+        this.websocket.onclose = () => {
+            // The server only takes a few subscribers; show something meanwhile
+            this.refreshStatus();
+            if (opened) {
+                this.watchedJobs.forEach(jobId => this.watchJob(jobId));
+            }
+            // Attempt to reconnect after 5 seconds
+            setTimeout(() => this.initializeWebSocket(), 5000);
+        };
         
-        // this.websocket.onerror = (error) => {
-        //     console.error('WebSocket error:', error);
-        //     this.showToast('Connection error', 'error');
-        // };
+        this.websocket.onerror = (error) => {
+            console.error('WebSocket error:', error);
+        };
+    }
+    
+    isStreaming() {
+        return this.websocket && this.websocket.readyState === WebSocket.OPEN;
     }
     
     handleWebSocketMessage(data) {
@@ -81,8 +83,8 @@ class PtouchInterface {
             case 'printerStatus':
                 this.updatePrinterStatus(data);
                 break;
-            case 'printResult':
-                this.handlePrintResult(data);
+            case 'job':
+                this.handleJobEvent(data);
                 break;
             default:
                 console.log('Unknown message type:', data.type);
@@ -400,21 +402,84 @@ class PtouchInterface {
             headers: {
                 'Content-Type': 'application/json',
             },
-            body: JSON.stringify({ text: text })
+            body: JSON.stringify({ text: text, priority: 'interactive' })
         })
-        .then(response => response.text())
-        .then(data => {
+        .then(response => {
+            if (response.status === 202) {
+                return response.json();
+            }
+            if (response.status === 429) {
+                const retry = response.headers.get('Retry-After');
+                return response.text().then(message => {
+                    throw new Error(retry ? `${message}, try again in ${retry}s` : message);
+                });
+            }
+            return response.text().then(message => { throw new Error(message); });
+        })
+        .then(job => {
             this.showLoading(false);
-            if (data.includes('successfully')) {
-                this.showToast('Print job sent successfully', 'success');
-                this.addToQueue('text', text);
-            } else {
-                this.showToast('Print job failed: ' + data, 'error');
+            const ahead = job.position > 0 ? ` (${job.position} ahead)` : '';
+            this.showToast(`Print job #${job.jobId} queued${ahead}`, 'info');
+            this.addToQueue('text', text);
+            this.watchedJobs.add(job.jobId);
+            const seen = this.jobEvents.get(job.jobId);
+            if (seen) {
+                this.reportJob(seen);
+            }
+            if (this.watchedJobs.has(job.jobId) && !this.isStreaming()) {
+                this.watchJob(job.jobId);
             }
         })
         .catch(error => {
             this.showLoading(false);
-            this.showToast('Error: ' + error.message, 'error');
+            this.showToast('Print job failed: ' + error.message, 'error');
+        });
+    }
+    
+    // Job progress from the event stream. Every job is reported to every
+    // page; only the ones submitted here get a toast, once per state.
+    handleJobEvent(job) {
+        const previous = this.jobEvents.get(job.jobId);
+        this.jobEvents.delete(job.jobId);
+        this.jobEvents.set(job.jobId, job);
+        if (this.jobEvents.size > 32) {
+            this.jobEvents.delete(this.jobEvents.keys().next().value);
+        }
+        
+        if (this.watchedJobs.has(job.jobId) && (!previous || previous.state !== job.state)) {
+            this.reportJob(job);
+        }
+    }
+    
+    reportJob(job) {
+        const jobId = job.jobId;
+        if (job.state === 'paused') {
+            this.showToast(`Print job #${jobId} paused after ${job.labelsDone}/${job.labels} labels: ${job.error}`, 'warning');
+        } else if (job.state === 'done') {
+            this.showToast(`Print job #${jobId} completed`, 'success');
+        } else if (job.state === 'failed') {
+            this.showToast(`Print job #${jobId} failed: ${job.error}`, 'error');
+        } else if (job.state === 'cancelled') {
+            this.showToast(`Print job #${jobId} cancelled`, 'info');
+        }
+        
+        if (job.state === 'done' || job.state === 'failed' || job.state === 'cancelled') {
+            this.watchedJobs.delete(jobId);
+        }
+    }
+    
+    // Fallback while the event stream is down: poll /api/jobs/{id}
+    watchJob(jobId) {
+        fetch(`/api/jobs/${jobId}`)
+        .then(response => response.json())
+        .then(job => {
+            this.handleJobEvent(job);
+            if (this.watchedJobs.has(jobId) && !this.isStreaming()) {
+                setTimeout(() => this.watchJob(jobId), 1000);
+            }
+        })
+        .catch(error => {
+            console.error('Error fetching job status:', error);
         });
     }
     
@@ -424,41 +489,67 @@ class PtouchInterface {
             return;
         }
         
-        // Image printing not yet implemented
-        this.showToast('Image printing not yet implemented', 'warning');
-        return;
-        
-        // TODO: Implement image printing endpoint
-        // Convert canvas to image data
-        // const imageData = this.designCanvas.toDataURL('image/png');
-        
-        // this.showLoading(true);
-        
-        // fetch('/api/print/image', {
-        //     method: 'POST',
-        //     headers: {
-        //         'Content-Type': 'application/json',
-        //     },
-        //     body: JSON.stringify({ 
-        //         image: imageData,
-        //         width: this.designCanvas.width,
-        //         height: this.designCanvas.height
-        //     })
-        // })
-        // .then(response => response.text())
-        // .then(data => {
-        //     this.showLoading(false);
-        //     if (data.includes('successfully')) {
-        //         this.showToast('Print job sent successfully', 'success');
-        //         this.addToQueue('design', 'Custom design');
-        //     } else {
-        //         this.showToast('Print job failed: ' + data, 'error');
-        //     }
-        // })
-        // .catch(error => {
-        //     this.showLoading(false);
-        //     this.showToast('Error: ' + error.message, 'error');
-        // });
+        // Each canvas column is one raster line across the tape. Lines are
+        // rendered only when the printer has room for them (/ws/raster credit).
+        const canvas = this.designCanvas;
+        const width = canvas.height;
+        const lines = canvas.width;
+        const lineBytes = Math.ceil(width / 8);
+        const pixels = canvas.getContext('2d').getImageData(0, 0, canvas.width, canvas.height).data;
+        
+        const protocol = window.location.protocol === 'https:' ? 'wss:' : 'ws:';
+        const socket = new WebSocket(`${protocol}//${window.location.host}/ws/raster`);
+        let sent = 0;
+        let finished = false;
+        
+        this.showLoading(true);
+        
+        socket.onopen = () => {
+            socket.send(JSON.stringify({ type: 'start', width: width, lines: lines }));
+        };
+        
+        socket.onmessage = (event) => {
+            const data = JSON.parse(event.data);
+            if (data.type === 'credit' && data.until > sent) {
+                const count = data.until - sent;
+                const frame = new Uint8Array(count * lineBytes);
+                for (let i = 0; i < count; i++) {
+                    this.rasterColumn(pixels, canvas.width, canvas.height, sent + i,
+                                      frame.subarray(i * lineBytes, (i + 1) * lineBytes));
+                }
+                socket.send(frame);
+                sent = data.until;
+            } else if (data.type === 'done' || data.type === 'error') {
+                finished = true;
+                this.showLoading(false);
+                if (data.type === 'done') {
+                    this.showToast('Print job sent successfully', 'success');
+                    this.addToQueue('design', 'Custom design');
+                } else {
+                    this.showToast('Print job failed: ' + data.error, 'error');
+                }
+                socket.close();
+            }
+        };
+        
+        socket.onclose = () => {
+            this.showLoading(false);
+            if (!finished) {
+                this.showToast('Connection lost while printing', 'error');
+            }
+        };
+    }
+    
+    // Canvas column x as a raster line: dark pixels set, bottom row first
+    rasterColumn(pixels, width, height, x, line) {
+        for (let y = 0; y < height; y++) {
+            const i = (y * width + x) * 4;
+            const dark = pixels[i + 3] > 127 && pixels[i] + pixels[i + 1] + pixels[i + 2] < 384;
+            if (dark) {
+                const pixel = height - 1 - y;
+                line[pixel >> 3] |= 0x80 >> (pixel & 7);
+            }
+        }
     }
     
     reconnectPrinter() {
@@ -519,14 +610,6 @@ class PtouchInterface {
         });
     }
     
-    handlePrintResult(data) {
-        if (data.success) {
-            this.showToast('Print completed successfully', 'success');
-        } else {
-            this.showToast('Print failed', 'error');
-        }
-    }
-    
     // Queue Management
     addToQueue(type, content) {
         this.printQueue.push({
@@ -0,0 +1,94 @@
+/*
+ * P-touch ESP32 Admission Control
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "admission.h"
+#include <string.h>
+
+ClientRateLimiter::ClientRateLimiter(uint32_t rate_per_minute, uint32_t burst)
+    : rate_per_minute(rate_per_minute), burst(burst)
+{
+    memset(buckets, 0, sizeof(buckets));
+}
+
+ClientRateLimiter::Bucket* ClientRateLimiter::find(uint32_t client, int64_t now_ms)
+{
+    Bucket *oldest = &buckets[0];
+    for (size_t i = 0; i < ADMISSION_MAX_CLIENTS; i++) {
+        Bucket *bucket = &buckets[i];
+        if (bucket->used && bucket->client == client) {
+            return bucket;
+        }
+        if (!bucket->used) {
+            oldest = bucket;
+        } else if (oldest->used && bucket->updated_ms < oldest->updated_ms) {
+            oldest = bucket;
+        }
+    }
+
+    // New client starts with a full bucket
+    oldest->used = true;
+    oldest->client = client;
+    oldest->milli_tokens = burst * 1000;
+    oldest->updated_ms = now_ms;
+    return oldest;
+}
+
+bool ClientRateLimiter::allow(uint32_t client, int64_t now_ms, uint32_t *wait_ms)
+{
+    Bucket *bucket = find(client, now_ms);
+
+    // Refill: rate_per_minute tokens per 60000 ms, in milli-tokens. Only
+    // the time the refill paid for is used up, so calls closer together
+    // than one milli-token still add up.
+    int64_t elapsed = now_ms - bucket->updated_ms;
+    if (elapsed > 0) {
+        uint64_t refill = (uint64_t)elapsed * rate_per_minute / 60;
+        uint64_t tokens = bucket->milli_tokens + refill;
+        if (tokens >= burst * 1000 || rate_per_minute == 0) {
+            bucket->milli_tokens = tokens > burst * 1000 ? burst * 1000 : (uint32_t)tokens;
+            bucket->updated_ms = now_ms;
+        } else {
+            bucket->milli_tokens = (uint32_t)tokens;
+            bucket->updated_ms += (int64_t)(refill * 60 / rate_per_minute);
+        }
+    }
+
+    if (bucket->milli_tokens >= 1000) {
+        bucket->milli_tokens -= 1000;
+        return true;
+    }
+
+    if (wait_ms) {
+        uint32_t missing = 1000 - bucket->milli_tokens;
+        *wait_ms = rate_per_minute ? (missing * 60 + rate_per_minute - 1) / rate_per_minute : UINT32_MAX;
+    }
+    return false;
+}
+
+uint32_t admission_retry_after_s(size_t pending_labels, uint32_t label_ms)
+{
+    uint64_t ms = (uint64_t)pending_labels * label_ms;
+    uint64_t seconds = (ms + 999) / 1000;
+    if (seconds < 1) {
+        seconds = 1;
+    }
+    if (seconds > ADMISSION_MAX_RETRY_AFTER_S) {
+        seconds = ADMISSION_MAX_RETRY_AFTER_S;
+    }
+    return (uint32_t)seconds;
+}
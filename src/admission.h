@@ -0,0 +1,61 @@
+/*
+ * P-touch ESP32 Admission Control
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Per-client request rate for the print endpoints
+#define ADMISSION_CLIENT_RATE_PER_MIN   30
+#define ADMISSION_CLIENT_BURST          10
+#define ADMISSION_MAX_CLIENTS           8
+#define ADMISSION_MAX_RETRY_AFTER_S     600
+
+// Token bucket per client address. Clients beyond ADMISSION_MAX_CLIENTS
+// replace the one seen least recently. Not thread safe.
+class ClientRateLimiter {
+public:
+    ClientRateLimiter(uint32_t rate_per_minute = ADMISSION_CLIENT_RATE_PER_MIN,
+                      uint32_t burst = ADMISSION_CLIENT_BURST);
+
+    // Take a token for the client. When refused, wait_ms is the time until
+    // the next token is due.
+    bool allow(uint32_t client, int64_t now_ms, uint32_t *wait_ms = nullptr);
+
+private:
+    struct Bucket {
+        bool used;
+        uint32_t client;
+        uint32_t milli_tokens;          // Tokens x 1000
+        int64_t updated_ms;
+    };
+
+    Bucket buckets[ADMISSION_MAX_CLIENTS];
+    uint32_t rate_per_minute;
+    uint32_t burst;
+
+    Bucket* find(uint32_t client, int64_t now_ms);
+};
+
+// Seconds a rejected client should wait: the queued labels at the measured
+// per-label print time, rounded up, at least one second
+uint32_t admission_retry_after_s(size_t pending_labels, uint32_t label_ms);
+
+#endif // ADMISSION_H
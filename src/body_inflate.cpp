@@ -0,0 +1,239 @@
+/*
+ * P-touch ESP32 Compressed Request Bodies
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "body_inflate.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "miniz.h"
+#include "esp_rom_crc.h"
+
+static_assert(BODY_INFLATE_WINDOW == TINFL_LZ_DICT_SIZE, "Window must match tinfl's dictionary");
+
+// gzip header flags, RFC 1952
+#define GZIP_FLAG_HCRC          0x02
+#define GZIP_FLAG_EXTRA         0x04
+#define GZIP_FLAG_NAME          0x08
+#define GZIP_FLAG_COMMENT       0x10
+
+bool content_encoding_from_name(const char *name, content_encoding_t *encoding)
+{
+    if (!name || !*name || strcasecmp(name, "identity") == 0) {
+        *encoding = CONTENT_ENCODING_IDENTITY;
+        return true;
+    }
+    if (strcasecmp(name, "deflate") == 0) {
+        *encoding = CONTENT_ENCODING_DEFLATE;
+        return true;
+    }
+    if (strcasecmp(name, "gzip") == 0 || strcasecmp(name, "x-gzip") == 0) {
+        *encoding = CONTENT_ENCODING_GZIP;
+        return true;
+    }
+    return false;
+}
+
+InflateConsumer::InflateConsumer(content_encoding_t encoding, BodyConsumer *inner, size_t decoded_len, size_t max_len)
+    : encoding(encoding), inner(inner), decoded_len(decoded_len), max_len(max_len),
+      state(encoding == CONTENT_ENCODING_GZIP ? GZIP_HEADER : DEFLATE), flags(0),
+      header_len(0), skip(0), flags_tinfl(0), inflator(NULL), window(NULL), window_pos(0),
+      produced(0), crc(0), failure(NULL)
+{
+}
+
+InflateConsumer::~InflateConsumer()
+{
+    free(inflator);
+    free(window);
+}
+
+bool InflateConsumer::fail(const char *reason)
+{
+    if (!failure) {
+        failure = reason;
+    }
+    return false;
+}
+
+bool InflateConsumer::begin(size_t content_len)
+{
+    (void)content_len;                  // The compressed length says nothing about the output
+    inflator = malloc(sizeof(tinfl_decompressor));
+    window = (uint8_t *)malloc(BODY_INFLATE_WINDOW);
+    if (!inflator || !window) {
+        return fail("Out of memory");
+    }
+    tinfl_init((tinfl_decompressor *)inflator);
+    return inner->begin(decoded_len);
+}
+
+// Move past the gzip header fields the flags announce
+bool InflateConsumer::nextHeaderField()
+{
+    if (state < GZIP_EXTRA_LENGTH && (flags & GZIP_FLAG_EXTRA)) {
+        state = GZIP_EXTRA_LENGTH;
+        header_len = 0;
+    } else if (state < GZIP_NAME && (flags & GZIP_FLAG_NAME)) {
+        state = GZIP_NAME;
+    } else if (state < GZIP_COMMENT && (flags & GZIP_FLAG_COMMENT)) {
+        state = GZIP_COMMENT;
+    } else if (state < GZIP_HEADER_CRC && (flags & GZIP_FLAG_HCRC)) {
+        state = GZIP_HEADER_CRC;
+        skip = 2;
+    } else {
+        state = DEFLATE;
+    }
+    return true;
+}
+
+bool InflateConsumer::headerByte(uint8_t byte)
+{
+    switch (state) {
+        case GZIP_HEADER:
+            header[header_len++] = byte;
+            if (header_len < sizeof(header)) {
+                return true;
+            }
+            if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8) {
+                return fail("Not a gzip stream");
+            }
+            flags = header[3];
+            return nextHeaderField();
+
+        case GZIP_EXTRA_LENGTH:
+            header[header_len++] = byte;
+            if (header_len == 2) {
+                skip = header[0] | (header[1] << 8);
+                state = GZIP_EXTRA;
+                if (skip == 0) {
+                    return nextHeaderField();
+                }
+            }
+            return true;
+
+        case GZIP_EXTRA:
+        case GZIP_HEADER_CRC:
+            if (--skip == 0) {
+                return nextHeaderField();
+            }
+            return true;
+
+        case GZIP_NAME:
+        case GZIP_COMMENT:
+            return byte == 0 ? nextHeaderField() : true;
+
+        case GZIP_TRAILER:
+            header[header_len++] = byte;
+            if (header_len == 8) {
+                uint32_t expected_crc = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+                uint32_t expected_len = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+                if (expected_crc != crc || expected_len != (uint32_t)produced) {
+                    return fail("gzip checksum mismatch");
+                }
+                state = DONE;
+            }
+            return true;
+
+        case DONE:
+            return fail("Data after the end of the compressed stream");
+
+        default:
+            return true;
+    }
+}
+
+// Inflate until the input is used up or the stream ends; *used says how
+// much of the input belonged to the deflate stream
+bool InflateConsumer::inflate(const uint8_t *data, size_t len, size_t *used)
+{
+    tinfl_decompressor *decompressor = (tinfl_decompressor *)inflator;
+    *used = 0;
+
+    if (encoding == CONTENT_ENCODING_DEFLATE && produced == 0 && flags_tinfl == 0) {
+        // Browsers and curl send zlib streams, some clients raw deflate
+        bool zlib = len >= 1 && (data[0] & 0x0f) == 8 && (len < 2 || ((data[0] << 8) | data[1]) % 31 == 0);
+        flags_tinfl = TINFL_FLAG_HAS_MORE_INPUT | (zlib ? TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32 : 0);
+    } else if (flags_tinfl == 0) {
+        flags_tinfl = TINFL_FLAG_HAS_MORE_INPUT;
+    }
+
+    for (;;) {
+        size_t in_bytes = len - *used;
+        size_t out_bytes = BODY_INFLATE_WINDOW - window_pos;
+        tinfl_status status = tinfl_decompress(decompressor, data + *used, &in_bytes, window,
+                                               window + window_pos, &out_bytes, flags_tinfl);
+        *used += in_bytes;
+
+        if (out_bytes > 0) {
+            produced += out_bytes;
+            if (produced > max_len || (decoded_len && produced > decoded_len)) {
+                return fail("Decoded body too large");
+            }
+            if (encoding == CONTENT_ENCODING_GZIP) {
+                crc = esp_rom_crc32_le(crc, window + window_pos, out_bytes);
+            }
+            // Straight from the window to the consumer
+            if (!inner->consume((const char *)window + window_pos, out_bytes)) {
+                return false;
+            }
+            window_pos = (window_pos + out_bytes) & (BODY_INFLATE_WINDOW - 1);
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            return fail("Invalid compressed data");
+        }
+        if (status == TINFL_STATUS_DONE) {
+            state = encoding == CONTENT_ENCODING_GZIP ? GZIP_TRAILER : DONE;
+            header_len = 0;
+            return true;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && *used == len) {
+            return true;
+        }
+    }
+}
+
+bool InflateConsumer::consume(const char *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    size_t i = 0;
+    while (i < len) {
+        if (state == DEFLATE) {
+            size_t used = 0;
+            if (!inflate(bytes + i, len - i, &used)) {
+                return false;
+            }
+            i += used;
+        } else if (!headerByte(bytes[i++])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InflateConsumer::end()
+{
+    if (state != DONE) {
+        return fail("Compressed data ends early");
+    }
+    if (decoded_len && produced != decoded_len) {
+        return fail("Decoded body has the wrong size");
+    }
+    return inner->end();
+}
@@ -0,0 +1,94 @@
+/*
+ * P-touch ESP32 Compressed Request Bodies
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BODY_INFLATE_H
+#define BODY_INFLATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "body_reader.h"
+
+// Bodies sent with Content-Encoding: gzip or deflate are inflated as they
+// arrive, with the ROM's tinfl, and the output goes straight to the
+// consumer that would have taken the plain body. Memory is bounded by
+// deflate's largest back-reference, whatever the body size.
+#define BODY_INFLATE_WINDOW     32768   // TINFL_LZ_DICT_SIZE
+
+typedef enum {
+    CONTENT_ENCODING_IDENTITY = 0,
+    CONTENT_ENCODING_DEFLATE,           // zlib stream; raw deflate is accepted too
+    CONTENT_ENCODING_GZIP
+} content_encoding_t;
+
+// Parse a Content-Encoding header; NULL or empty is identity
+bool content_encoding_from_name(const char *name, content_encoding_t *encoding);
+
+// Wraps the consumer of the decoded body. decoded_len is the exact size
+// the decoded body must have, or 0 if unknown; max_len caps the output
+// either way, so a small body cannot inflate without bound.
+class InflateConsumer : public BodyConsumer {
+public:
+    InflateConsumer(content_encoding_t encoding, BodyConsumer *inner, size_t decoded_len, size_t max_len);
+    ~InflateConsumer() override;
+
+    bool begin(size_t content_len) override;
+    bool consume(const char *data, size_t len) override;
+    bool end() override;
+
+    // Set when the compressed data was at fault rather than the consumer
+    const char* error() const { return failure; }
+    size_t decodedLength() const { return produced; }
+
+private:
+    enum State {
+        GZIP_HEADER,                    // Fixed 10 bytes
+        GZIP_EXTRA_LENGTH,
+        GZIP_EXTRA,
+        GZIP_NAME,
+        GZIP_COMMENT,
+        GZIP_HEADER_CRC,
+        DEFLATE,
+        GZIP_TRAILER,                   // CRC-32 and size of the decoded data
+        DONE
+    };
+
+    content_encoding_t encoding;
+    BodyConsumer *inner;
+    size_t decoded_len;
+    size_t max_len;
+    State state;
+    uint8_t flags;                      // gzip header flags
+    uint8_t header[10];
+    size_t header_len;
+    size_t skip;                        // Bytes left in the current header field
+    uint32_t flags_tinfl;
+    void *inflator;                     // tinfl_decompressor
+    uint8_t *window;
+    size_t window_pos;
+    size_t produced;
+    uint32_t crc;
+    const char *failure;
+
+    bool fail(const char *reason);
+    bool nextHeaderField();
+    bool headerByte(uint8_t byte);
+    bool inflate(const uint8_t *data, size_t len, size_t *used);
+};
+
+#endif // BODY_INFLATE_H
@@ -0,0 +1,94 @@
+/*
+ * P-touch ESP32 Request Body Reader
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "body_reader.h"
+#include <string.h>
+
+bool BufferConsumer::begin(size_t content_len)
+{
+    used = 0;
+    return content_len < cap;
+}
+
+bool BufferConsumer::consume(const char *data, size_t len)
+{
+    if (used + len >= cap) {
+        return false;
+    }
+    memcpy(buf + used, data, len);
+    used += len;
+    return true;
+}
+
+bool BufferConsumer::end()
+{
+    buf[used] = '\0';
+    return true;
+}
+
+body_status_t body_read(body_recv_t recv, void *ctx, size_t content_len,
+                        const body_limits_t *limits, BodyConsumer *consumer)
+{
+    if (content_len > limits->max_len) {
+        return BODY_TOO_LARGE;
+    }
+    if (!consumer->begin(content_len)) {
+        return BODY_REJECTED;
+    }
+
+    uint8_t max_stalls = limits->max_stalls ? limits->max_stalls : BODY_READ_MAX_STALLS;
+    uint8_t stalls = 0;
+    size_t remaining = content_len;
+    char chunk[BODY_READ_CHUNK];
+
+    while (remaining > 0) {
+        size_t want = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+        int ret = recv(ctx, chunk, want);
+        if (ret == BODY_RECV_TIMEOUT) {
+            // A slow link may still be sending; give up only when it stays silent
+            if (++stalls >= max_stalls) {
+                return BODY_TIMEOUT;
+            }
+            continue;
+        }
+        if (ret <= 0) {
+            return BODY_CLOSED;
+        }
+
+        stalls = 0;
+        remaining -= ret;
+        if (!consumer->consume(chunk, ret)) {
+            return BODY_REJECTED;
+        }
+    }
+
+    return consumer->end() ? BODY_OK : BODY_REJECTED;
+}
+
+const char* body_status_name(body_status_t status)
+{
+    switch (status) {
+        case BODY_OK:        return "ok";
+        case BODY_TOO_LARGE: return "too large";
+        case BODY_TIMEOUT:   return "timeout";
+        case BODY_CLOSED:    return "closed";
+        case BODY_REJECTED:  return "rejected";
+    }
+    return "unknown";
+}
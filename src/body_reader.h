@@ -0,0 +1,86 @@
+/*
+ * P-touch ESP32 Request Body Reader
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BODY_READER_H
+#define BODY_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bytes handed to a consumer per call
+#define BODY_READ_CHUNK         512
+// Consecutive receive timeouts without data before the upload is dropped
+#define BODY_READ_MAX_STALLS    2
+
+// Receive callback with httpd_req_recv() semantics: bytes read, 0 when
+// the peer closed, BODY_RECV_TIMEOUT when nothing arrived in time or
+// another negative value on socket errors
+#define BODY_RECV_TIMEOUT       (-3)    // Same as HTTPD_SOCK_ERR_TIMEOUT
+typedef int (*body_recv_t)(void *ctx, char *buf, size_t len);
+
+typedef enum {
+    BODY_OK = 0,
+    BODY_TOO_LARGE,                     // Content-Length above the endpoint limit
+    BODY_TIMEOUT,                       // Client stalled
+    BODY_CLOSED,                        // Connection lost mid-body
+    BODY_REJECTED                       // The consumer refused the data
+} body_status_t;
+
+// Per-endpoint limits
+typedef struct {
+    size_t max_len;                     // Largest accepted Content-Length
+    uint8_t max_stalls;                 // 0 means BODY_READ_MAX_STALLS
+} body_limits_t;
+
+// Receives a request body as it arrives. Returning false from any call
+// stops the upload with BODY_REJECTED; the consumer keeps its own reason.
+class BodyConsumer {
+public:
+    virtual ~BodyConsumer() {}
+    virtual bool begin(size_t content_len) { (void)content_len; return true; }
+    virtual bool consume(const char *data, size_t len) = 0;
+    virtual bool end() { return true; }
+};
+
+// Collects a small body into a caller buffer and NUL-terminates it, for
+// JSON endpoints that parse the whole document at once
+class BufferConsumer : public BodyConsumer {
+public:
+    BufferConsumer(char *buf, size_t len) : buf(buf), cap(len), used(0) {}
+
+    bool begin(size_t content_len) override;
+    bool consume(const char *data, size_t len) override;
+    bool end() override;
+
+    size_t length() const { return used; }
+
+private:
+    char *buf;
+    size_t cap;
+    size_t used;
+};
+
+// Read content_len bytes in BODY_READ_CHUNK pieces into the consumer.
+// Nothing is read when content_len exceeds limits->max_len.
+body_status_t body_read(body_recv_t recv, void *ctx, size_t content_len,
+                        const body_limits_t *limits, BodyConsumer *consumer);
+
+const char* body_status_name(body_status_t status);
+
+#endif // BODY_READER_H
@@ -0,0 +1,242 @@
+/*
+ * P-touch ESP32 Event Stream
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "event_stream.h"
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include "esp_log.h"
+
+static const char *TAG = "event-stream";
+
+// One serialised event on its way to the httpd task
+typedef struct {
+    char *json;
+    size_t len;
+} event_msg_t;
+
+static httpd_handle_t stream_server = NULL;
+
+// Subscriber sockets; only touched from the httpd task
+static int subscribers[EVENT_STREAM_MAX_CLIENTS];
+static size_t subscriber_count = 0;
+
+// Read by publishers on other tasks
+static std::atomic<size_t> active_subscribers(0);
+static std::atomic<int> pending_events(0);
+static std::atomic<uint32_t> published(0);
+static std::atomic<uint32_t> dropped(0);
+static std::atomic<uint32_t> frames_sent(0);
+
+static void remove_subscriber(size_t index)
+{
+    subscribers[index] = subscribers[--subscriber_count];
+    active_subscribers.store(subscriber_count);
+}
+
+static bool send_text(int fd, const char *json, size_t len)
+{
+    httpd_ws_frame_t frame = {};
+    frame.final = true;
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.payload = (uint8_t *)json;
+    frame.len = len;
+    return httpd_ws_send_frame_async(stream_server, fd, &frame) == ESP_OK;
+}
+
+// httpd task: the same bytes go to every subscriber
+static void send_event(void *arg)
+{
+    event_msg_t *msg = (event_msg_t *)arg;
+
+    for (size_t i = 0; i < subscriber_count;) {
+        int fd = subscribers[i];
+        if (httpd_ws_get_fd_info(stream_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+            !send_text(fd, msg->json, msg->len)) {
+            ESP_LOGI(TAG, "Subscriber %d gone", fd);
+            remove_subscriber(i);
+            continue;
+        }
+        frames_sent++;
+        i++;
+    }
+
+    pending_events--;
+    free(msg->json);
+    free(msg);
+}
+
+// Takes ownership of the serialised event
+static void publish(char *json)
+{
+    if (!json) {
+        return;
+    }
+    published++;
+
+    event_msg_t *msg = NULL;
+    if (pending_events.fetch_add(1) < EVENT_STREAM_MAX_PENDING) {
+        msg = (event_msg_t *)malloc(sizeof(*msg));
+    }
+    if (msg) {
+        msg->json = json;
+        msg->len = strlen(json);
+        if (httpd_queue_work(stream_server, send_event, msg) == ESP_OK) {
+            return;
+        }
+        free(msg);
+    }
+
+    pending_events--;
+    dropped++;
+    free(json);
+}
+
+static bool streaming(void)
+{
+    return stream_server && active_subscribers.load() > 0;
+}
+
+void printer_state_write_json(const printer_state_t *state, JsonWriter &out)
+{
+    out.beginObject();
+    out.string("type", "printerStatus");
+    out.boolean("connected", state->connected);
+    out.string("name", state->name);
+    out.string("status", state->status);
+    out.number("maxWidth", state->max_width);
+    out.number("tapeWidth", state->tape_width);
+
+    if (state->connected) {
+        out.string("mediaType", state->media_type);
+        out.string("tapeColor", state->tape_color);
+        out.string("textColor", state->text_color);
+        out.boolean("hasError", state->has_error);
+        if (state->has_error) {
+            out.string("errorDescription", state->error_description);
+        }
+    }
+    out.endObject();
+}
+
+// The event outlives the caller's buffer until the httpd task has sent it
+static void publish_copy(const char *json, size_t len)
+{
+    char *copy = (char *)malloc(len + 1);
+    if (!copy) {
+        dropped++;
+        return;
+    }
+    memcpy(copy, json, len);
+    copy[len] = '\0';
+    publish(copy);
+}
+
+void event_stream_printer_status(const char *json, size_t len)
+{
+    if (streaming()) {
+        publish_copy(json, len);
+    }
+}
+
+void event_stream_job(const print_job_info_t *job)
+{
+    if (!streaming()) {
+        return;
+    }
+
+    char json[EVENT_STREAM_JOB_JSON_MAX];
+    JsonWriter out(json, sizeof(json));
+    out.beginObject();
+    out.string("type", "job");
+    out.number("jobId", job->id);
+    out.string("state", print_job_state_name(job->state));
+    out.string("priority", print_priority_name(job->priority));
+    out.number("labels", job->labels);
+    out.number("labelsDone", job->labels_done);
+    if (job->error[0]) {
+        out.string("error", job->error);
+    }
+    out.endObject();
+
+    if (!out.finish()) {
+        dropped++;
+        return;
+    }
+    publish_copy(json, out.length());
+}
+
+// GET /ws: the handshake subscribes; frames from the client are ignored
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+
+    if (req->method == HTTP_GET) {
+        for (size_t i = 0; i < subscriber_count; i++) {
+            if (subscribers[i] == fd) {
+                remove_subscriber(i);
+                break;
+            }
+        }
+        if (subscriber_count >= EVENT_STREAM_MAX_CLIENTS) {
+            ESP_LOGW(TAG, "Too many subscribers, refusing %d", fd);
+            return ESP_FAIL;
+        }
+        subscribers[subscriber_count++] = fd;
+        active_subscribers.store(subscriber_count);
+        ESP_LOGI(TAG, "Subscriber %d joined (%u)", fd, (unsigned)subscriber_count);
+
+        // Start the new subscriber off with the current printer state
+        char json[PRINTER_STATE_JSON_MAX];
+        size_t len = printer_task_get_state_json(json, sizeof(json));
+        send_text(fd, json, len);
+        return ESP_OK;
+    }
+
+    uint8_t buf[EVENT_STREAM_MAX_RX];
+    httpd_ws_frame_t frame = {};
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK || frame.len > sizeof(buf)) {
+        return ESP_FAIL;
+    }
+    if (frame.len > 0) {
+        frame.payload = buf;
+        err = httpd_ws_recv_frame(req, &frame, frame.len);
+    }
+    return err;
+}
+
+esp_err_t event_stream_start(httpd_handle_t server)
+{
+    stream_server = server;
+
+    httpd_uri_t ws = {};
+    ws.uri = EVENT_STREAM_URI;
+    ws.method = HTTP_GET;
+    ws.handler = ws_handler;
+    ws.is_websocket = true;
+    return httpd_register_uri_handler(server, &ws);
+}
+
+void event_stream_get_stats(event_stream_stats_t *stats)
+{
+    stats->subscribers = active_subscribers.load();
+    stats->published = published.load();
+    stats->dropped = dropped.load();
+    stats->frames_sent = frames_sent.load();
+}
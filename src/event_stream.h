@@ -0,0 +1,61 @@
+/*
+ * P-touch ESP32 Event Stream
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "json_lite.h"
+#include "printer_task.h"
+#include "print_queue.h"
+
+// Printer status and job progress pushed to browsers over a WebSocket at
+// /ws, so the web UI does not have to poll. Each event is serialised once
+// by the task that produces it and sent to every subscriber from the
+// httpd task.
+#define EVENT_STREAM_URI            "/ws"
+#define EVENT_STREAM_MAX_CLIENTS    3   // Each holds one of the server's open sockets
+#define EVENT_STREAM_MAX_PENDING    8   // Events queued to the httpd task; more are dropped
+#define EVENT_STREAM_MAX_RX         128 // Client frames are read and discarded
+#define EVENT_STREAM_JOB_JSON_MAX   256
+
+// Counters for /api/queue
+typedef struct {
+    size_t subscribers;
+    uint32_t published;
+    uint32_t dropped;                   // Pending limit reached or queueing failed
+    uint32_t frames_sent;
+} event_stream_stats_t;
+
+// Register the /ws handler on a running server
+esp_err_t event_stream_start(httpd_handle_t server);
+
+// Printer state as a printerStatus event. The printer task serialises it
+// once per change; GET /api/status serves the same bytes.
+void printer_state_write_json(const printer_state_t *state, JsonWriter &out);
+
+// Publish events. Safe from any task; cheap when nobody is subscribed.
+void event_stream_printer_status(const char *json, size_t len);
+void event_stream_job(const print_job_info_t *job);
+
+void event_stream_get_stats(event_stream_stats_t *stats);
+
+#endif // EVENT_STREAM_H
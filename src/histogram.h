@@ -0,0 +1,67 @@
+/*
+ * P-touch ESP32 Latency Histogram
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-bucket histogram in the Prometheus model: a sample lands in the
+// first bucket whose upper bound it does not exceed, or in the overflow
+// bucket. Each bucket is its own relaxed atomic, so recording takes no lock
+// and a reader may see a sample in its bucket a moment before it shows in
+// the sum, which scrapers tolerate. Sums and counts wrap at 2^32.
+template <size_t N>
+class Histogram {
+private:
+    const uint32_t *bounds;             // N ascending upper bounds
+    std::atomic<uint32_t> counts[N + 1];
+    std::atomic<uint32_t> total;
+
+public:
+    explicit Histogram(const uint32_t (&upper_bounds)[N]) : bounds(upper_bounds), counts(), total(0) {}
+
+    void record(uint32_t value) {
+        size_t bucket = 0;
+        while (bucket < N && value > bounds[bucket]) {
+            bucket++;
+        }
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static constexpr size_t buckets() { return N; }
+    uint32_t bound(size_t bucket) const { return bounds[bucket]; }
+
+    // Samples at or below bound(bucket); buckets() gives the total count
+    uint32_t cumulative(size_t bucket) const {
+        uint32_t sum = 0;
+        for (size_t i = 0; i <= bucket && i <= N; i++) {
+            sum += counts[i].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    uint32_t count() const { return cumulative(N); }
+    uint32_t sum() const { return total.load(std::memory_order_relaxed); }
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,173 @@
+/*
+ * P-touch ESP32 Print Job Scheduler
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "job_scheduler.h"
+#include <string.h>
+#include <algorithm>
+
+const char* print_priority_name(print_priority_t priority)
+{
+    switch (priority) {
+        case PRINT_PRIORITY_INTERACTIVE: return "interactive";
+        case PRINT_PRIORITY_NORMAL:      return "normal";
+        case PRINT_PRIORITY_BULK:        return "bulk";
+        default:                         return "unknown";
+    }
+}
+
+bool print_priority_from_name(const char *name, print_priority_t *priority)
+{
+    if (!name || !priority) {
+        return false;
+    }
+
+    for (int i = 0; i < PRINT_PRIORITY_COUNT; i++) {
+        if (strcmp(name, print_priority_name((print_priority_t)i)) == 0) {
+            *priority = (print_priority_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobScheduler::hasClient(const ClassQueue &queue, uint32_t client)
+{
+    return std::find(queue.rotation.begin(), queue.rotation.end(), client) != queue.rotation.end();
+}
+
+bool JobScheduler::add(uint32_t job_id, print_priority_t priority, uint32_t client, uint16_t labels,
+                       uint16_t first_label)
+{
+    if (priority >= PRINT_PRIORITY_COUNT || first_label >= labels) {
+        return false;
+    }
+
+    ClassQueue &queue = classes[priority];
+    queue.entries.push_back({job_id, client, first_label, labels});
+    if (!hasClient(queue, client)) {
+        queue.rotation.push_back(client);
+    }
+    return true;
+}
+
+bool JobScheduler::next(uint32_t *job_id, uint16_t *label, print_priority_t *priority)
+{
+    for (int c = 0; c < PRINT_PRIORITY_COUNT; c++) {
+        ClassQueue &queue = classes[c];
+        if (queue.rotation.empty()) {
+            continue;
+        }
+
+        uint32_t client = queue.rotation.front();
+        queue.rotation.pop_front();
+
+        // Oldest job of this client
+        auto it = std::find_if(queue.entries.begin(), queue.entries.end(),
+                               [client](const Entry &e) { return e.client == client; });
+        *job_id = it->job_id;
+        *label = it->next_label++;
+        if (priority) {
+            *priority = (print_priority_t)c;
+        }
+
+        if (it->next_label >= it->labels) {
+            queue.entries.erase(it);
+        }
+
+        // Back of the line if the client still has work in this class
+        bool more = std::any_of(queue.entries.begin(), queue.entries.end(),
+                                [client](const Entry &e) { return e.client == client; });
+        if (more) {
+            queue.rotation.push_back(client);
+        }
+        return true;
+    }
+    return false;
+}
+
+void JobScheduler::remove(uint32_t job_id)
+{
+    for (int c = 0; c < PRINT_PRIORITY_COUNT; c++) {
+        ClassQueue &queue = classes[c];
+        auto it = std::find_if(queue.entries.begin(), queue.entries.end(),
+                               [job_id](const Entry &e) { return e.job_id == job_id; });
+        if (it == queue.entries.end()) {
+            continue;
+        }
+
+        uint32_t client = it->client;
+        queue.entries.erase(it);
+
+        bool more = std::any_of(queue.entries.begin(), queue.entries.end(),
+                                [client](const Entry &e) { return e.client == client; });
+        if (!more) {
+            queue.rotation.erase(std::remove(queue.rotation.begin(), queue.rotation.end(), client),
+                                 queue.rotation.end());
+        }
+        return;
+    }
+}
+
+bool JobScheduler::empty() const
+{
+    for (int c = 0; c < PRINT_PRIORITY_COUNT; c++) {
+        if (!classes[c].entries.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t JobScheduler::pendingLabels(print_priority_t priority) const
+{
+    size_t labels = 0;
+    if (priority < PRINT_PRIORITY_COUNT) {
+        for (const Entry &e : classes[priority].entries) {
+            labels += e.labels - e.next_label;
+        }
+    }
+    return labels;
+}
+
+void WaitStats::record(uint32_t wait_ms)
+{
+    window[head] = wait_ms;
+    head = (head + 1) % WINDOW;
+    if (count < WINDOW) {
+        count++;
+    }
+    total++;
+}
+
+// Nearest-rank percentile over the current window
+uint32_t WaitStats::percentile(unsigned pct) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    uint32_t sorted[WINDOW];
+    memcpy(sorted, window, count * sizeof(uint32_t));
+    std::sort(sorted, sorted + count);
+
+    size_t rank = (pct * count + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+    return sorted[std::min(rank, count) - 1];
+}
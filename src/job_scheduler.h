@@ -0,0 +1,94 @@
+/*
+ * P-touch ESP32 Print Job Scheduler
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+// Job priority classes, highest first
+typedef enum {
+    PRINT_PRIORITY_INTERACTIVE = 0,
+    PRINT_PRIORITY_NORMAL,
+    PRINT_PRIORITY_BULK,
+    PRINT_PRIORITY_COUNT
+} print_priority_t;
+
+const char* print_priority_name(print_priority_t priority);
+bool print_priority_from_name(const char *name, print_priority_t *priority);
+
+// Picks the next label to print. Classes are served in strict priority
+// order; inside a class, clients take turns one label at a time, so a
+// batch of hundreds only delays another client's label by one label.
+// Not thread safe: owned by the printer task.
+class JobScheduler {
+public:
+    // first_label skips labels already printed when a job resumes
+    bool add(uint32_t job_id, print_priority_t priority, uint32_t client, uint16_t labels,
+             uint16_t first_label = 0);
+
+    // Next label to print; label is the 0-based index within the job
+    bool next(uint32_t *job_id, uint16_t *label, print_priority_t *priority = nullptr);
+
+    // Drop the remaining labels of a job (failure or cancellation)
+    void remove(uint32_t job_id);
+
+    bool empty() const;
+    size_t pendingLabels(print_priority_t priority) const;
+
+private:
+    struct Entry {
+        uint32_t job_id;
+        uint32_t client;
+        uint16_t next_label;
+        uint16_t labels;
+    };
+
+    struct ClassQueue {
+        std::vector<Entry> entries;         // Arrival order
+        std::deque<uint32_t> rotation;      // Clients waiting for their turn
+    };
+
+    ClassQueue classes[PRINT_PRIORITY_COUNT];
+
+    static bool hasClient(const ClassQueue &queue, uint32_t client);
+};
+
+// Rolling window of queue wait times for percentile reporting
+class WaitStats {
+public:
+    static const size_t WINDOW = 64;
+
+    WaitStats() : head(0), count(0), total(0) {}
+
+    void record(uint32_t wait_ms);
+    uint32_t percentile(unsigned pct) const;
+    size_t samples() const { return count; }
+    uint32_t recorded() const { return total; }
+
+private:
+    uint32_t window[WINDOW];
+    size_t head;
+    size_t count;
+    uint32_t total;
+};
+
+#endif // JOB_SCHEDULER_H
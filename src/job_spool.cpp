@@ -0,0 +1,213 @@
+/*
+ * P-touch ESP32 Print Job Spool
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "job_spool.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "job-spool";
+
+static_assert(PRINT_JOB_TEXT_MAX <= PRINT_BATCH_TEXT_MAX, "text jobs must fit a spool record");
+
+static SemaphoreHandle_t spool_lock = NULL;
+static SpoolLog spool(JOB_SPOOL_LOG_PATH, JOB_SPOOL_INDEX_PATH, JOB_SPOOL_MAX_BYTES,
+                      JOB_SPOOL_INDEX_MAX_BYTES, JOB_SPOOL_COMPACT_BYTES);
+
+// Records found at boot, handed out by job_spool_next_recovered()
+static uint32_t recovered[JOB_SPOOL_MAX_LIVE];
+static size_t recovered_count = 0;
+static size_t recovered_next = 0;
+
+static job_spool_stats_t stats = {};
+static uint64_t append_us_total = 0;
+
+esp_err_t job_spool_init(void)
+{
+    if (spool_lock) {
+        return ESP_OK;
+    }
+
+    spool_lock = xSemaphoreCreateMutex();
+    if (!spool_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    int64_t start = esp_timer_get_time();
+    if (!spool.open()) {
+        ESP_LOGE(TAG, "Spool unavailable, jobs will not survive a reset");
+        return ESP_FAIL;
+    }
+    if (spool.dropped() > 0) {
+        ESP_LOGW(TAG, "Dropped %" PRIu32 " damaged records", spool.dropped());
+    }
+
+    recovered_count = spool.liveCount();
+    for (size_t i = 0; i < recovered_count; i++) {
+        recovered[i] = spool.liveRef(i);
+    }
+
+    stats.enabled = true;
+    stats.recovered = recovered_count;
+    stats.recovery_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+    ESP_LOGI(TAG, "Spool ready: %u jobs recovered in %" PRIu32 " ms", (unsigned)recovered_count,
+             stats.recovery_ms);
+    return ESP_OK;
+}
+
+esp_err_t job_spool_append(const print_job_request_t *request, uint32_t *ref)
+{
+    *ref = JOB_SPOOL_NONE;
+    if (!spool_lock || !spool.isOpen()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    spool_job_t job = {};
+    job.text = request->text;
+    job.entries = request->entries;
+    job.entry_count = request->entry_count;
+    job.copies = request->copies;
+    job.priority = (uint8_t)request->priority;
+    job.client = request->client;
+
+    xSemaphoreTake(spool_lock, portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+    size_t before = spool.logBytes() + spool.indexBytes();
+    uint32_t compactions = spool.compactions();
+    spool_append_t result = spool.append(job, ref);
+    if (result == SPOOL_APPEND_OK) {
+        uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+        append_us_total += elapsed;
+        stats.appends++;
+        // After a compaction the files were rewritten, so count what they hold now
+        size_t after = spool.logBytes() + spool.indexBytes();
+        stats.bytes_written += spool.compactions() != compactions ? after : after - before;
+        stats.last_append_us = elapsed;
+        stats.write_kbps = append_us_total ? (uint32_t)(stats.bytes_written * 1000000ULL / append_us_total / 1024) : 0;
+    }
+    xSemaphoreGive(spool_lock);
+
+    switch (result) {
+        case SPOOL_APPEND_OK:
+            return ESP_OK;
+        case SPOOL_APPEND_FULL:
+            return ESP_ERR_NO_MEM;
+        case SPOOL_APPEND_TOO_LARGE:
+            return ESP_ERR_INVALID_SIZE;
+        default:
+            ESP_LOGE(TAG, "Failed to write spool record");
+            return ESP_FAIL;
+    }
+}
+
+void job_spool_complete(uint32_t ref)
+{
+    if (ref == JOB_SPOOL_NONE || !spool_lock) {
+        return;
+    }
+
+    xSemaphoreTake(spool_lock, portMAX_DELAY);
+    if (spool.isOpen() && !spool.complete(ref)) {
+        ESP_LOGW(TAG, "Failed to mark record %" PRIu32 " complete", ref);
+    }
+    xSemaphoreGive(spool_lock);
+}
+
+void job_spool_checkpoint(uint32_t ref, uint16_t labels_done)
+{
+    if (ref == JOB_SPOOL_NONE || !spool_lock) {
+        return;
+    }
+
+    xSemaphoreTake(spool_lock, portMAX_DELAY);
+    if (spool.isOpen()) {
+        if (spool.checkpoint(ref, labels_done)) {
+            stats.checkpoints++;
+        } else {
+            ESP_LOGW(TAG, "Failed to checkpoint record %" PRIu32, ref);
+        }
+    }
+    xSemaphoreGive(spool_lock);
+}
+
+bool job_spool_next_recovered(print_job_request_t *request, char *text_buf, size_t text_len,
+                              print_label_entry_t *entries, uint32_t *ref)
+{
+    if (!spool_lock) {
+        return false;
+    }
+
+    bool found = false;
+    xSemaphoreTake(spool_lock, portMAX_DELAY);
+    while (!found && recovered_next < recovered_count) {
+        uint32_t record = recovered[recovered_next];
+        spool_job_t job;
+        uint16_t labels_done;
+        if (spool.read(record, &job, text_buf, text_len, entries, &labels_done)) {
+            memset(request, 0, sizeof(*request));
+            request->text = job.text;
+            request->entries = job.entries ? entries : NULL;
+            request->entry_count = job.entry_count;
+            request->copies = job.copies;
+            request->priority = (print_priority_t)job.priority;
+            request->client = job.client;
+            request->labels_done = labels_done;
+            *ref = record;
+            found = true;
+        } else {
+            ESP_LOGW(TAG, "Dropping unreadable record %" PRIu32, record);
+            recovered_next++;
+            spool.complete(record);
+        }
+    }
+    xSemaphoreGive(spool_lock);
+    return found;
+}
+
+void job_spool_take_recovered(uint32_t ref)
+{
+    if (!spool_lock) {
+        return;
+    }
+
+    xSemaphoreTake(spool_lock, portMAX_DELAY);
+    if (recovered_next < recovered_count && recovered[recovered_next] == ref) {
+        recovered_next++;
+    }
+    xSemaphoreGive(spool_lock);
+}
+
+void job_spool_get_stats(job_spool_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!spool_lock) {
+        return;
+    }
+
+    xSemaphoreTake(spool_lock, portMAX_DELAY);
+    *out = stats;
+    out->live = spool.liveCount();
+    out->waiting = recovered_count - recovered_next;
+    out->log_bytes = spool.logBytes();
+    out->index_bytes = spool.indexBytes();
+    out->compactions = spool.compactions();
+    xSemaphoreGive(spool_lock);
+}
@@ -0,0 +1,91 @@
+/*
+ * P-touch ESP32 Print Job Spool
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOB_SPOOL_H
+#define JOB_SPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "print_queue.h"
+#include "spool_log.h"
+
+// Accepted jobs are appended to a log on SPIFFS before the client gets its
+// 202, so a reset does not lose them. A second, small append-only index
+// marks each record committed, checkpoints the labels confirmed printed
+// and finally marks it completed; on boot the committed but not completed
+// records are handed back to the print queue, resuming at their checkpoint.
+// When either file reaches its limit the live records are compacted into
+// a fresh pair; a job that still does not fit is refused, not accepted
+// without a durable copy.
+#define JOB_SPOOL_LOG_PATH          "/spiffs/spool.log"
+#define JOB_SPOOL_INDEX_PATH        "/spiffs/spool.idx"
+#define JOB_SPOOL_MAX_BYTES         (64 * 1024)   // Log size limit; compacted when reached
+#define JOB_SPOOL_INDEX_MAX_BYTES   (8 * 1024)    // Index size limit; compacted when reached
+#define JOB_SPOOL_MAX_LIVE          SPOOL_LOG_MAX_LIVE
+#define JOB_SPOOL_COMPACT_BYTES     (16 * 1024)   // Start a fresh log once it is idle and this big
+#define JOB_SPOOL_NONE              SPOOL_LOG_NONE  // Job is not in the spool
+#define JOB_SPOOL_PAYLOAD_MAX       SPOOL_LOG_PAYLOAD_MAX
+#define JOB_SPOOL_RETRY_AFTER_S     5             // Retry-After when a record cannot be written
+
+// Spool counters for /api/queue
+typedef struct {
+    bool enabled;                       // SPIFFS mounted and spool files open
+    size_t live;                        // Records not completed yet
+    size_t waiting;                     // Recovered records not back in the queue yet
+    size_t log_bytes;
+    size_t index_bytes;
+    uint32_t appends;
+    uint64_t bytes_written;
+    uint32_t last_append_us;            // Including fsync of log and index
+    uint32_t write_kbps;                // Bytes written per second of append time / 1024
+    uint32_t recovered;                 // Records found at boot
+    uint32_t recovery_ms;               // Time to scan and verify them
+    uint32_t checkpoints;               // Label checkpoints written
+    uint32_t compactions;               // Live records copied into fresh files
+} job_spool_stats_t;
+
+// Scan the index and queue up unfinished records for replay
+esp_err_t job_spool_init(void);
+
+// Persist a job; ref identifies the record for job_spool_complete().
+// ESP_ERR_NO_MEM when the spool is full, ESP_ERR_INVALID_SIZE when the job
+// is too large for a record, ESP_FAIL on a write error.
+esp_err_t job_spool_append(const print_job_request_t *request, uint32_t *ref);
+
+// Mark a record done (printed, failed or rejected); it will not be replayed
+void job_spool_complete(uint32_t ref);
+
+// Record that the first labels_done labels of a job are confirmed printed
+void job_spool_checkpoint(uint32_t ref, uint16_t labels_done);
+
+// Next record recovered at boot. The payload is copied into text_buf,
+// which should hold JOB_SPOOL_PAYLOAD_MAX + 1 bytes; a batch's label
+// descriptions go to entries, which must hold PRINT_BATCH_MAX_LABELS.
+// request->labels_done is the checkpoint to resume from. The record stays
+// first in line, to be returned again, until job_spool_take_recovered().
+bool job_spool_next_recovered(print_job_request_t *request, char *text_buf, size_t text_len,
+                              print_label_entry_t *entries, uint32_t *ref);
+
+// The record last returned by job_spool_next_recovered() is back in the queue
+void job_spool_take_recovered(uint32_t ref);
+
+void job_spool_get_stats(job_spool_stats_t *stats);
+
+#endif // JOB_SPOOL_H
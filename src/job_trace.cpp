@@ -0,0 +1,293 @@
+/*
+ * P-touch ESP32 Job Tracing
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "job_trace.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "json_lite.h"
+
+static const char *TAG = "job-trace";
+
+static const char *const stage_names[JOB_TRACE_STAGE_COUNT] = {
+    "queued", "render", "status", "preamble", "band", "finalize", "confirm", "finished"
+};
+
+// Times are kept relative to the job's queued_at to halve the event size
+typedef struct {
+    uint32_t start;                     // Microseconds after the job was queued
+    uint32_t duration;
+    uint32_t arg;
+    uint16_t label;
+    uint8_t stage;
+} trace_event_t;
+
+typedef struct {
+    uint32_t job_id;                    // 0 when unused
+    uint32_t sequence;                  // Order of job_trace_begin(), oldest is reused first
+    int64_t queued_at;
+    uint16_t count;
+    uint16_t dropped;
+    trace_event_t events[JOB_TRACE_EVENTS];
+} job_trace_t;
+
+static job_trace_t traces[JOB_TRACE_JOBS];
+static uint32_t next_sequence = 1;
+static SemaphoreHandle_t trace_lock = NULL;
+
+// Printer task only: the label printBitmap() is sending
+static uint32_t current_job = 0;
+static uint16_t current_label = 0;
+
+esp_err_t job_trace_init(void)
+{
+    if (trace_lock) {
+        return ESP_OK;
+    }
+
+    trace_lock = xSemaphoreCreateMutex();
+    if (!trace_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(traces, 0, sizeof(traces));
+    return ESP_OK;
+}
+
+static job_trace_t* find_trace(uint32_t job_id)
+{
+    for (int i = 0; i < JOB_TRACE_JOBS; i++) {
+        if (traces[i].job_id == job_id) {
+            return &traces[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t offset_us(const job_trace_t *trace, int64_t at)
+{
+    int64_t offset = at - trace->queued_at;
+    return offset < 0 ? 0 : offset > UINT32_MAX ? UINT32_MAX : (uint32_t)offset;
+}
+
+// Call with trace_lock held
+static void append(job_trace_t *trace, job_trace_stage_t stage, int64_t start_us, int64_t end_us,
+                   uint16_t label, uint32_t arg)
+{
+    if (trace->count >= JOB_TRACE_EVENTS) {
+        trace->dropped++;
+        return;
+    }
+    trace_event_t *event = &trace->events[trace->count++];
+    event->start = offset_us(trace, start_us);
+    event->duration = offset_us(trace, end_us) - event->start;
+    event->arg = arg;
+    event->label = label;
+    event->stage = stage;
+}
+
+void job_trace_begin(uint32_t job_id, int64_t queued_at, int64_t started_at)
+{
+    if (!trace_lock || !job_id) {
+        return;
+    }
+
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    job_trace_t *trace = find_trace(job_id);
+    if (!trace) {
+        trace = &traces[0];
+        for (int i = 1; i < JOB_TRACE_JOBS; i++) {
+            if (traces[i].sequence < trace->sequence) {
+                trace = &traces[i];
+            }
+        }
+        trace->job_id = job_id;
+        trace->sequence = next_sequence++;
+        trace->queued_at = queued_at;
+        trace->count = 0;
+        trace->dropped = 0;
+        append(trace, JOB_TRACE_QUEUED, queued_at, started_at, 0, 0);
+    }
+    xSemaphoreGive(trace_lock);
+}
+
+void job_trace_record(uint32_t job_id, job_trace_stage_t stage, int64_t start_us, int64_t end_us,
+                      uint16_t label, uint32_t arg)
+{
+    if (!trace_lock) {
+        return;
+    }
+
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    job_trace_t *trace = job_id ? find_trace(job_id) : NULL;
+    if (trace) {
+        append(trace, stage, start_us, end_us, label, arg);
+    }
+    xSemaphoreGive(trace_lock);
+}
+
+void job_trace_set_label(uint32_t job_id, uint16_t label)
+{
+    current_job = job_id;
+    current_label = label;
+}
+
+void job_trace_printer_step(ptouch_step_t step, int64_t start_us, int64_t end_us, uint32_t arg, void *ctx)
+{
+    static const job_trace_stage_t stages[] = {
+        JOB_TRACE_STATUS, JOB_TRACE_PREAMBLE, JOB_TRACE_BAND, JOB_TRACE_FINALIZE
+    };
+    if ((size_t)step < sizeof(stages) / sizeof(stages[0])) {
+        job_trace_record(current_job, stages[step], start_us, end_us, current_label, arg);
+    }
+}
+
+void job_trace_finish(uint32_t job_id, print_job_state_t state, int64_t at)
+{
+    job_trace_record(job_id, JOB_TRACE_FINISHED, at, at, 0, (uint32_t)state);
+}
+
+// JsonWriter sink that streams the download as HTTP chunks
+static bool trace_chunk_sink(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len) == ESP_OK;
+}
+
+static void write_trace(JsonWriter &out, const job_trace_t *trace)
+{
+    char name[24];
+    snprintf(name, sizeof(name), "job %" PRIu32, trace->job_id);
+
+    // One row per job, in the order the jobs started
+    out.beginObject();
+    out.string("name", "thread_name");
+    out.string("ph", "M");
+    out.number("pid", 1);
+    out.number("tid", trace->job_id);
+    out.beginObject("args");
+    out.string("name", name);
+    out.endObject();
+    out.endObject();
+
+    out.beginObject();
+    out.string("name", "thread_sort_index");
+    out.string("ph", "M");
+    out.number("pid", 1);
+    out.number("tid", trace->job_id);
+    out.beginObject("args");
+    out.number("sort_index", trace->sequence);
+    out.endObject();
+    out.endObject();
+
+    for (uint16_t i = 0; i < trace->count; i++) {
+        const trace_event_t &event = trace->events[i];
+        out.beginObject();
+        if (event.stage == JOB_TRACE_FINISHED) {
+            out.string("name", print_job_state_name((print_job_state_t)event.arg));
+            out.string("ph", "i");
+            out.string("s", "t");
+        } else {
+            out.string("name", stage_names[event.stage]);
+            out.string("ph", "X");
+            out.number("dur", event.duration);
+        }
+        out.string("cat", "job");
+        out.number("ts", trace->queued_at + event.start);
+        out.number("pid", 1);
+        out.number("tid", trace->job_id);
+        out.beginObject("args");
+        if (event.stage == JOB_TRACE_QUEUED) {
+            out.number("droppedEvents", trace->dropped);
+        } else if (event.stage != JOB_TRACE_FINISHED) {
+            out.number("label", event.label);
+        }
+        if (event.stage == JOB_TRACE_BAND) {
+            out.number("firstLine", event.arg);
+        }
+        out.endObject();
+        out.endObject();
+    }
+}
+
+// GET /api/trace: the kept jobs as one Chrome Trace Event file
+static esp_err_t trace_get_handler(httpd_req_t *req)
+{
+    // Each trace is copied out under the lock and written without it
+    job_trace_t *copy = trace_lock ? (job_trace_t *)malloc(sizeof(job_trace_t)) : NULL;
+    if (!copy) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"ptouch-trace.json\"");
+
+    JsonWriter out(trace_chunk_sink, req);
+    out.beginObject();
+    out.string("displayTimeUnit", "ms");
+    out.beginArray("traceEvents");
+
+    uint32_t after = 0;
+    while (true) {
+        // Oldest trace not written yet
+        bool found = false;
+        xSemaphoreTake(trace_lock, portMAX_DELAY);
+        const job_trace_t *next = NULL;
+        for (int i = 0; i < JOB_TRACE_JOBS; i++) {
+            if (traces[i].job_id && traces[i].sequence > after &&
+                (!next || traces[i].sequence < next->sequence)) {
+                next = &traces[i];
+            }
+        }
+        if (next) {
+            memcpy(copy, next, sizeof(job_trace_t));
+            found = true;
+        }
+        xSemaphoreGive(trace_lock);
+
+        if (!found) {
+            break;
+        }
+        after = copy->sequence;
+        write_trace(out, copy);
+    }
+    free(copy);
+
+    out.endArray();
+    out.endObject();
+    if (!out.finish()) {
+        ESP_LOGW(TAG, "Trace download cut off");
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t job_trace_register(httpd_handle_t server)
+{
+    httpd_uri_t trace = {
+        .uri       = JOB_TRACE_URI,
+        .method    = HTTP_GET,
+        .handler   = trace_get_handler,
+        .user_ctx  = NULL
+    };
+    return httpd_register_uri_handler(server, &trace);
+}
@@ -0,0 +1,67 @@
+/*
+ * P-touch ESP32 Job Tracing
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef JOB_TRACE_H
+#define JOB_TRACE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "ptouch_esp32.h"
+#include "print_queue.h"
+
+// Per-job timelines of where a label's time went, downloadable from
+// GET /api/trace as Chrome Trace Event JSON (chrome://tracing, Perfetto).
+// Each job is one row; spans carry the label index they belong to.
+#define JOB_TRACE_URI           "/api/trace"
+#define JOB_TRACE_JOBS          8       // Most recent jobs kept
+#define JOB_TRACE_EVENTS        96      // Per job; later events are counted as dropped
+
+typedef enum {
+    JOB_TRACE_QUEUED = 0,               // Accepted until the printer task picks the job up
+    JOB_TRACE_RENDER,
+    JOB_TRACE_STATUS,                   // The printer steps of printBitmap()
+    JOB_TRACE_PREAMBLE,
+    JOB_TRACE_BAND,
+    JOB_TRACE_FINALIZE,
+    JOB_TRACE_CONFIRM,                  // Sent until print-complete status is seen
+    JOB_TRACE_FINISHED,                 // Instant; arg is the final print_job_state_t
+    JOB_TRACE_STAGE_COUNT
+} job_trace_stage_t;
+
+esp_err_t job_trace_init(void);
+
+// Start a job's trace when its first label is picked up, reusing the
+// oldest trace once JOB_TRACE_JOBS are kept
+void job_trace_begin(uint32_t job_id, int64_t queued_at, int64_t started_at);
+
+// Add a span to a job's trace; ignored for jobs that are not traced
+void job_trace_record(uint32_t job_id, job_trace_stage_t stage, int64_t start_us, int64_t end_us,
+                      uint16_t label, uint32_t arg);
+
+// Printer task side: the label printBitmap() is about to send. Install
+// job_trace_printer_step as the printer's step hook to record its steps.
+void job_trace_set_label(uint32_t job_id, uint16_t label);
+void job_trace_printer_step(ptouch_step_t step, int64_t start_us, int64_t end_us, uint32_t arg, void *ctx);
+
+void job_trace_finish(uint32_t job_id, print_job_state_t state, int64_t at);
+
+esp_err_t job_trace_register(httpd_handle_t server);
+
+#endif // JOB_TRACE_H
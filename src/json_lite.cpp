@@ -0,0 +1,623 @@
+/*
+ * P-touch ESP32 JSON Tokenizer and Writer
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "json_lite.h"
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+// Recursive descent over the input; tokens are appended in document order
+typedef struct {
+    const char *js;
+    size_t len;
+    size_t pos;
+    json_token_t *tokens;
+    unsigned max_tokens;
+    unsigned count;
+} json_parser_t;
+
+static int parse_value(json_parser_t *p, int depth);
+
+static void skip_space(json_parser_t *p)
+{
+    while (p->pos < p->len) {
+        char c = p->js[p->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return;
+        }
+        p->pos++;
+    }
+}
+
+static int alloc_token(json_parser_t *p, json_type_t type, int start)
+{
+    if (p->count >= p->max_tokens) {
+        return JSON_ERROR_NOMEM;
+    }
+    json_token_t *token = &p->tokens[p->count];
+    token->type = type;
+    token->start = start;
+    token->end = -1;
+    token->size = 0;
+    return (int)p->count++;
+}
+
+static bool is_hex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static int parse_string(json_parser_t *p)
+{
+    size_t start = ++p->pos;
+    while (p->pos < p->len) {
+        unsigned char c = (unsigned char)p->js[p->pos];
+        if (c == '"') {
+            int index = alloc_token(p, JSON_STRING, (int)start);
+            if (index < 0) {
+                return index;
+            }
+            p->tokens[index].end = (int)p->pos++;
+            return index;
+        }
+        if (c < 0x20) {
+            return JSON_ERROR_INVAL;
+        }
+        if (c == '\\') {
+            if (++p->pos >= p->len) {
+                return JSON_ERROR_PART;
+            }
+            switch (p->js[p->pos]) {
+                case '"': case '\\': case '/': case 'b':
+                case 'f': case 'n': case 'r': case 't':
+                    break;
+                case 'u':
+                    for (int i = 0; i < 4; i++) {
+                        if (++p->pos >= p->len) {
+                            return JSON_ERROR_PART;
+                        }
+                        if (!is_hex(p->js[p->pos])) {
+                            return JSON_ERROR_INVAL;
+                        }
+                    }
+                    break;
+                default:
+                    return JSON_ERROR_INVAL;
+            }
+        }
+        p->pos++;
+    }
+    return JSON_ERROR_PART;
+}
+
+static bool match_literal(json_parser_t *p, const char *literal, int *error)
+{
+    size_t n = strlen(literal);
+    size_t avail = p->len - p->pos;
+    if (strncmp(p->js + p->pos, literal, avail < n ? avail : n) != 0) {
+        *error = JSON_ERROR_INVAL;
+        return false;
+    }
+    if (avail < n) {
+        *error = JSON_ERROR_PART;
+        return false;
+    }
+    p->pos += n;
+    return true;
+}
+
+static size_t skip_digits(json_parser_t *p)
+{
+    size_t start = p->pos;
+    while (p->pos < p->len && p->js[p->pos] >= '0' && p->js[p->pos] <= '9') {
+        p->pos++;
+    }
+    return p->pos - start;
+}
+
+static int parse_primitive(json_parser_t *p)
+{
+    size_t start = p->pos;
+    char c = p->js[p->pos];
+    int error = 0;
+
+    if (c == 't' || c == 'f' || c == 'n') {
+        const char *literal = c == 't' ? "true" : (c == 'f' ? "false" : "null");
+        if (!match_literal(p, literal, &error)) {
+            return error;
+        }
+    } else {
+        // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+        if (c == '-') {
+            p->pos++;
+        }
+        if (p->pos < p->len && p->js[p->pos] == '0') {
+            p->pos++;
+        } else if (skip_digits(p) == 0) {
+            return p->pos >= p->len ? JSON_ERROR_PART : JSON_ERROR_INVAL;
+        }
+        if (p->pos < p->len && p->js[p->pos] == '.') {
+            p->pos++;
+            if (skip_digits(p) == 0) {
+                return p->pos >= p->len ? JSON_ERROR_PART : JSON_ERROR_INVAL;
+            }
+        }
+        if (p->pos < p->len && (p->js[p->pos] == 'e' || p->js[p->pos] == 'E')) {
+            p->pos++;
+            if (p->pos < p->len && (p->js[p->pos] == '+' || p->js[p->pos] == '-')) {
+                p->pos++;
+            }
+            if (skip_digits(p) == 0) {
+                return p->pos >= p->len ? JSON_ERROR_PART : JSON_ERROR_INVAL;
+            }
+        }
+    }
+
+    int index = alloc_token(p, JSON_PRIMITIVE, (int)start);
+    if (index >= 0) {
+        p->tokens[index].end = (int)p->pos;
+    }
+    return index;
+}
+
+// Objects and arrays: members separated by commas up to the closing bracket
+static int parse_container(json_parser_t *p, int depth, bool object)
+{
+    if (depth >= JSON_MAX_DEPTH) {
+        return JSON_ERROR_INVAL;
+    }
+
+    int index = alloc_token(p, object ? JSON_OBJECT : JSON_ARRAY, (int)p->pos);
+    if (index < 0) {
+        return index;
+    }
+    char close = object ? '}' : ']';
+    p->pos++;
+
+    skip_space(p);
+    if (p->pos < p->len && p->js[p->pos] == close) {
+        p->tokens[index].end = (int)++p->pos;
+        return index;
+    }
+
+    while (true) {
+        skip_space(p);
+        if (p->pos >= p->len) {
+            return JSON_ERROR_PART;
+        }
+        if (object) {
+            if (p->js[p->pos] != '"') {
+                return JSON_ERROR_INVAL;
+            }
+            int key = parse_string(p);
+            if (key < 0) {
+                return key;
+            }
+            skip_space(p);
+            if (p->pos >= p->len) {
+                return JSON_ERROR_PART;
+            }
+            if (p->js[p->pos++] != ':') {
+                return JSON_ERROR_INVAL;
+            }
+        }
+
+        int value = parse_value(p, depth + 1);
+        if (value < 0) {
+            return value;
+        }
+        p->tokens[index].size++;
+
+        skip_space(p);
+        if (p->pos >= p->len) {
+            return JSON_ERROR_PART;
+        }
+        char c = p->js[p->pos++];
+        if (c == close) {
+            p->tokens[index].end = (int)p->pos;
+            return index;
+        }
+        if (c != ',') {
+            return JSON_ERROR_INVAL;
+        }
+    }
+}
+
+static int parse_value(json_parser_t *p, int depth)
+{
+    skip_space(p);
+    if (p->pos >= p->len) {
+        return JSON_ERROR_PART;
+    }
+
+    switch (p->js[p->pos]) {
+        case '{': return parse_container(p, depth, true);
+        case '[': return parse_container(p, depth, false);
+        case '"': return parse_string(p);
+        default:  return parse_primitive(p);
+    }
+}
+
+int json_parse(const char *js, size_t len, json_token_t *tokens, unsigned max_tokens)
+{
+    json_parser_t p = {js, len, 0, tokens, max_tokens, 0};
+
+    int root = parse_value(&p, 0);
+    if (root < 0) {
+        return root;
+    }
+
+    // Nothing but whitespace after the document
+    skip_space(&p);
+    if (p.pos < p.len && js[p.pos] != '\0') {
+        return JSON_ERROR_INVAL;
+    }
+    return (int)p.count;
+}
+
+// Index just past the token and everything nested in it
+static int skip_token(const json_token_t *tokens, int count, int i)
+{
+    if (i >= count) {
+        return count;
+    }
+
+    int members = tokens[i].size;
+    bool object = tokens[i].type == JSON_OBJECT;
+    int next = i + 1;
+    if (tokens[i].type == JSON_OBJECT || tokens[i].type == JSON_ARRAY) {
+        for (int m = 0; m < members && next < count; m++) {
+            if (object) {
+                next++;
+            }
+            next = skip_token(tokens, count, next);
+        }
+    }
+    return next;
+}
+
+int json_object_get(const char *js, const json_token_t *tokens, int count, int object, const char *key)
+{
+    if (object < 0 || object >= count || tokens[object].type != JSON_OBJECT) {
+        return -1;
+    }
+
+    size_t key_len = strlen(key);
+    int i = object + 1;
+    for (int m = 0; m < tokens[object].size && i + 1 < count; m++) {
+        const json_token_t *name = &tokens[i];
+        // Keys with escapes are compared raw; ours never have any
+        if ((size_t)(name->end - name->start) == key_len &&
+            memcmp(js + name->start, key, key_len) == 0) {
+            return i + 1;
+        }
+        i = skip_token(tokens, count, i + 1);
+    }
+    return -1;
+}
+
+static int hex_value(const char *s)
+{
+    int value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = s[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else {
+            value |= c - 'A' + 10;
+        }
+    }
+    return value;
+}
+
+static size_t utf8_encode(uint32_t cp, char *out)
+{
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xc0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+bool json_token_string(const char *js, const json_token_t *token, char *buf, size_t len)
+{
+    if (token->type != JSON_STRING || len == 0) {
+        return false;
+    }
+
+    // The tokenizer has already validated the escapes
+    size_t out = 0;
+    for (int i = token->start; i < token->end; i++) {
+        char encoded[4];
+        size_t n = 1;
+        encoded[0] = js[i];
+
+        if (js[i] == '\\') {
+            char e = js[++i];
+            switch (e) {
+                case 'b': encoded[0] = '\b'; break;
+                case 'f': encoded[0] = '\f'; break;
+                case 'n': encoded[0] = '\n'; break;
+                case 'r': encoded[0] = '\r'; break;
+                case 't': encoded[0] = '\t'; break;
+                case 'u': {
+                    uint32_t cp = hex_value(js + i + 1);
+                    i += 4;
+                    // Surrogate pair
+                    if (cp >= 0xd800 && cp < 0xdc00 && i + 6 < token->end &&
+                        js[i + 1] == '\\' && js[i + 2] == 'u') {
+                        uint32_t low = hex_value(js + i + 3);
+                        if (low >= 0xdc00 && low < 0xe000) {
+                            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                            i += 6;
+                        }
+                    }
+                    if (cp >= 0xd800 && cp < 0xe000) {
+                        cp = '?';
+                    }
+                    n = utf8_encode(cp, encoded);
+                    break;
+                }
+                default: encoded[0] = e; break;
+            }
+        }
+
+        if (out + n >= len) {
+            return false;
+        }
+        memcpy(buf + out, encoded, n);
+        out += n;
+    }
+    buf[out] = '\0';
+    return true;
+}
+
+bool json_token_int(const char *js, const json_token_t *token, long *value)
+{
+    if (token->type != JSON_PRIMITIVE) {
+        return false;
+    }
+
+    int i = token->start;
+    bool negative = js[i] == '-';
+    if (negative) {
+        i++;
+    }
+    if (i >= token->end || js[i] < '0' || js[i] > '9') {
+        return false;
+    }
+
+    long result = 0;
+    for (; i < token->end; i++) {
+        if (js[i] < '0' || js[i] > '9') {
+            return false;               // Fractions and exponents are not integers
+        }
+        int digit = js[i] - '0';
+        if (result > (LONG_MAX - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    *value = negative ? -result : result;
+    return true;
+}
+
+bool json_token_bool(const char *js, const json_token_t *token, bool *value)
+{
+    if (token->type != JSON_PRIMITIVE) {
+        return false;
+    }
+    if (js[token->start] == 't') {
+        *value = true;
+        return true;
+    }
+    if (js[token->start] == 'f') {
+        *value = false;
+        return true;
+    }
+    return false;
+}
+
+JsonWriter::JsonWriter(json_sink_t sink, void *ctx)
+    : sink(sink), ctx(ctx), buf(chunk), cap(sizeof(chunk)), used(0), total(0),
+      failed(false), depth(0), has_items(0), after_key(false)
+{
+}
+
+JsonWriter::JsonWriter(char *buf, size_t len)
+    : sink(nullptr), ctx(nullptr), buf(buf), cap(len), used(0), total(0),
+      failed(buf == nullptr || len == 0), depth(0), has_items(0), after_key(false)
+{
+}
+
+void JsonWriter::put(const char *data, size_t len)
+{
+    if (failed) {
+        return;
+    }
+
+    while (len > 0) {
+        if (used == cap) {
+            if (!sink || !sink(ctx, buf, used)) {
+                failed = true;
+                return;
+            }
+            used = 0;
+        }
+        size_t n = cap - used < len ? cap - used : len;
+        memcpy(buf + used, data, n);
+        used += n;
+        total += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// Comma before every item but the first at this level; none after a key
+void JsonWriter::separate()
+{
+    if (after_key) {
+        after_key = false;
+        return;
+    }
+    if (depth > 0) {
+        uint32_t bit = 1u << (depth - 1);
+        if (has_items & bit) {
+            putChar(',');
+        }
+        has_items |= bit;
+    }
+}
+
+void JsonWriter::open(char c)
+{
+    separate();
+    if (depth >= JSON_MAX_DEPTH) {
+        failed = true;
+        return;
+    }
+    putChar(c);
+    depth++;
+    has_items &= ~(1u << (depth - 1));
+}
+
+void JsonWriter::close(char c)
+{
+    if (depth == 0) {
+        failed = true;
+        return;
+    }
+    depth--;
+    putChar(c);
+}
+
+void JsonWriter::quoted(const char *value)
+{
+    putChar('"');
+    const char *run = value;
+    for (const char *s = value; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        put(run, s - run);
+        run = s + 1;
+        char escaped[8];
+        switch (c) {
+            case '"':  put("\\\"", 2); break;
+            case '\\': put("\\\\", 2); break;
+            case '\n': put("\\n", 2); break;
+            case '\r': put("\\r", 2); break;
+            case '\t': put("\\t", 2); break;
+            default:
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                put(escaped, 6);
+                break;
+        }
+    }
+    put(run, strlen(run));
+    putChar('"');
+}
+
+void JsonWriter::beginObject() { open('{'); }
+void JsonWriter::endObject()   { close('}'); }
+void JsonWriter::beginArray()  { open('['); }
+void JsonWriter::endArray()    { close(']'); }
+
+void JsonWriter::key(const char *name)
+{
+    separate();
+    quoted(name);
+    putChar(':');
+    after_key = true;
+}
+
+void JsonWriter::string(const char *value)
+{
+    separate();
+    if (value) {
+        quoted(value);
+    } else {
+        put("null", 4);
+    }
+}
+
+void JsonWriter::number(int64_t value)
+{
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%lld", (long long)value);
+    separate();
+    put(digits, n);
+}
+
+void JsonWriter::boolean(bool value)
+{
+    separate();
+    if (value) {
+        put("true", 4);
+    } else {
+        put("false", 5);
+    }
+}
+
+void JsonWriter::null()
+{
+    separate();
+    put("null", 4);
+}
+
+bool JsonWriter::finish()
+{
+    if (failed || depth != 0) {
+        return false;
+    }
+
+    if (sink) {
+        if (used > 0 && !sink(ctx, buf, used)) {
+            failed = true;
+            return false;
+        }
+        used = 0;
+        return true;
+    }
+
+    // Keep room for the terminator
+    if (used >= cap) {
+        failed = true;
+        return false;
+    }
+    buf[used] = '\0';
+    return true;
+}
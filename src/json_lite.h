@@ -0,0 +1,125 @@
+/*
+ * P-touch ESP32 JSON Tokenizer and Writer
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSON_LITE_H
+#define JSON_LITE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Request bodies are tokenized in place into a caller-provided token
+// array, and responses are written through a small fixed buffer, so the
+// HTTP handlers parse and build JSON without touching the heap.
+#define JSON_MAX_DEPTH          16
+#define JSON_WRITER_CHUNK       256     // Bytes buffered before the sink is called
+
+// Tokenizer errors
+#define JSON_ERROR_NOMEM        -1      // More tokens than the caller provided
+#define JSON_ERROR_INVAL        -2      // Not valid JSON
+#define JSON_ERROR_PART         -3      // Input ended inside a value
+
+typedef enum {
+    JSON_UNDEFINED = 0,
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,                        // Key or value; start/end exclude the quotes
+    JSON_PRIMITIVE                      // Number, true, false or null
+} json_type_t;
+
+// Tokens are stored in document order. Objects count their members and
+// arrays their elements; an object member is a key token followed by the
+// value's tokens.
+typedef struct {
+    json_type_t type;
+    int start;
+    int end;
+    int size;
+} json_token_t;
+
+// Tokenize js. Returns the number of tokens or a JSON_ERROR_* code.
+int json_parse(const char *js, size_t len, json_token_t *tokens, unsigned max_tokens);
+
+// Token index of a member's value in the object at tokens[object], or -1
+int json_object_get(const char *js, const json_token_t *tokens, int count, int object, const char *key);
+
+// Value accessors; false if the token has another type or does not fit.
+// Unescaping never makes a string longer, so buf may be js + token->start
+// to decode a string in place.
+bool json_token_string(const char *js, const json_token_t *token, char *buf, size_t len);
+bool json_token_int(const char *js, const json_token_t *token, long *value);
+bool json_token_bool(const char *js, const json_token_t *token, bool *value);
+
+// Receives the writer's output; returns false to abort
+typedef bool (*json_sink_t)(void *ctx, const char *data, size_t len);
+
+// Streaming JSON writer. With a sink, output is passed on every
+// JSON_WRITER_CHUNK bytes; with a buffer, it must fit. Errors latch and
+// are reported by finish().
+class JsonWriter {
+public:
+    JsonWriter(json_sink_t sink, void *ctx);
+    JsonWriter(char *buf, size_t len);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(const char *name);
+
+    // Array elements, or the value after key()
+    void string(const char *value);
+    void number(int64_t value);
+    void boolean(bool value);
+    void null();
+
+    // Object members
+    void string(const char *name, const char *value) { key(name); string(value); }
+    void number(const char *name, int64_t value) { key(name); number(value); }
+    void boolean(const char *name, bool value) { key(name); boolean(value); }
+    void beginObject(const char *name) { key(name); beginObject(); }
+    void beginArray(const char *name) { key(name); beginArray(); }
+
+    // Flush to the sink, or terminate the buffer. False if anything failed.
+    bool finish();
+
+    // Bytes written so far
+    size_t length() const { return total; }
+
+private:
+    json_sink_t sink;
+    void *ctx;
+    char chunk[JSON_WRITER_CHUNK];
+    char *buf;
+    size_t cap;
+    size_t used;
+    size_t total;
+    bool failed;
+    int depth;
+    uint32_t has_items;                 // Bit per depth: a comma is due before the next item
+    bool after_key;
+
+    void put(const char *data, size_t len);
+    void putChar(char c) { put(&c, 1); }
+    void separate();
+    void open(char c);
+    void close(char c);
+    void quoted(const char *value);
+};
+
+#endif // JSON_LITE_H
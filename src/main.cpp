@@ -25,6 +25,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <memory>
+#include <new>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -32,17 +34,34 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_netif.h"
 #include "esp_http_server.h"
 #include "esp_spiffs.h"
 #include "nvs_flash.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
+#include "lwip/sockets.h"
 #include "cJSON.h"
 
 // Include our P-touch library
-#include "../lib/ptouch-esp32/include/ptouch_esp32.h"
+#include "ptouch_esp32.h"
 #include "../include/config.h"
+#include "print_queue.h"
+#include "printer_task.h"
+#include "admission.h"
+#include "job_spool.h"
+#include "event_stream.h"
+#include "json_lite.h"
+#include "body_reader.h"
+#include "raster_stream.h"
+#include "print_batch.h"
+#include "raw_listener.h"
+#include "raster_socket.h"
+#include "body_inflate.h"
+#include "web_assets.h"
+#include "metrics.h"
+#include "job_trace.h"
 
 static const char *TAG = "ptouch-server";
 
@@ -60,27 +79,16 @@ static int s_retry_num = 0;
 // HTTP server handle
 static httpd_handle_t server = NULL;
 
-// P-touch printer instance
-static PtouchPrinter *printer = nullptr;
-
-// Global variables for printer status
-static bool printerConnected = false;
-static char printerName[64] = "Unknown";
-static int printerMaxWidth = 0;
-static int printerTapeWidth = 0;
-static char printerStatus[64] = "Disconnected";
+// Print request rate per client; only used from the httpd task
+static ClientRateLimiter rate_limiter;
 
 // Configuration constants
-const bool PRINTER_VERBOSE = true;
-const int PRINTER_STATUS_CHECK_INTERVAL = 5000;  // milliseconds
 const int WS_CLEANUP_INTERVAL = 100;  // milliseconds
 
 // Function prototypes
 static void wifi_init_sta(void);
 static esp_err_t start_webserver(void);
 static void stop_webserver(void);
-static void init_printer(void);
-static void printer_status_task(void *pvParameters);
 
 // WiFi event handler
 static void event_handler(void* arg, esp_event_base_t event_base,
@@ -158,215 +166,788 @@ static void wifi_init_sta(void)
 
 // HTTP request handlers
 
-// Root handler - serve web interface
-static esp_err_t root_get_handler(httpd_req_t *req)
+// Request bodies are small flat objects
+#define API_MAX_TOKENS 16
+
+// JsonWriter sink that streams a response as HTTP chunks
+static bool httpd_chunk_sink(void *ctx, const char *data, size_t len)
 {
-    FILE *file = fopen("/spiffs/index.html", "r");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open index.html");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open index.html");
-        return ESP_FAIL;
-    }
-    
-    httpd_resp_set_type(req, "text/html");
-    
-    char buffer[1024];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        if (httpd_resp_send_chunk(req, buffer, bytes_read) != ESP_OK) {
-            fclose(file);
-            return ESP_FAIL;
-        }
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len) == ESP_OK;
+}
+
+// Request body limits per endpoint
+static const body_limits_t text_body_limits = { .max_len = 1023, .max_stalls = 0 };
+static const body_limits_t feed_body_limits = { .max_len = 63, .max_stalls = 0 };
+static const body_limits_t batch_body_limits = { .max_len = PRINT_BATCH_BODY_MAX, .max_stalls = 0 };
+static const body_limits_t raster_body_limits = { .max_len = RASTER_UPLOAD_MAX_BYTES, .max_stalls = 0 };
+
+static int httpd_body_recv(void *ctx, char *buf, size_t len)
+{
+    return httpd_req_recv((httpd_req_t *)ctx, buf, len);
+}
+
+// Stream the request body into a consumer. Answers 413 and 408 itself;
+// a rejected body is left to the caller, which knows why.
+static body_status_t receive_body(httpd_req_t *req, const body_limits_t *limits, BodyConsumer *consumer)
+{
+    body_status_t status = body_read(httpd_body_recv, req, req->content_len, limits, consumer);
+    switch (status) {
+        case BODY_TOO_LARGE:
+            httpd_resp_set_status(req, "413 Payload Too Large");
+            httpd_resp_send(req, "Content too long", HTTPD_RESP_USE_STRLEN);
+            break;
+        case BODY_TIMEOUT:
+            httpd_resp_send_408(req);
+            break;
+        case BODY_CLOSED:
+            ESP_LOGW(TAG, "Client closed the connection mid-body");
+            break;
+        default:
+            break;
     }
-    
-    fclose(file);
-    httpd_resp_send_chunk(req, NULL, 0);  // End chunked response
-    return ESP_OK;
+    return status;
 }
 
-// Style.css handler
-static esp_err_t style_get_handler(httpd_req_t *req)
+// Send a response built in a fixed buffer
+static esp_err_t send_json(httpd_req_t *req, JsonWriter &out, const char *buf)
 {
-    FILE *file = fopen("/spiffs/style.css", "r");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open style.css");
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+    if (!out.finish()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
         return ESP_FAIL;
     }
-    
-    httpd_resp_set_type(req, "text/css");
-    
-    char buffer[1024];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        if (httpd_resp_send_chunk(req, buffer, bytes_read) != ESP_OK) {
-            fclose(file);
-            return ESP_FAIL;
-        }
-    }
-    
-    fclose(file);
-    httpd_resp_send_chunk(req, NULL, 0);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, out.length());
+}
+
+// API status endpoint
+static esp_err_t api_status_get_handler(httpd_req_t *req)
+{
+    // Serialised by the printer task when the state last changed
+    char json[PRINTER_STATE_JSON_MAX];
+    size_t len = printer_task_get_state_json(json, sizeof(json));
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, len);
     return ESP_OK;
 }
 
-// Script.js handler
-static esp_err_t script_get_handler(httpd_req_t *req)
+// Peer address of the request, used to queue clients fairly
+static uint32_t request_client_id(httpd_req_t *req)
 {
-    FILE *file = fopen("/spiffs/script.js", "r");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open script.js");
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
-        return ESP_FAIL;
+    struct sockaddr_in6 addr;
+    socklen_t addr_len = sizeof(addr);
+    int sockfd = httpd_req_to_sockfd(req);
+    if (getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        return 0;
     }
-    
-    httpd_resp_set_type(req, "application/javascript");
-    
-    char buffer[1024];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        if (httpd_resp_send_chunk(req, buffer, bytes_read) != ESP_OK) {
-            fclose(file);
-            return ESP_FAIL;
-        }
+    if (addr.sin6_family == AF_INET) {
+        return ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
     }
-    
-    fclose(file);
-    httpd_resp_send_chunk(req, NULL, 0);
+    // IPv4 clients show up as IPv4-mapped addresses in the last word
+    return addr.sin6_addr.un.u32_addr[3];
+}
+
+static esp_err_t send_with_retry_after(httpd_req_t *req, const char *status, uint32_t retry_after_s,
+                                       const char *message)
+{
+    char retry_after[12];
+    snprintf(retry_after, sizeof(retry_after), "%" PRIu32, retry_after_s);
+
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_hdr(req, "Retry-After", retry_after);
+    httpd_resp_send(req, message, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
-// API status endpoint
-static esp_err_t api_status_get_handler(httpd_req_t *req)
+// Reject with 429 and a Retry-After header
+static esp_err_t send_retry_later(httpd_req_t *req, uint32_t retry_after_s, const char *message)
 {
-    cJSON *doc = cJSON_CreateObject();
-    cJSON_AddBoolToObject(doc, "connected", printerConnected);
-    cJSON_AddStringToObject(doc, "name", printerName);
-    cJSON_AddStringToObject(doc, "status", printerStatus);
-    cJSON_AddNumberToObject(doc, "maxWidth", printerMaxWidth);
-    cJSON_AddNumberToObject(doc, "tapeWidth", printerTapeWidth);
-
-    if (printerConnected && printer) {
-        cJSON_AddStringToObject(doc, "mediaType", printer->getMediaType());
-        cJSON_AddStringToObject(doc, "tapeColor", printer->getTapeColor());
-        cJSON_AddStringToObject(doc, "textColor", printer->getTextColor());
-        cJSON_AddBoolToObject(doc, "hasError", printer->hasError());
-        if (printer->hasError()) {
-            cJSON_AddStringToObject(doc, "errorDescription", printer->getErrorDescription());
-        }
+    return send_with_retry_after(req, "429 Too Many Requests", retry_after_s, message);
+}
+
+// Reject with 503 and a Retry-After header, for a device side fault
+static esp_err_t send_unavailable(httpd_req_t *req, uint32_t retry_after_s, const char *message)
+{
+    return send_with_retry_after(req, "503 Service Unavailable", retry_after_s, message);
+}
+
+// Check a print request holding up to the given bytes of label text
+// against the client rate and the queue limits before its body is read.
+// Sends the 429 itself and returns false when the request is turned away.
+static bool admit_print_request(httpd_req_t *req, uint32_t client, size_t bytes)
+{
+    print_queue_load_t load;
+    print_queue_get_load(&load);
+    uint32_t retry_after_s = admission_retry_after_s(load.pending_labels, load.label_ms);
+
+    uint32_t wait_ms = 0;
+    if (!rate_limiter.allow(client, esp_timer_get_time() / 1000, &wait_ms)) {
+        send_retry_later(req, (wait_ms + 999) / 1000, "Too many print requests");
+        return false;
     }
 
-    char *response = cJSON_PrintUnformatted(doc);
-    cJSON_Delete(doc);
+    if (load.pending_jobs >= PRINT_QUEUE_LENGTH) {
+        send_retry_later(req, retry_after_s, "Print queue full");
+        return false;
+    }
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    free(response);
-    return ESP_OK;
+    if (load.bytes + bytes > PRINT_QUEUE_MAX_BYTES) {
+        send_retry_later(req, retry_after_s, "Too much print data queued");
+        return false;
+    }
+    return true;
 }
 
 // API print text endpoint
 static esp_err_t api_print_text_post_handler(httpd_req_t *req)
 {
     char buf[1024];
-    int ret, remaining = req->content_len;
+    uint32_t client = request_client_id(req);
 
-    if (remaining >= sizeof(buf)) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content too long");
-        return ESP_FAIL;
+    if (!admit_print_request(req, client, req->content_len)) {
+        return ESP_OK;
     }
 
-    // Receive the content
-    ret = httpd_req_recv(req, buf, remaining);
-    if (ret <= 0) {
-        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-            httpd_resp_send_408(req);
-        }
+    BufferConsumer body(buf, sizeof(buf));
+    if (receive_body(req, &text_body_limits, &body) != BODY_OK) {
         return ESP_FAIL;
     }
-    buf[ret] = '\0';
+    int ret = body.length();
 
-    // Parse JSON
-    cJSON *doc = cJSON_Parse(buf);
-    if (!doc) {
+    // Tokenize in place; nothing is allocated
+    json_token_t tokens[API_MAX_TOKENS];
+    int count = json_parse(buf, ret, tokens, API_MAX_TOKENS);
+    if (count < 1 || tokens[0].type != JSON_OBJECT) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
         return ESP_FAIL;
     }
 
-    if (!cJSON_HasObjectItem(doc, "text")) {
+    int text_tok = json_object_get(buf, tokens, count, 0, "text");
+    if (text_tok < 0) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing text parameter");
-        cJSON_Delete(doc);
         return ESP_FAIL;
     }
 
-    const char* text = cJSON_GetStringValue(cJSON_GetObjectItem(doc, "text"));
-    if (!text || strlen(text) == 0) {
+    print_job_request_t job = {};
+    job.copies = 1;
+    job.client = client;
+
+    int copies = json_object_get(buf, tokens, count, 0, "copies");
+    if (copies >= 0) {
+        long value = 0;
+        if (!json_token_int(buf, &tokens[copies], &value) || value < 1 || value > PRINT_JOB_MAX_COPIES) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid copies");
+            return ESP_FAIL;
+        }
+        job.copies = (uint16_t)value;
+    }
+
+    // Large runs go to the bulk class unless the client says otherwise
+    job.priority = job.copies > PRINT_BULK_COPIES ? PRINT_PRIORITY_BULK : PRINT_PRIORITY_NORMAL;
+    int priority = json_object_get(buf, tokens, count, 0, "priority");
+    if (priority >= 0) {
+        char name[16];
+        if (!json_token_string(buf, &tokens[priority], name, sizeof(name)) ||
+            !print_priority_from_name(name, &job.priority)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid priority");
+            return ESP_FAIL;
+        }
+    }
+
+    // Decoded in place, after every other member has been read
+    char *text = buf + tokens[text_tok].start;
+    size_t text_len = tokens[text_tok].end - tokens[text_tok].start + 1;
+    if (!json_token_string(buf, &tokens[text_tok], text, text_len) || strlen(text) == 0) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty text");
-        cJSON_Delete(doc);
+        return ESP_FAIL;
+    }
+    job.text = text;
+
+    printer_state_t state;
+    printer_task_get_state(&state);
+    if (!state.connected) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Printer not connected");
+        return ESP_FAIL;
+    }
+
+    // Hand the label to the print worker and answer straight away
+    uint32_t job_id = 0;
+    size_t position = 0;
+    esp_err_t err = print_queue_submit(&job, &job_id, &position);
+
+    if (err == ESP_ERR_NO_MEM) {
+        // Lost a race with another request for the last slot
+        print_queue_load_t load;
+        print_queue_get_load(&load);
+        return send_retry_later(req, admission_retry_after_s(load.pending_labels, load.label_ms),
+                                "Print queue full");
+    } else if (err == ESP_FAIL) {
+        return send_unavailable(req, JOB_SPOOL_RETRY_AFTER_S, "Job could not be spooled");
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to queue print job");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Queued print job %" PRIu32 " (%s, %u labels) at position %u", job_id,
+             print_priority_name(job.priority), job.copies, (unsigned)position);
+
+    char location[32];
+    snprintf(location, sizeof(location), "/api/jobs/%" PRIu32, job_id);
+
+    char response[160];
+    JsonWriter out(response, sizeof(response));
+    out.beginObject();
+    out.number("jobId", job_id);
+    out.number("position", position);
+    out.string("state", print_job_state_name(PRINT_JOB_QUEUED));
+    out.string("priority", print_priority_name(job.priority));
+    out.string("location", location);
+    out.endObject();
+
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_hdr(req, "Location", location);
+    return send_json(req, out, response);
+}
+
+// API batch print endpoint: many label descriptions as one chained job
+static esp_err_t api_print_batch_post_handler(httpd_req_t *req)
+{
+    uint32_t client = request_client_id(req);
+
+    // The texts are only part of the body and together hold at most
+    // PRINT_BATCH_TEXT_MAX + 1 bytes; the exact size is checked when queued
+    size_t text_bytes = req->content_len < PRINT_BATCH_TEXT_MAX + 1 ? req->content_len : PRINT_BATCH_TEXT_MAX + 1;
+    if (!admit_print_request(req, client, text_bytes)) {
+        return ESP_OK;
+    }
+
+    BatchParser *batch = new (std::nothrow) BatchParser();
+    if (!batch) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    std::unique_ptr<BatchParser> owner(batch);
+
+    body_status_t status = receive_body(req, &batch_body_limits, batch);
+    if (status == BODY_REJECTED) {
+        char response[128];
+        JsonWriter out(response, sizeof(response));
+        out.beginObject();
+        out.string("error", batch->error());
+        if (batch->errorIndex() >= 0) {
+            out.number("index", batch->errorIndex());
+        }
+        out.endObject();
+        httpd_resp_set_status(req, "400 Bad Request");
+        return send_json(req, out, response);
+    } else if (status != BODY_OK) {
         return ESP_FAIL;
     }
 
-    if (!printerConnected || !printer) {
+    print_job_request_t job = {};
+    job.entries = batch->entries();
+    job.entry_count = (uint8_t)batch->count();
+    job.copies = batch->copies();
+    job.client = client;
+    job.priority = batch->hasPriority() ? batch->priority() :
+                   job.copies > PRINT_BULK_COPIES ? PRINT_PRIORITY_BULK : PRINT_PRIORITY_NORMAL;
+
+    printer_state_t state;
+    printer_task_get_state(&state);
+    if (!state.connected) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Printer not connected");
-        cJSON_Delete(doc);
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "Printing text: %s", text);
+    uint32_t job_id = 0;
+    size_t position = 0;
+    esp_err_t err = print_queue_submit(&job, &job_id, &position);
+    if (err == ESP_ERR_NO_MEM) {
+        print_queue_load_t load;
+        print_queue_get_load(&load);
+        return send_retry_later(req, admission_retry_after_s(load.pending_labels, load.label_ms),
+                                "Print queue full");
+    } else if (err == ESP_FAIL) {
+        return send_unavailable(req, JOB_SPOOL_RETRY_AFTER_S, "Job could not be spooled");
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to queue print job");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Queued batch job %" PRIu32 " (%s, %u descriptions, %u labels) at position %u", job_id,
+             print_priority_name(job.priority), job.entry_count, job.copies, (unsigned)position);
+
+    char location[32];
+    snprintf(location, sizeof(location), "/api/jobs/%" PRIu32, job_id);
+
+    // Which labels of the job each description became
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_hdr(req, "Location", location);
+    httpd_resp_set_type(req, "application/json");
+    JsonWriter out(httpd_chunk_sink, req);
+    out.beginObject();
+    out.number("jobId", job_id);
+    out.number("position", position);
+    out.string("state", print_job_state_name(PRINT_JOB_QUEUED));
+    out.string("priority", print_priority_name(job.priority));
+    out.number("labels", job.copies);
+    out.string("location", location);
+    out.beginArray("entries");
+    uint32_t first = 0;
+    for (size_t i = 0; i < batch->count(); i++) {
+        const print_label_entry_t *entry = &batch->entries()[i];
+        out.beginObject();
+        out.number("index", i);
+        out.number("firstLabel", first);
+        out.number("copies", entry->copies);
+        out.string("cut", print_cut_name(entry->cut));
+        out.endObject();
+        first += entry->copies;
+    }
+    out.endArray();
+    out.endObject();
+    if (!out.finish()) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Job id from /api/jobs/{id}
+static bool parse_job_id(httpd_req_t *req, uint32_t *id)
+{
+    const char *id_str = req->uri + strlen("/api/jobs/");
+    char *end = NULL;
+    unsigned long value = strtoul(id_str, &end, 10);
+    if (end == id_str || (*end != '\0' && *end != '?')) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid job id");
+        return false;
+    }
+    *id = (uint32_t)value;
+    return true;
+}
+
+// Integer request header; false when missing or malformed
+static bool request_header_int(httpd_req_t *req, const char *name, long *value)
+{
+    char buf[16];
+    if (httpd_req_get_hdr_value_str(req, name, buf, sizeof(buf)) != ESP_OK) {
+        return false;
+    }
+    char *end = NULL;
+    *value = strtol(buf, &end, 10);
+    return end != buf && *end == '\0';
+}
+
+// API raster upload endpoint. The body is a 1bpp bitmap described by
+// headers, or pre-encoded Brother raster lines; either way it goes to the
+// printer while it arrives and the response is sent once the label is out.
+static esp_err_t api_print_raster_post_handler(httpd_req_t *req)
+{
+    uint32_t wait_ms = 0;
+    if (!rate_limiter.allow(request_client_id(req), esp_timer_get_time() / 1000, &wait_ms)) {
+        return send_retry_later(req, (wait_ms + 999) / 1000, "Too many print requests");
+    }
+
+    printer_state_t state;
+    printer_task_get_state(&state);
+    if (!state.connected) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Printer not connected");
+        return ESP_FAIL;
+    }
 
-    bool success = printer->printText(text);
+    raster_upload_t upload = {};
+    upload.max_px = state.max_width;
+    upload.packbits = state.packbits;
 
-    if (success) {
-        httpd_resp_send(req, "Print job sent successfully", HTTPD_RESP_USE_STRLEN);
+    char value[16];
+    if (httpd_req_get_hdr_value_str(req, "X-Label-Format", value, sizeof(value)) == ESP_OK &&
+        strcmp(value, "bitmap") != 0) {
+        if (strcmp(value, "raster") != 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid X-Label-Format");
+            return ESP_FAIL;
+        }
+        upload.format = RASTER_UPLOAD_ENCODED;
+        long lines = 0;
+        request_header_int(req, "X-Label-Lines", &lines);
+        upload.lines = lines > 0 ? (uint32_t)lines : 0;
     } else {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Print job failed");
+        long width = 0, height = 0;
+        request_header_int(req, "X-Label-Width", &width);
+        request_header_int(req, "X-Label-Height", &height);
+        upload.width = (int)width;
+        upload.height = (int)height;
+        if (httpd_req_get_hdr_value_str(req, "X-Label-Orientation", value, sizeof(value)) == ESP_OK &&
+            !raster_orientation_from_name(value, &upload.orientation)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid X-Label-Orientation");
+            return ESP_FAIL;
+        }
+    }
+
+    // Compressed bodies are inflated on the way in; the size checks apply
+    // to the decoded bitmap
+    content_encoding_t encoding = CONTENT_ENCODING_IDENTITY;
+    char encoding_name[16] = "";
+    httpd_req_get_hdr_value_str(req, "Content-Encoding", encoding_name, sizeof(encoding_name));
+    if (!content_encoding_from_name(encoding_name, &encoding)) {
+        httpd_resp_set_status(req, "415 Unsupported Media Type");
+        httpd_resp_send(req, "Unsupported Content-Encoding", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    bool compressed = encoding != CONTENT_ENCODING_IDENTITY;
+    size_t decoded_len = compressed && upload.format == RASTER_UPLOAD_BITMAP ?
+                         raster_upload_bytes(&upload) : req->content_len;
+
+    const char *problem = raster_upload_check(&upload, decoded_len);
+    if (problem) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, problem);
+        return ESP_FAIL;
+    }
+
+    // The body is streamed to the printer as it arrives, which would hold
+    // this task for as long as queued labels take; only start when the
+    // printer task can take it at once
+    if (!printer_task_idle()) {
+        print_queue_load_t load;
+        print_queue_get_load(&load);
+        return send_unavailable(req, admission_retry_after_s(load.pending_labels, load.label_ms),
+                                "Printer busy");
+    }
+
+    int64_t started = esp_timer_get_time();
+    RasterUploadConsumer consumer(&upload);
+    InflateConsumer inflater(encoding, &consumer, raster_upload_bytes(&upload), RASTER_UPLOAD_MAX_BYTES);
+    body_status_t status = receive_body(req, &raster_body_limits,
+                                        compressed ? (BodyConsumer *)&inflater : &consumer);
+    if (status == BODY_REJECTED && inflater.error()) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, inflater.error());
+    } else if (status == BODY_REJECTED) {
+        switch (consumer.status()) {
+            case ESP_ERR_INVALID_ARG:
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, consumer.error());
+                break;
+            case ESP_ERR_INVALID_STATE:
+                send_unavailable(req, 1, consumer.error());
+                break;
+            default:
+                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, consumer.error());
+                break;
+        }
+    }
+    if (status != BODY_OK) {
+        return ESP_FAIL;
     }
 
+    char response[128];
+    JsonWriter out(response, sizeof(response));
+    out.beginObject();
+    out.number("lines", consumer.lines());
+    out.number("bytes", req->content_len);
+    if (compressed) {
+        out.number("decodedBytes", inflater.decodedLength());
+    }
+    out.number("totalMs", (esp_timer_get_time() - started) / 1000);
+    out.endObject();
+    return send_json(req, out, response);
+}
+
+// API job status endpoint: /api/jobs/{id}
+static esp_err_t api_job_get_handler(httpd_req_t *req)
+{
+    uint32_t id;
+    if (!parse_job_id(req, &id)) {
+        return ESP_FAIL;
+    }
+
+    print_job_info_t job;
+    if (!print_queue_get_job(id, &job)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown job");
+        return ESP_FAIL;
+    }
+
+    int64_t now = esp_timer_get_time();
+
+    // Streamed, as a batch job lists every label description
+    httpd_resp_set_type(req, "application/json");
+    JsonWriter out(httpd_chunk_sink, req);
+    out.beginObject();
+    out.number("jobId", job.id);
+    out.string("state", print_job_state_name(job.state));
+    out.string("priority", print_priority_name(job.priority));
+    out.number("labels", job.labels);
+    out.number("labelsDone", job.labels_done);
+    if (job.state == PRINT_JOB_QUEUED) {
+        out.number("position", print_queue_position(job.id));
+    }
+
+    // Timings in milliseconds; stages that have not ended yet run up to now
+    int64_t started = job.started_at ? job.started_at : now;
+    out.number("waitMs", (started - job.queued_at) / 1000);
+    if (job.started_at) {
+        int64_t rendered = job.rendered_at ? job.rendered_at : (job.finished_at ? job.finished_at : now);
+        out.number("renderMs", (rendered - job.started_at) / 1000);
+    }
+    if (job.rendered_at) {
+        int64_t finished = job.finished_at ? job.finished_at : now;
+        out.number("printMs", (finished - job.rendered_at) / 1000);
+    }
+    if (job.finished_at) {
+        out.number("totalMs", (job.finished_at - job.queued_at) / 1000);
+    }
+    if (job.state == PRINT_JOB_FAILED || job.state == PRINT_JOB_CANCELLED || job.state == PRINT_JOB_PAUSED) {
+        out.string("error", job.error);
+    }
+
+    // Per-label results of a batch: labels print in order, so each
+    // description's progress follows from the job's labelsDone
+    uint16_t copies[PRINT_BATCH_MAX_LABELS];
+    size_t entries = job.entries > 1 ? print_queue_get_entries(job.id, copies, PRINT_BATCH_MAX_LABELS) : 0;
+    if (entries) {
+        out.beginArray("entries");
+        uint32_t first = 0;
+        for (size_t i = 0; i < entries; i++) {
+            uint32_t done = job.labels_done > first ? job.labels_done - first : 0;
+            done = done < copies[i] ? done : copies[i];
+            print_job_state_t state = done == copies[i] ? PRINT_JOB_DONE :
+                                      (job.labels_done >= first || job.state >= PRINT_JOB_FAILED) ? job.state :
+                                      PRINT_JOB_QUEUED;
+            out.beginObject();
+            out.number("index", i);
+            out.number("copies", copies[i]);
+            out.number("labelsDone", done);
+            out.string("state", print_job_state_name(state));
+            out.endObject();
+            first += copies[i];
+        }
+        out.endArray();
+    }
+    out.endObject();
+
+    if (!out.finish()) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// API job cancel endpoint: DELETE /api/jobs/{id}
+static esp_err_t api_job_delete_handler(httpd_req_t *req)
+{
+    uint32_t id;
+    if (!parse_job_id(req, &id)) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = print_queue_cancel(id);
+    if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown job");
+        return ESP_FAIL;
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_send(req, "Job already finished or fully sent to the printer", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to cancel job");
+        return ESP_FAIL;
+    }
+
+    // Queued jobs are cancelled at once; a running label stops at the next
+    // raster line, so report whatever state the job is in now. A job that
+    // has already dropped out of the history was cancelled and retired.
+    print_job_info_t job = {};
+    if (!print_queue_get_job(id, &job)) {
+        job.state = PRINT_JOB_CANCELLED;
+    }
+
+    char response[96];
+    JsonWriter out(response, sizeof(response));
+    out.beginObject();
+    out.number("jobId", id);
+    out.string("state", print_job_state_name(job.state));
+    out.number("labelsDone", job.labels_done);
+    out.endObject();
+
+    if (job.state != PRINT_JOB_CANCELLED) {
+        httpd_resp_set_status(req, "202 Accepted");
+    }
+    return send_json(req, out, response);
+}
+
+// API queue endpoint: pending work and queue wait percentiles per class
+static esp_err_t api_queue_get_handler(httpd_req_t *req)
+{
+    cJSON *doc = cJSON_CreateObject();
+    print_queue_load_t load;
+    print_queue_get_load(&load);
+    cJSON_AddNumberToObject(doc, "pending", load.pending_jobs);
+    cJSON_AddNumberToObject(doc, "pendingLabels", load.pending_labels);
+    cJSON_AddNumberToObject(doc, "bytes", load.bytes);
+    cJSON_AddNumberToObject(doc, "labelMs", load.label_ms);
+    cJSON *classes = cJSON_AddObjectToObject(doc, "classes");
+
+    for (int i = 0; i < PRINT_PRIORITY_COUNT; i++) {
+        print_class_stats_t stats;
+        print_queue_get_class_stats((print_priority_t)i, &stats);
+
+        cJSON *entry = cJSON_AddObjectToObject(classes, print_priority_name((print_priority_t)i));
+        cJSON_AddNumberToObject(entry, "pending", stats.pending_jobs);
+        cJSON_AddNumberToObject(entry, "waitP50Ms", stats.wait_p50_ms);
+        cJSON_AddNumberToObject(entry, "waitP90Ms", stats.wait_p90_ms);
+        cJSON_AddNumberToObject(entry, "waitP99Ms", stats.wait_p99_ms);
+        cJSON_AddNumberToObject(entry, "samples", stats.samples);
+    }
+
+    print_session_stats_t sessions;
+    print_queue_get_session_stats(&sessions);
+    cJSON *session = cJSON_AddObjectToObject(doc, "sessions");
+    cJSON_AddNumberToObject(session, "count", sessions.sessions);
+    cJSON_AddNumberToObject(session, "labels", sessions.labels);
+    cJSON_AddNumberToObject(session, "lastLabels", sessions.last_labels);
+    cJSON_AddNumberToObject(session, "lastMs", sessions.last_ms);
+    cJSON_AddNumberToObject(session, "labelsPerMinute", sessions.labels_per_minute);
+
+    job_spool_stats_t spool;
+    job_spool_get_stats(&spool);
+    cJSON *spool_doc = cJSON_AddObjectToObject(doc, "spool");
+    cJSON_AddBoolToObject(spool_doc, "enabled", spool.enabled);
+    cJSON_AddNumberToObject(spool_doc, "live", spool.live);
+    cJSON_AddNumberToObject(spool_doc, "waiting", spool.waiting);
+    cJSON_AddNumberToObject(spool_doc, "logBytes", spool.log_bytes);
+    cJSON_AddNumberToObject(spool_doc, "indexBytes", spool.index_bytes);
+    cJSON_AddNumberToObject(spool_doc, "appends", spool.appends);
+    cJSON_AddNumberToObject(spool_doc, "lastAppendUs", spool.last_append_us);
+    cJSON_AddNumberToObject(spool_doc, "writeKBps", spool.write_kbps);
+    cJSON_AddNumberToObject(spool_doc, "recovered", spool.recovered);
+    cJSON_AddNumberToObject(spool_doc, "recoveryMs", spool.recovery_ms);
+    cJSON_AddNumberToObject(spool_doc, "checkpoints", spool.checkpoints);
+    cJSON_AddNumberToObject(spool_doc, "compactions", spool.compactions);
+
+    event_stream_stats_t events;
+    event_stream_get_stats(&events);
+    cJSON *events_doc = cJSON_AddObjectToObject(doc, "events");
+    cJSON_AddNumberToObject(events_doc, "subscribers", events.subscribers);
+    cJSON_AddNumberToObject(events_doc, "published", events.published);
+    cJSON_AddNumberToObject(events_doc, "dropped", events.dropped);
+    cJSON_AddNumberToObject(events_doc, "framesSent", events.frames_sent);
+
+    raw_listener_stats_t raw;
+    raw_listener_get_stats(&raw);
+    cJSON *raw_doc = cJSON_AddObjectToObject(doc, "raw");
+    cJSON_AddBoolToObject(raw_doc, "connected", raw.connected);
+    cJSON_AddNumberToObject(raw_doc, "connections", raw.connections);
+    cJSON_AddNumberToObject(raw_doc, "jobs", raw.jobs);
+    cJSON_AddNumberToObject(raw_doc, "failed", raw.failed);
+    cJSON_AddNumberToObject(raw_doc, "pages", raw.pages);
+    cJSON_AddNumberToObject(raw_doc, "bytes", raw.bytes);
+
+    char *response = cJSON_PrintUnformatted(doc);
     cJSON_Delete(doc);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, strlen(response));
+    free(response);
     return ESP_OK;
 }
 
 // API reconnect endpoint
 static esp_err_t api_reconnect_post_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "Reconnecting printer...");
-    
-    if (printer) {
-        printer->disconnect();
-        init_printer();
+    ESP_LOGI(TAG, "Reconnect requested");
+
+    // Runs on the printer task once any job in progress has finished
+    if (!printer_task_post(PRINTER_CMD_RECONNECT, 0)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Printer busy", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
     }
-    
-    httpd_resp_send(req, "Reconnection attempt completed", HTTPD_RESP_USE_STRLEN);
+
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_send(req, "Reconnection requested", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// API feed endpoint, optional body {"amount": n} with n from 1 to PRINTER_FEED_MAX
+static esp_err_t api_feed_post_handler(httpd_req_t *req)
+{
+    int amount = 1;
+    char buf[64];
+
+    if (req->content_len > 0) {
+        BufferConsumer body(buf, sizeof(buf));
+        if (receive_body(req, &feed_body_limits, &body) != BODY_OK) {
+            return ESP_FAIL;
+        }
+        int ret = body.length();
+
+        json_token_t tokens[API_MAX_TOKENS];
+        int count = json_parse(buf, ret, tokens, API_MAX_TOKENS);
+        if (count < 1 || tokens[0].type != JSON_OBJECT) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+            return ESP_FAIL;
+        }
+        int item = json_object_get(buf, tokens, count, 0, "amount");
+        if (item >= 0) {
+            // Every unit is a USB send the printer task cannot be pulled out of
+            long value = 0;
+            if (!json_token_int(buf, &tokens[item], &value) || value < 1 || value > PRINTER_FEED_MAX) {
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid amount");
+                return ESP_FAIL;
+            }
+            amount = (int)value;
+        }
+    }
+
+    if (!printer_task_post(PRINTER_CMD_FEED, (uint32_t)amount)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Printer busy", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_send(req, "Feed requested", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// API cut endpoint
+static esp_err_t api_cut_post_handler(httpd_req_t *req)
+{
+    if (!printer_task_post(PRINTER_CMD_CUT, 0)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Printer busy", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_send(req, "Cut requested", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
 // API list printers endpoint
 static esp_err_t api_printers_get_handler(httpd_req_t *req)
 {
-    cJSON *doc = cJSON_CreateObject();
-    cJSON *printers = cJSON_CreateArray();
-    cJSON_AddItemToObject(doc, "printers", printers);
+    // Streamed in chunks as it is written; the list is never held in RAM
+    httpd_resp_set_type(req, "application/json");
+    JsonWriter out(httpd_chunk_sink, req);
+    out.beginObject();
+    out.beginArray("printers");
     
     const pt_dev_info* devices = PtouchPrinter::getSupportedDevices();
     for (int i = 0; devices[i].vid != 0; i++) {
         if (!(devices[i].flags & FLAG_PLITE)) {
-            cJSON *printer = cJSON_CreateObject();
-            cJSON_AddStringToObject(printer, "name", devices[i].name);
-            cJSON_AddNumberToObject(printer, "vid", devices[i].vid);
-            cJSON_AddNumberToObject(printer, "pid", devices[i].pid);
-            cJSON_AddNumberToObject(printer, "maxWidth", devices[i].max_px);
-            cJSON_AddNumberToObject(printer, "dpi", devices[i].dpi);
-            cJSON_AddItemToArray(printers, printer);
+            out.beginObject();
+            out.string("name", devices[i].name);
+            out.number("vid", devices[i].vid);
+            out.number("pid", devices[i].pid);
+            out.number("maxWidth", devices[i].max_px);
+            out.number("dpi", devices[i].dpi);
+            out.endObject();
         }
     }
     
-    char *response = cJSON_PrintUnformatted(doc);
-    cJSON_Delete(doc);
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    free(response);
-    return ESP_OK;
+    out.endArray();
+    out.endObject();
+    if (!out.finish()) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 // Initialize HTTP server
@@ -374,37 +955,21 @@ static esp_err_t start_webserver(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = WEB_SERVER_PORT;
-    config.max_uri_handlers = 16;
+    config.max_uri_handlers = 20;
+    config.uri_match_fn = httpd_uri_match_wildcard;
 
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
         ESP_LOGI(TAG, "Registering URI handlers");
 
-        // Root handler
-        httpd_uri_t root = {
-            .uri       = "/",
-            .method    = HTTP_GET,
-            .handler   = root_get_handler,
-            .user_ctx  = NULL
-        };
-        httpd_register_uri_handler(server, &root);
-        
-        // Static file handlers
-        httpd_uri_t style = {
-            .uri       = "/style.css",
-            .method    = HTTP_GET,
-            .handler   = style_get_handler,
-            .user_ctx  = NULL
-        };
-        httpd_register_uri_handler(server, &style);
-        
-        httpd_uri_t script = {
-            .uri       = "/script.js",
-            .method    = HTTP_GET,
-            .handler   = script_get_handler,
-            .user_ctx  = NULL
-        };
-        httpd_register_uri_handler(server, &script);
+        // Web UI: index.html, style.css and script.js
+        web_assets_register(server);
+
+        // Prometheus scrape target
+        metrics_register(server);
+
+        // Stage timings of recent jobs, as a Chrome trace download
+        job_trace_register(server);
 
         // API handlers
         httpd_uri_t api_status = {
@@ -423,6 +988,46 @@ static esp_err_t start_webserver(void)
         };
         httpd_register_uri_handler(server, &api_print_text);
 
+        httpd_uri_t api_print_batch = {
+            .uri       = "/api/print/batch",
+            .method    = HTTP_POST,
+            .handler   = api_print_batch_post_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &api_print_batch);
+
+        httpd_uri_t api_print_raster = {
+            .uri       = "/api/print/raster",
+            .method    = HTTP_POST,
+            .handler   = api_print_raster_post_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &api_print_raster);
+
+        httpd_uri_t api_job = {
+            .uri       = "/api/jobs/*",
+            .method    = HTTP_GET,
+            .handler   = api_job_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &api_job);
+
+        httpd_uri_t api_job_cancel = {
+            .uri       = "/api/jobs/*",
+            .method    = HTTP_DELETE,
+            .handler   = api_job_delete_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &api_job_cancel);
+
+        httpd_uri_t api_queue = {
+            .uri       = "/api/queue",
+            .method    = HTTP_GET,
+            .handler   = api_queue_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &api_queue);
+
         httpd_uri_t api_reconnect = {
             .uri       = "/api/reconnect",
             .method    = HTTP_POST,
@@ -431,6 +1036,22 @@ static esp_err_t start_webserver(void)
         };
         httpd_register_uri_handler(server, &api_reconnect);
 
+        httpd_uri_t api_feed = {
+            .uri       = "/api/feed",
+            .method    = HTTP_POST,
+            .handler   = api_feed_post_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &api_feed);
+
+        httpd_uri_t api_cut = {
+            .uri       = "/api/cut",
+            .method    = HTTP_POST,
+            .handler   = api_cut_post_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &api_cut);
+
         httpd_uri_t api_printers = {
             .uri       = "/api/printers",
             .method    = HTTP_GET,
@@ -439,6 +1060,12 @@ static esp_err_t start_webserver(void)
         };
         httpd_register_uri_handler(server, &api_printers);
 
+        // Status and job progress pushed to the web UI
+        event_stream_start(server);
+
+        // Labels drawn in the web UI, streamed as raster lines
+        raster_socket_start(server);
+
         return ESP_OK;
     }
 
@@ -454,82 +1081,6 @@ static void stop_webserver(void)
     }
 }
 
-// Initialize printer
-static void init_printer(void)
-{
-    ESP_LOGI(TAG, "Initializing P-touch printer...");
-    
-    if (!printer) {
-        printer = new PtouchPrinter();
-    }
-    
-    printer->setVerbose(PRINTER_VERBOSE);
-    
-    if (printer->begin()) {
-        ESP_LOGI(TAG, "USB Host initialized");
-        
-        if (printer->detectPrinter()) {
-            if (printer->connect()) {
-                printerConnected = true;
-                strncpy(printerName, printer->getPrinterName(), sizeof(printerName) - 1);
-                printerMaxWidth = printer->getMaxWidth();
-                printerTapeWidth = printer->getTapeWidth();
-                strncpy(printerStatus, "Connected", sizeof(printerStatus) - 1);
-                
-                ESP_LOGI(TAG, "Printer connected: %s", printerName);
-                ESP_LOGI(TAG, "Max width: %d px, Tape width: %d px", printerMaxWidth, printerTapeWidth);
-            } else {
-                strncpy(printerStatus, "Connection failed", sizeof(printerStatus) - 1);
-                ESP_LOGI(TAG, "Failed to connect to printer");
-            }
-        } else {
-            strncpy(printerStatus, "Not detected", sizeof(printerStatus) - 1);
-            ESP_LOGI(TAG, "No printer detected");
-        }
-    } else {
-        strncpy(printerStatus, "USB Host init failed", sizeof(printerStatus) - 1);
-        ESP_LOGI(TAG, "Failed to initialize USB Host");
-    }
-}
-
-// Printer status monitoring task
-static void printer_status_task(void *pvParameters)
-{
-    while (1) {
-        if (printerConnected && printer) {
-            // Try to get status from printer
-            if (!printer->getStatus()) {
-                // Connection might be lost
-                printerConnected = false;
-                strncpy(printerStatus, "Connection lost", sizeof(printerStatus) - 1);
-                ESP_LOGI(TAG, "Printer connection lost");
-            } else {
-                // Update tape width if it changed
-                int currentTapeWidth = printer->getTapeWidth();
-                if (currentTapeWidth != printerTapeWidth) {
-                    printerTapeWidth = currentTapeWidth;
-                    ESP_LOGI(TAG, "Tape width changed to: %d px", printerTapeWidth);
-                }
-            }
-        } else {
-            // Try to reconnect
-            if (printer && printer->detectPrinter()) {
-                if (printer->connect()) {
-                    printerConnected = true;
-                    strncpy(printerName, printer->getPrinterName(), sizeof(printerName) - 1);
-                    printerMaxWidth = printer->getMaxWidth();
-                    printerTapeWidth = printer->getTapeWidth();
-                    strncpy(printerStatus, "Connected", sizeof(printerStatus) - 1);
-                    
-                    ESP_LOGI(TAG, "Printer reconnected: %s", printerName);
-                }
-            }
-        }
-        
-        vTaskDelay(pdMS_TO_TICKS(PRINTER_STATUS_CHECK_INTERVAL));
-    }
-}
-
 // Initialize SPIFFS
 static void init_spiffs(void)
 {
@@ -538,7 +1089,8 @@ static void init_spiffs(void)
     esp_vfs_spiffs_conf_t conf = {
         .base_path = "/spiffs",
         .partition_label = NULL,
-        .max_files = 5,
+        // The spool may be compacting while an asset is served
+        .max_files = SPOOL_LOG_MAX_FILES + WEB_ASSET_MAX_FILES,
         .format_if_mount_failed = true
     };
 
@@ -583,14 +1135,19 @@ extern "C" void app_main(void)
     // Initialize WiFi
     wifi_init_sta();
 
-    // Initialize printer
-    init_printer();
+    // Start the printer task; it owns the printer and all USB traffic.
+    // Jobs left in the spool by a reset are requeued by that task.
+    print_queue_init();
+    job_trace_init();
+    raster_stream_init();
+    job_spool_init();
+    printer_task_start();
 
     // Start web server
     start_webserver();
 
-    // Start printer status monitoring task
-    xTaskCreate(printer_status_task, "printer_status", 4096, NULL, 5, NULL);
+    // Raw jobs on port 9100 share the raster stream with HTTP uploads
+    raw_listener_start();
 
     ESP_LOGI(TAG, "Setup complete!");
 
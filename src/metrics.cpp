@@ -0,0 +1,246 @@
+/*
+ * P-touch ESP32 Prometheus Metrics
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "metrics.h"
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "histogram.h"
+
+static const char *TAG = "metrics";
+
+// Milliseconds; wide enough for a queue wait behind a long batch
+static const uint32_t stage_bounds_ms[] = {5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000};
+static const uint32_t label_bytes_bounds[] = {256, 1024, 4096, 16384, 65536, 262144};
+
+static const char *const stage_names[METRICS_STAGE_COUNT] = {
+    "queue_wait", "render", "encode", "usb", "print"
+};
+
+typedef Histogram<sizeof(stage_bounds_ms) / sizeof(stage_bounds_ms[0])> StageHistogram;
+
+static_assert(METRICS_STAGE_COUNT == 5, "One histogram per stage");
+static StageHistogram stage_histograms[METRICS_STAGE_COUNT] = {
+    StageHistogram(stage_bounds_ms), StageHistogram(stage_bounds_ms), StageHistogram(stage_bounds_ms),
+    StageHistogram(stage_bounds_ms), StageHistogram(stage_bounds_ms)
+};
+static Histogram<sizeof(label_bytes_bounds) / sizeof(label_bytes_bounds[0])> label_bytes(label_bytes_bounds);
+
+static std::atomic<uint32_t> jobs_done(0);
+static std::atomic<uint32_t> jobs_failed(0);
+static std::atomic<uint32_t> jobs_cancelled(0);
+
+static std::atomic<uint32_t> usb_transfers(0);
+static std::atomic<uint32_t> usb_errors(0);
+static std::atomic<uint32_t> usb_bytes(0);
+
+void metrics_record_stage(metrics_stage_t stage, int64_t us)
+{
+    if (stage < METRICS_STAGE_COUNT && us >= 0) {
+        stage_histograms[stage].record((uint32_t)(us / 1000));
+    }
+}
+
+void metrics_record_label(const ptouch_usb_stats_t *before, const ptouch_usb_stats_t *after, int64_t total_us)
+{
+    int64_t usb_us = after->busy_us - before->busy_us;
+    metrics_record_stage(METRICS_STAGE_USB, usb_us);
+    if (total_us > 0) {
+        metrics_record_stage(METRICS_STAGE_ENCODE, total_us > usb_us ? total_us - usb_us : 0);
+    }
+    label_bytes.record(after->bytes_out - before->bytes_out);
+}
+
+void metrics_count_job(print_job_state_t state)
+{
+    switch (state) {
+        case PRINT_JOB_DONE:
+            jobs_done.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case PRINT_JOB_FAILED:
+            jobs_failed.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case PRINT_JOB_CANCELLED:
+            jobs_cancelled.fetch_add(1, std::memory_order_relaxed);
+            break;
+        default:
+            break;
+    }
+}
+
+void metrics_update_usb(const ptouch_usb_stats_t *stats)
+{
+    usb_transfers.store(stats->transfers, std::memory_order_relaxed);
+    usb_errors.store(stats->errors, std::memory_order_relaxed);
+    usb_bytes.store(stats->bytes_out, std::memory_order_relaxed);
+}
+
+// Formats lines into one buffer and sends it as a chunk when it fills up
+typedef struct {
+    httpd_req_t *req;
+    char buffer[METRICS_CHUNK];
+    size_t len;
+    bool failed;
+} metrics_writer_t;
+
+static void flush(metrics_writer_t *out)
+{
+    if (out->len && !out->failed) {
+        out->failed = httpd_resp_send_chunk(out->req, out->buffer, out->len) != ESP_OK;
+    }
+    out->len = 0;
+}
+
+static void emit(metrics_writer_t *out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void emit(metrics_writer_t *out, const char *format, ...)
+{
+    for (int attempt = 0; attempt < 2; attempt++) {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(out->buffer + out->len, sizeof(out->buffer) - out->len, format, args);
+        va_end(args);
+        if (written >= 0 && (size_t)written < sizeof(out->buffer) - out->len) {
+            out->len += written;
+            return;
+        }
+        flush(out);
+    }
+    ESP_LOGW(TAG, "Metric line too long: %s", format);
+}
+
+static void emit_header(metrics_writer_t *out, const char *name, const char *type, const char *help)
+{
+    emit(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void emit_gauge(metrics_writer_t *out, const char *name, const char *help, uint32_t value)
+{
+    emit_header(out, name, "gauge", help);
+    emit(out, "%s %u\n", name, (unsigned)value);
+}
+
+static void emit_counter(metrics_writer_t *out, const char *name, const char *help, uint32_t value)
+{
+    emit_header(out, name, "counter", help);
+    emit(out, "%s %u\n", name, (unsigned)value);
+}
+
+// Millisecond histograms are exported in seconds, the Prometheus base unit
+template <size_t N>
+static void emit_histogram(metrics_writer_t *out, const char *name, const char *labels,
+                           const Histogram<N> &histogram, bool milliseconds)
+{
+    const char *sep = labels[0] ? "," : "";
+    for (size_t i = 0; i < N; i++) {
+        uint32_t bound = histogram.bound(i);
+        if (milliseconds) {
+            emit(out, "%s_bucket{%s%sle=\"%u.%03u\"} %u\n", name, labels, sep,
+                 (unsigned)(bound / 1000), (unsigned)(bound % 1000), (unsigned)histogram.cumulative(i));
+        } else {
+            emit(out, "%s_bucket{%s%sle=\"%u\"} %u\n", name, labels, sep, (unsigned)bound,
+                 (unsigned)histogram.cumulative(i));
+        }
+    }
+    emit(out, "%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, sep, (unsigned)histogram.count());
+
+    char braces[40] = "";
+    if (labels[0]) {
+        snprintf(braces, sizeof(braces), "{%s}", labels);
+    }
+    uint32_t sum = histogram.sum();
+    if (milliseconds) {
+        emit(out, "%s_sum%s %u.%03u\n", name, braces, (unsigned)(sum / 1000), (unsigned)(sum % 1000));
+    } else {
+        emit(out, "%s_sum%s %u\n", name, braces, (unsigned)sum);
+    }
+    emit(out, "%s_count%s %u\n", name, braces, (unsigned)histogram.count());
+}
+
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+    metrics_writer_t *out = (metrics_writer_t *)malloc(sizeof(metrics_writer_t));
+    if (!out) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    out->req = req;
+    out->len = 0;
+    out->failed = false;
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    emit_header(out, "ptouch_jobs_total", "counter", "Print jobs by final state");
+    emit(out, "ptouch_jobs_total{outcome=\"done\"} %u\n", (unsigned)jobs_done.load(std::memory_order_relaxed));
+    emit(out, "ptouch_jobs_total{outcome=\"failed\"} %u\n", (unsigned)jobs_failed.load(std::memory_order_relaxed));
+    emit(out, "ptouch_jobs_total{outcome=\"cancelled\"} %u\n",
+         (unsigned)jobs_cancelled.load(std::memory_order_relaxed));
+
+    emit_header(out, "ptouch_stage_seconds", "histogram", "Time spent in each stage of a label");
+    for (int i = 0; i < METRICS_STAGE_COUNT; i++) {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", stage_names[i]);
+        emit_histogram(out, "ptouch_stage_seconds", labels, stage_histograms[i], true);
+    }
+
+    emit_header(out, "ptouch_label_bytes", "histogram", "Bytes sent to the printer per label");
+    emit_histogram(out, "ptouch_label_bytes", "", label_bytes, false);
+
+    emit_counter(out, "ptouch_usb_transfers_total", "USB transfers submitted",
+                 usb_transfers.load(std::memory_order_relaxed));
+    emit_counter(out, "ptouch_usb_errors_total", "USB transfers that failed",
+                 usb_errors.load(std::memory_order_relaxed));
+    emit_counter(out, "ptouch_usb_bytes_total", "Bytes sent to the printer",
+                 usb_bytes.load(std::memory_order_relaxed));
+
+    print_queue_load_t load;
+    print_queue_get_load(&load);
+    emit_gauge(out, "ptouch_queue_jobs", "Jobs waiting for the printer", load.pending_jobs);
+    emit_gauge(out, "ptouch_queue_labels", "Labels of queued and running jobs not printed yet", load.pending_labels);
+    emit_gauge(out, "ptouch_queue_bytes", "Job data held in RAM", load.bytes);
+
+    emit_gauge(out, "ptouch_heap_free_bytes", "Free internal RAM", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    emit_gauge(out, "ptouch_heap_min_free_bytes", "Lowest free internal RAM since boot",
+               heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    emit_gauge(out, "ptouch_heap_largest_block_bytes", "Largest free internal block",
+               heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    emit_gauge(out, "ptouch_psram_free_bytes", "Free PSRAM, 0 without PSRAM", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    emit_gauge(out, "ptouch_psram_total_bytes", "PSRAM size, 0 without PSRAM", heap_caps_get_total_size(MALLOC_CAP_SPIRAM));
+
+    flush(out);
+    bool failed = out->failed;
+    free(out);
+    if (failed) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t metrics_register(httpd_handle_t server)
+{
+    httpd_uri_t metrics = {
+        .uri       = METRICS_URI,
+        .method    = HTTP_GET,
+        .handler   = metrics_get_handler,
+        .user_ctx  = NULL
+    };
+    return httpd_register_uri_handler(server, &metrics);
+}
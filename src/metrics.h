@@ -0,0 +1,60 @@
+/*
+ * P-touch ESP32 Prometheus Metrics
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "ptouch_esp32.h"
+#include "print_queue.h"
+
+// GET /metrics in the Prometheus text format. Recording is a few relaxed
+// atomic adds, so it stays on in production; the text is only built when
+// a scraper asks for it.
+#define METRICS_URI             "/metrics"
+#define METRICS_CHUNK           512     // Response text is sent in pieces of this size
+
+// Stages of a label, each with its own latency histogram
+typedef enum {
+    METRICS_STAGE_QUEUE_WAIT = 0,       // Accepted until the printer task picks the job up
+    METRICS_STAGE_RENDER,               // Text to bitmap
+    METRICS_STAGE_ENCODE,               // Sending a label, less the time spent in USB transfers
+    METRICS_STAGE_USB,                  // USB transfers of one label
+    METRICS_STAGE_PRINT,                // Last byte sent until print-complete status is seen
+    METRICS_STAGE_COUNT
+} metrics_stage_t;
+
+void metrics_record_stage(metrics_stage_t stage, int64_t us);
+
+// One label's transfer, from the printer's USB counters before and after
+// it. Records the USB stage and bytes per label; a non-zero total_us also
+// records the rest of that time as the encode stage.
+void metrics_record_label(const ptouch_usb_stats_t *before, const ptouch_usb_stats_t *after, int64_t total_us);
+
+// A job reached a final state
+void metrics_count_job(print_job_state_t state);
+
+// Printer task side: publish the printer's running USB counters
+void metrics_update_usb(const ptouch_usb_stats_t *stats);
+
+esp_err_t metrics_register(httpd_handle_t server);
+
+#endif // METRICS_H
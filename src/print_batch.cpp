@@ -0,0 +1,359 @@
+/*
+ * P-touch ESP32 Batch Print Requests
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "print_batch.h"
+#include <string.h>
+#include "json_lite.h"
+
+// Tokens for one label description; unknown members beyond this are refused
+#define BATCH_ELEMENT_TOKENS    16
+
+const char* print_cut_name(print_cut_t cut)
+{
+    switch (cut) {
+        case PRINT_CUT_NONE: return "none";
+        case PRINT_CUT_EACH: return "each";
+        case PRINT_CUT_END:  return "end";
+    }
+    return "unknown";
+}
+
+bool print_cut_from_name(const char *name, print_cut_t *cut)
+{
+    if (!name) {
+        return false;
+    }
+    for (int i = PRINT_CUT_NONE; i <= PRINT_CUT_END; i++) {
+        if (strcmp(name, print_cut_name((print_cut_t)i)) == 0) {
+            *cut = (print_cut_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+BatchParser::BatchParser()
+    : state(EXPECT_OPEN), in_string(false), escaped(false), nesting(0), seen_labels(false),
+      key_len(0), capture_len(0), capture_overflow(false), label_count(0), total_copies(0),
+      text_used(0), priority_set(false), batch_priority(PRINT_PRIORITY_NORMAL),
+      failure(NULL), failure_index(-1)
+{
+    key[0] = '\0';
+}
+
+bool BatchParser::fail(const char *reason, int index)
+{
+    if (!failure) {
+        failure = reason;
+        failure_index = index;
+    }
+    return false;
+}
+
+void BatchParser::captureChar(char c)
+{
+    if (capture_len < sizeof(capture) - 1) {
+        capture[capture_len++] = c;
+    } else {
+        capture_overflow = true;
+    }
+}
+
+bool BatchParser::scanNested(char c)
+{
+    if (in_string) {
+        if (escaped) {
+            escaped = false;
+        } else if (c == '\\') {
+            escaped = true;
+        } else if (c == '"') {
+            in_string = false;
+        }
+        return false;
+    }
+    if (c == '"') {
+        in_string = true;
+    } else if (c == '{' || c == '[') {
+        nesting++;
+    } else if (c == '}' || c == ']') {
+        nesting--;
+        return nesting == 0;
+    }
+    return false;
+}
+
+// A top-level member other than "labels" has ended
+bool BatchParser::finishValue()
+{
+    if (strcmp(key, "priority") != 0) {
+        return true;
+    }
+
+    json_token_t token;
+    char name[16];
+    if (capture_overflow || json_parse(capture, capture_len, &token, 1) != 1 ||
+        !json_token_string(capture, &token, name, sizeof(name)) ||
+        !print_priority_from_name(name, &batch_priority)) {
+        return fail("Invalid priority");
+    }
+    priority_set = true;
+    return true;
+}
+
+// One label description has been captured
+bool BatchParser::finishElement()
+{
+    int index = (int)label_count;
+    if (capture_overflow) {
+        return fail("Label description too long", index);
+    }
+    if (label_count >= PRINT_BATCH_MAX_LABELS) {
+        return fail("Too many label descriptions", index);
+    }
+
+    json_token_t tokens[BATCH_ELEMENT_TOKENS];
+    int count = json_parse(capture, capture_len, tokens, BATCH_ELEMENT_TOKENS);
+    if (count < 1 || tokens[0].type != JSON_OBJECT) {
+        return fail("Invalid label description", index);
+    }
+
+    int text = json_object_get(capture, tokens, count, 0, "text");
+    if (text < 0 || tokens[text].type != JSON_STRING) {
+        return fail("Missing text", index);
+    }
+    char *decoded = texts + text_used;
+    if (!json_token_string(capture, &tokens[text], decoded, sizeof(texts) - text_used)) {
+        return fail("Label text exceeds the batch limit", index);
+    }
+    if (decoded[0] == '\0') {
+        return fail("Empty text", index);
+    }
+
+    print_label_entry_t &entry = labels[label_count];
+    entry.text = decoded;
+    entry.copies = 1;
+    entry.cut = PRINT_CUT_NONE;
+
+    int copies = json_object_get(capture, tokens, count, 0, "copies");
+    if (copies >= 0) {
+        long value = 0;
+        if (!json_token_int(capture, &tokens[copies], &value) || value < 1 || value > PRINT_BATCH_MAX_COPIES) {
+            return fail("Invalid copies", index);
+        }
+        entry.copies = (uint16_t)value;
+    }
+    if (total_copies + entry.copies > PRINT_BATCH_MAX_COPIES) {
+        return fail("Too many labels in the batch", index);
+    }
+
+    int cut = json_object_get(capture, tokens, count, 0, "cut");
+    if (cut >= 0) {
+        char name[8];
+        if (!json_token_string(capture, &tokens[cut], name, sizeof(name)) ||
+            !print_cut_from_name(name, &entry.cut)) {
+            return fail("Invalid cut", index);
+        }
+    }
+
+    text_used += strlen(decoded) + 1;
+    total_copies += entry.copies;
+    label_count++;
+    return true;
+}
+
+bool BatchParser::step(char c)
+{
+    switch (state) {
+        case EXPECT_OPEN:
+            if (is_space(c)) {
+                return true;
+            }
+            if (c != '{') {
+                return fail("Body must be a JSON object");
+            }
+            state = EXPECT_KEY;
+            return true;
+
+        case EXPECT_KEY:
+            if (is_space(c)) {
+                return true;
+            }
+            if (c == '}') {
+                state = DONE;
+                return true;
+            }
+            if (c != '"') {
+                return fail("Invalid JSON");
+            }
+            key_len = 0;
+            escaped = false;
+            state = IN_KEY;
+            return true;
+
+        case IN_KEY:
+            if (!escaped && c == '"') {
+                key[key_len] = '\0';
+                state = EXPECT_COLON;
+                return true;
+            }
+            escaped = !escaped && c == '\\';
+            // Longer keys are truncated; they match nothing we read
+            if (key_len < sizeof(key) - 1) {
+                key[key_len++] = c;
+            }
+            return true;
+
+        case EXPECT_COLON:
+            if (is_space(c)) {
+                return true;
+            }
+            if (c != ':') {
+                return fail("Invalid JSON");
+            }
+            state = EXPECT_VALUE;
+            return true;
+
+        case EXPECT_VALUE:
+            if (is_space(c)) {
+                return true;
+            }
+            if (strcmp(key, "labels") == 0) {
+                if (seen_labels || c != '[') {
+                    return fail("labels must be one array");
+                }
+                seen_labels = true;
+                state = EXPECT_ELEMENT;
+                return true;
+            }
+            capture_len = 0;
+            capture_overflow = false;
+            nesting = 0;
+            in_string = false;
+            escaped = false;
+            state = IN_VALUE;
+            return step(c);
+
+        case IN_VALUE:
+            if (!in_string && nesting == 0 && (c == ',' || c == '}')) {
+                if (!finishValue()) {
+                    return false;
+                }
+                state = c == ',' ? EXPECT_KEY : DONE;
+                return true;
+            }
+            captureChar(c);
+            scanNested(c);
+            if (nesting < 0) {
+                return fail("Invalid JSON");
+            }
+            return true;
+
+        case EXPECT_ELEMENT:
+            if (is_space(c)) {
+                return true;
+            }
+            if (c == ']') {
+                state = AFTER_VALUE;
+                return true;
+            }
+            if (c != '{') {
+                return fail("Each label must be an object", (int)label_count);
+            }
+            capture_len = 0;
+            capture_overflow = false;
+            nesting = 0;
+            in_string = false;
+            escaped = false;
+            state = IN_ELEMENT;
+            // fall through
+        case IN_ELEMENT:
+            captureChar(c);
+            if (scanNested(c)) {
+                if (!finishElement()) {
+                    return false;
+                }
+                state = AFTER_ELEMENT;
+            }
+            return true;
+
+        case AFTER_ELEMENT:
+            if (is_space(c)) {
+                return true;
+            }
+            if (c == ',') {
+                state = EXPECT_ELEMENT;
+                return true;
+            }
+            if (c == ']') {
+                state = AFTER_VALUE;
+                return true;
+            }
+            return fail("Invalid JSON");
+
+        case AFTER_VALUE:
+            if (is_space(c)) {
+                return true;
+            }
+            if (c == ',') {
+                state = EXPECT_KEY;
+                return true;
+            }
+            if (c == '}') {
+                state = DONE;
+                return true;
+            }
+            return fail("Invalid JSON");
+
+        case DONE:
+            return is_space(c) ? true : fail("Data after the JSON object");
+    }
+    return fail("Invalid JSON");
+}
+
+bool BatchParser::consume(const char *data, size_t len)
+{
+    if (failure) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!step(data[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BatchParser::end()
+{
+    if (failure) {
+        return false;
+    }
+    if (state != DONE) {
+        return fail("Invalid JSON");
+    }
+    if (label_count == 0) {
+        return fail("No labels");
+    }
+    return true;
+}
@@ -0,0 +1,123 @@
+/*
+ * P-touch ESP32 Batch Print Requests
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PRINT_BATCH_H
+#define PRINT_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "body_reader.h"
+#include "job_scheduler.h"
+
+// A batch is one job made of several label descriptions, printed as one
+// chained session. Its texts share the job's PRINT_JOB_TEXT_MAX budget.
+#define PRINT_BATCH_MAX_LABELS      32      // Label descriptions per batch
+#define PRINT_BATCH_TEXT_MAX        1023    // All texts of a batch, as PRINT_JOB_TEXT_MAX
+#define PRINT_BATCH_MAX_COPIES      500     // Labels per batch, as PRINT_JOB_MAX_COPIES
+#define PRINT_BATCH_ELEMENT_MAX     1536    // JSON of one label description
+#define PRINT_BATCH_BODY_MAX        16384
+
+// Where the tape is fed and cut, ending the chained session
+typedef enum {
+    PRINT_CUT_NONE = 0,                 // Stay chained to the next label
+    PRINT_CUT_EACH,                     // After every copy
+    PRINT_CUT_END                       // After the description's last copy
+} print_cut_t;
+
+const char* print_cut_name(print_cut_t cut);
+bool print_cut_from_name(const char *name, print_cut_t *cut);
+
+// One label description of a job
+typedef struct {
+    const char *text;
+    uint16_t copies;
+    print_cut_t cut;
+} print_label_entry_t;
+
+// Incremental parser for POST /api/print/batch bodies:
+//   {"priority": "bulk", "labels": [{"text": "A", "copies": 2, "cut": "end"}, ...]}
+// Only one label description is held at a time, so the body itself may be
+// far larger than the texts it carries. Texts are decoded into the
+// parser's own storage; entries() stays valid while the parser lives.
+class BatchParser : public BodyConsumer {
+public:
+    BatchParser();
+
+    bool consume(const char *data, size_t len) override;
+    bool end() override;
+
+    const print_label_entry_t* entries() const { return labels; }
+    size_t count() const { return label_count; }
+    uint16_t copies() const { return total_copies; }
+
+    // Set when the body had a "priority" member
+    bool hasPriority() const { return priority_set; }
+    print_priority_t priority() const { return batch_priority; }
+
+    const char* error() const { return failure; }
+    int errorIndex() const { return failure_index; }    // Label description at fault, or -1
+
+private:
+    enum State {
+        EXPECT_OPEN,
+        EXPECT_KEY,
+        IN_KEY,
+        EXPECT_COLON,
+        EXPECT_VALUE,
+        IN_VALUE,                       // Any member other than "labels"
+        EXPECT_ELEMENT,
+        IN_ELEMENT,
+        AFTER_ELEMENT,
+        AFTER_VALUE,
+        DONE
+    };
+
+    State state;
+    bool in_string;
+    bool escaped;
+    int nesting;                        // Brackets open inside the captured value
+    bool seen_labels;
+
+    char key[16];
+    size_t key_len;
+    char capture[PRINT_BATCH_ELEMENT_MAX];
+    size_t capture_len;
+    bool capture_overflow;
+
+    print_label_entry_t labels[PRINT_BATCH_MAX_LABELS];
+    size_t label_count;
+    uint16_t total_copies;
+    char texts[PRINT_BATCH_TEXT_MAX + 1];
+    size_t text_used;
+
+    bool priority_set;
+    print_priority_t batch_priority;
+
+    const char *failure;
+    int failure_index;
+
+    bool fail(const char *reason, int index = -1);
+    bool step(char c);
+    void captureChar(char c);
+    bool scanNested(char c);            // True when c closed the captured value
+    bool finishValue();
+    bool finishElement();
+};
+
+#endif // PRINT_BATCH_H
@@ -0,0 +1,959 @@
+/*
+ * P-touch ESP32 Print Job Queue
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "print_queue.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "printer_task.h"
+#include "job_spool.h"
+#include "metrics.h"
+#include "job_trace.h"
+#include "event_stream.h"
+
+static const char *TAG = "print-queue";
+
+static_assert(PRINT_BATCH_TEXT_MAX <= PRINT_JOB_TEXT_MAX, "Batch texts must fit a job");
+static_assert(PRINT_BATCH_MAX_COPIES <= PRINT_JOB_MAX_COPIES, "Batch labels must fit a job");
+
+// One slot per pending job, the running job and the finished history
+#define PRINT_JOB_SLOTS (PRINT_QUEUE_LENGTH + PRINT_JOB_HISTORY + 1)
+
+typedef struct {
+    bool in_use;
+    print_job_info_t info;
+    uint32_t client;
+    uint32_t spool_ref;                 // Spool record, JOB_SPOOL_NONE if not persisted
+    bool cancelled;                     // Cancel requested while running
+    bool all_sent;                      // Last label sent, only confirmations to come
+    print_label_entry_t *entries;       // Owned copy with the texts behind it, freed when the job finishes
+    size_t bytes;                       // Label text held, counted in queued_bytes
+    uint16_t entry_copies[PRINT_BATCH_MAX_LABELS]; // Kept after the texts go, for per-label results
+} print_job_slot_t;
+
+// Job table, shared with the HTTP handlers under job_lock
+static print_job_slot_t job_slots[PRINT_JOB_SLOTS];
+static SemaphoreHandle_t job_lock = NULL;
+static uint32_t next_job_id = 1;
+static size_t pending_jobs = 0;
+static size_t pending_labels = 0;
+static size_t queued_bytes = 0;
+static uint32_t label_ms = 0;
+static WaitStats wait_stats[PRINT_PRIORITY_COUNT];
+static print_session_stats_t session_stats = {};
+static uint32_t printing_job = 0;       // Job whose label is on the wire
+
+// Printer task only
+static JobScheduler scheduler;
+static bool session_open = false;       // Last label was chained, tape not ejected yet
+static int64_t session_started_at = 0;
+static uint16_t session_labels = 0;
+static int64_t last_arrival = 0;        // Last job handed to the scheduler
+static int64_t last_confirmed_at = 0;   // Last print-complete status taken
+
+// Labels sent to the printer whose print-complete status has not been seen
+// yet, oldest first. The newest one is left unconfirmed so the next
+// label's transfer, or the mailbox, is served while it prints; it is
+// settled by the next label or the printer task's idle poll.
+#define PRINT_UNCONFIRMED_MAX 2
+
+typedef struct {
+    uint32_t job_id;
+    uint32_t printed_target;            // Printer's printed count once this label is out
+    int64_t deadline;                   // Give up waiting for its status
+    int64_t started_at;                 // First byte handed to USB
+    int64_t sent_at;                    // Last byte handed to USB
+    uint16_t label;                     // Index within the job, for its trace
+} unconfirmed_label_t;
+
+static unconfirmed_label_t unconfirmed[PRINT_UNCONFIRMED_MAX];
+static size_t unconfirmed_count = 0;
+
+static bool job_finished(const print_job_slot_t *slot)
+{
+    return slot->info.state == PRINT_JOB_DONE || slot->info.state == PRINT_JOB_FAILED ||
+           slot->info.state == PRINT_JOB_CANCELLED;
+}
+
+static print_job_slot_t* find_slot(uint32_t id)
+{
+    for (int i = 0; i < PRINT_JOB_SLOTS; i++) {
+        if (job_slots[i].in_use && job_slots[i].info.id == id) {
+            return &job_slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Free slot, or the oldest finished job if the history is full
+static print_job_slot_t* alloc_slot(void)
+{
+    print_job_slot_t *oldest = NULL;
+    for (int i = 0; i < PRINT_JOB_SLOTS; i++) {
+        print_job_slot_t *slot = &job_slots[i];
+        if (!slot->in_use) {
+            return slot;
+        }
+        if (job_finished(slot)) {
+            if (!oldest || slot->info.finished_at < oldest->info.finished_at) {
+                oldest = slot;
+            }
+        }
+    }
+    return oldest;
+}
+
+// Push a job's current state to event stream subscribers
+static void publish_job(uint32_t id)
+{
+    print_job_info_t info;
+    if (print_queue_get_job(id, &info)) {
+        event_stream_job(&info);
+    }
+}
+
+// Move a job to a final state; call with job_lock held. Returns the spool
+// record to complete once the lock is released.
+static uint32_t finish_slot(print_job_slot_t *slot, print_job_state_t state, const char *error)
+{
+    if (slot->info.state == PRINT_JOB_QUEUED) {
+        pending_jobs--;
+    }
+    pending_labels -= slot->info.labels - slot->info.labels_done;
+    queued_bytes -= slot->bytes;
+    slot->bytes = 0;
+    slot->info.state = state;
+    slot->info.finished_at = esp_timer_get_time();
+    metrics_count_job(state);
+    job_trace_finish(slot->info.id, state, slot->info.finished_at);
+    if (error) {
+        strncpy(slot->info.error, error, sizeof(slot->info.error) - 1);
+    }
+    free(slot->entries);
+    slot->entries = NULL;
+    return slot->spool_ref;
+}
+
+static void finish_job(uint32_t id, print_job_state_t state, const char *error)
+{
+    uint32_t spool_ref = JOB_SPOOL_NONE;
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *slot = find_slot(id);
+    if (slot && !job_finished(slot)) {
+        spool_ref = finish_slot(slot, state, error);
+    }
+    xSemaphoreGive(job_lock);
+
+    // Failed and cancelled jobs are not replayed either
+    job_spool_complete(spool_ref);
+
+    if (state != PRINT_JOB_DONE) {
+        scheduler.remove(id);
+    }
+    publish_job(id);
+}
+
+// Stop a job after a printer error. Labels confirmed so far stay done and
+// the spool checkpoint says where to continue; a job that keeps failing
+// after PRINT_JOB_MAX_RESUMES attempts is failed for good.
+static void pause_job(uint32_t id, const char *error)
+{
+    bool paused = false;
+    bool give_up = false;
+    uint16_t labels_done = 0;
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *slot = find_slot(id);
+    if (slot && !job_finished(slot) && slot->info.state != PRINT_JOB_PAUSED) {
+        if (slot->info.resumes >= PRINT_JOB_MAX_RESUMES) {
+            give_up = true;
+        } else {
+            if (slot->info.state == PRINT_JOB_QUEUED) {
+                pending_jobs--;
+            }
+            slot->info.state = PRINT_JOB_PAUSED;
+            slot->all_sent = false;
+            strncpy(slot->info.error, error, sizeof(slot->info.error) - 1);
+            labels_done = slot->info.labels_done;
+            paused = true;
+        }
+    }
+    xSemaphoreGive(job_lock);
+
+    scheduler.remove(id);
+    if (give_up) {
+        finish_job(id, PRINT_JOB_FAILED, error);
+    } else if (paused) {
+        ESP_LOGW(TAG, "Job %" PRIu32 " paused after %u labels: %s", id, labels_done, error);
+        publish_job(id);
+    }
+}
+
+// Count a label the printer confirmed; the job is done once all are. A
+// cancel that came too late to stop its last label still ends it cancelled.
+static void confirm_label(uint32_t id)
+{
+    uint32_t spool_ref = JOB_SPOOL_NONE;
+    uint16_t labels_done = 0;
+    bool done = false;
+    bool cancelled = false;
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *slot = find_slot(id);
+    if (slot && !job_finished(slot)) {
+        labels_done = ++slot->info.labels_done;
+        pending_labels--;
+        done = labels_done >= slot->info.labels;
+        cancelled = slot->cancelled;
+        spool_ref = slot->spool_ref;
+    }
+    xSemaphoreGive(job_lock);
+
+    if (done && cancelled) {
+        finish_job(id, PRINT_JOB_CANCELLED, "Cancelled");
+    } else if (done) {
+        finish_job(id, PRINT_JOB_DONE, NULL);
+    } else {
+        job_spool_checkpoint(spool_ref, labels_done);
+        publish_job(id);
+    }
+}
+
+// Take print-complete status until at most keep labels are unconfirmed.
+// Without wait a label whose status has not arrived stops the loop until
+// its deadline. A label whose status does not come in time is taken as
+// printed if the printer reports no error; its notification is expected,
+// so a late one is not counted for the next label. On an error nothing
+// after the last confirmed label is trusted and every job with an
+// unconfirmed label is paused.
+static bool confirm_labels(PtouchPrinter *printer, size_t keep, bool wait = true)
+{
+    while (unconfirmed_count > keep) {
+        const unconfirmed_label_t &oldest = unconfirmed[0];
+        ptouch_wait_t result = PTOUCH_WAIT_ERROR;
+        if (printer && printer->isConnected()) {
+            int64_t left_ms = (oldest.deadline - esp_timer_get_time()) / 1000;
+            uint32_t timeout_ms = (wait && left_ms > 0) ? (uint32_t)left_ms : 0;
+            result = printer->waitForPrinted(oldest.printed_target, timeout_ms);
+            if (result == PTOUCH_WAIT_TIMEOUT && left_ms > 0 && !wait) {
+                return true;
+            }
+        }
+        bool assumed = false;
+        if (result == PTOUCH_WAIT_TIMEOUT && printer->getStatus() && !printer->hasError()) {
+            // Reprinting would duplicate a label that most likely came out
+            ESP_LOGW(TAG, "Job %" PRIu32 " label %u not confirmed, printer reports no error",
+                     oldest.job_id, oldest.label + 1);
+            printer->expectPrinted(oldest.printed_target);
+            result = PTOUCH_WAIT_PRINTED;
+            assumed = true;
+        }
+        if (result != PTOUCH_WAIT_PRINTED) {
+            const char *error = (printer && printer->hasError()) ? printer->getErrorDescription()
+                                                                 : "Label not confirmed by printer";
+            unconfirmed_label_t lost[PRINT_UNCONFIRMED_MAX];
+            size_t count = unconfirmed_count;
+            memcpy(lost, unconfirmed, sizeof(lost));
+            unconfirmed_count = 0;
+            for (size_t i = 0; i < count; i++) {
+                pause_job(lost[i].job_id, error);
+            }
+            return false;
+        }
+
+        uint32_t id = oldest.job_id;
+        int64_t confirmed_at = esp_timer_get_time();
+        metrics_record_stage(METRICS_STAGE_PRINT, confirmed_at - oldest.sent_at);
+        job_trace_record(id, JOB_TRACE_CONFIRM, oldest.sent_at, confirmed_at, oldest.label, 0);
+
+        // Printer time for this label: from its transfer, or from the
+        // previous label's status if that came later, to its own status.
+        // A status assumed at the deadline only marks the deadline.
+        if (!assumed) {
+            int64_t busy_from = oldest.started_at > last_confirmed_at ? oldest.started_at : last_confirmed_at;
+            uint32_t print_ms = (uint32_t)((confirmed_at - busy_from) / 1000);
+            xSemaphoreTake(job_lock, portMAX_DELAY);
+            label_ms = label_ms ? (label_ms * 7 + print_ms) / 8 : print_ms;
+            xSemaphoreGive(job_lock);
+        }
+        last_confirmed_at = confirmed_at;
+        unconfirmed_count--;
+        memmove(&unconfirmed[0], &unconfirmed[1], unconfirmed_count * sizeof(unconfirmed[0]));
+        confirm_label(id);
+    }
+    return true;
+}
+
+static size_t scheduled_labels(void)
+{
+    size_t labels = 0;
+    for (int i = 0; i < PRINT_PRIORITY_COUNT; i++) {
+        labels += scheduler.pendingLabels((print_priority_t)i);
+    }
+    return labels;
+}
+
+static void end_session(void)
+{
+    if (session_labels > 0) {
+        uint32_t ms = (uint32_t)((esp_timer_get_time() - session_started_at) / 1000);
+
+        xSemaphoreTake(job_lock, portMAX_DELAY);
+        session_stats.sessions++;
+        session_stats.labels += session_labels;
+        session_stats.last_labels = session_labels;
+        session_stats.last_ms = ms;
+        session_stats.labels_per_minute = ms ? (uint32_t)(session_labels * 60000ULL / ms) : 0;
+        xSemaphoreGive(job_lock);
+
+        ESP_LOGI(TAG, "Session of %u labels took %" PRIu32 " ms", session_labels, ms);
+    }
+    session_open = false;
+    session_labels = 0;
+}
+
+esp_err_t print_queue_init(void)
+{
+    if (job_lock) {
+        return ESP_OK;
+    }
+
+    job_lock = xSemaphoreCreateMutex();
+    if (!job_lock) {
+        ESP_LOGE(TAG, "Failed to create print queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(job_slots, 0, sizeof(job_slots));
+    ESP_LOGI(TAG, "Print queue ready (%d jobs)", PRINT_QUEUE_LENGTH);
+    return ESP_OK;
+}
+
+// Copy a job's label descriptions and texts into one block. A text job
+// becomes a single description. Returns ESP_ERR_INVALID_ARG for a bad
+// request and ESP_ERR_NO_MEM when the block cannot be allocated.
+static esp_err_t copy_entries(const print_job_request_t *request, print_label_entry_t **out,
+                              size_t *count, size_t *bytes)
+{
+    print_label_entry_t single = {request->text, request->copies, PRINT_CUT_NONE};
+    const print_label_entry_t *entries = request->entries ? request->entries : &single;
+    size_t n = request->entries ? request->entry_count : 1;
+    if (n == 0 || n > PRINT_BATCH_MAX_LABELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t text_bytes = 0;
+    uint32_t copies = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!entries[i].text || entries[i].copies == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        text_bytes += strlen(entries[i].text) + 1;
+        copies += entries[i].copies;
+    }
+    if (copies != request->copies || text_bytes > PRINT_JOB_TEXT_MAX + 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    print_label_entry_t *copy = (print_label_entry_t *)malloc(n * sizeof(*copy) + text_bytes);
+    if (!copy) {
+        return ESP_ERR_NO_MEM;
+    }
+    char *text = (char *)(copy + n);
+    for (size_t i = 0; i < n; i++) {
+        copy[i] = entries[i];
+        copy[i].text = text;
+        strcpy(text, entries[i].text);
+        text += strlen(text) + 1;
+    }
+    *out = copy;
+    *count = n;
+    *bytes = text_bytes;
+    return ESP_OK;
+}
+
+// The description a label belongs to, and whether the tape is cut after it
+static const print_label_entry_t* label_entry(const print_job_slot_t *slot, uint16_t label, bool *cut)
+{
+    for (uint8_t i = 0; i < slot->info.entries; i++) {
+        const print_label_entry_t *entry = &slot->entries[i];
+        if (label < entry->copies) {
+            *cut = entry->cut == PRINT_CUT_EACH || (entry->cut == PRINT_CUT_END && label == entry->copies - 1);
+            return entry;
+        }
+        label -= entry->copies;
+    }
+    return NULL;
+}
+
+static esp_err_t submit_job(const print_job_request_t *request, uint32_t spool_ref,
+                            uint32_t *job_id, size_t *position)
+{
+    if (!job_lock || !request || (!request->text && !request->entries) || !job_id) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (request->copies == 0 || request->copies > PRINT_JOB_MAX_COPIES ||
+        request->labels_done >= request->copies || request->priority >= PRINT_PRIORITY_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    print_label_entry_t *copy = NULL;
+    size_t entry_count = 0;
+    size_t bytes = 0;
+    esp_err_t err = copy_entries(request, &copy, &entry_count, &bytes);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    bool room = pending_jobs < PRINT_QUEUE_LENGTH && queued_bytes + bytes <= PRINT_QUEUE_MAX_BYTES;
+    print_job_slot_t *slot = room ? alloc_slot() : NULL;
+    if (!slot) {
+        xSemaphoreGive(job_lock);
+        free(copy);
+        return ESP_ERR_NO_MEM;
+    }
+
+    free(slot->entries);
+    memset(slot, 0, sizeof(*slot));
+    slot->in_use = true;
+    slot->entries = copy;
+    slot->bytes = bytes;
+    slot->info.entries = (uint8_t)entry_count;
+    for (size_t i = 0; i < entry_count; i++) {
+        slot->entry_copies[i] = copy[i].copies;
+    }
+    slot->client = request->client;
+    slot->spool_ref = spool_ref;
+    slot->info.id = next_job_id++;
+    slot->info.state = PRINT_JOB_QUEUED;
+    slot->info.priority = request->priority;
+    slot->info.labels = request->copies;
+    slot->info.labels_done = request->labels_done;
+    slot->info.queued_at = esp_timer_get_time();
+
+    uint32_t id = slot->info.id;
+
+    // Posted under the lock so the printer task sees jobs in id order
+    if (!printer_task_post(PRINTER_CMD_PRINT_JOB, id)) {
+        slot->in_use = false;
+        slot->entries = NULL;
+        slot->bytes = 0;
+        xSemaphoreGive(job_lock);
+        free(copy);
+        return ESP_ERR_NO_MEM;
+    }
+    pending_jobs++;
+    pending_labels += request->copies - request->labels_done;
+    queued_bytes += bytes;
+    xSemaphoreGive(job_lock);
+
+    *job_id = id;
+    if (position) {
+        *position = print_queue_position(id);
+    }
+    publish_job(id);
+    return ESP_OK;
+}
+
+void print_queue_schedule(uint32_t id)
+{
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *slot = find_slot(id);
+    bool queued = slot && slot->info.state == PRINT_JOB_QUEUED;
+    print_priority_t priority = queued ? slot->info.priority : PRINT_PRIORITY_NORMAL;
+    uint32_t client = queued ? slot->client : 0;
+    uint16_t labels = queued ? slot->info.labels : 0;
+    uint16_t labels_done = queued ? slot->info.labels_done : 0;
+    xSemaphoreGive(job_lock);
+
+    if (queued) {
+        scheduler.add(id, priority, client, labels, labels_done);
+        last_arrival = esp_timer_get_time();
+    }
+}
+
+esp_err_t print_queue_submit(const print_job_request_t *request, uint32_t *job_id, size_t *position)
+{
+    if (!request || (!request->text && !request->entries)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Persist before accepting; without a spool the job still runs from RAM,
+    // but a job the spool cannot hold is refused rather than accepted
+    // without a durable copy
+    uint32_t spool_ref = JOB_SPOOL_NONE;
+    esp_err_t err = job_spool_append(request, &spool_ref);
+    if (err == ESP_ERR_INVALID_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "Job not spooled (%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    err = submit_job(request, spool_ref, job_id, position);
+    if (err != ESP_OK) {
+        job_spool_complete(spool_ref);
+    }
+    return err;
+}
+
+// Room for another job, judged before its record is read back
+static bool queue_has_room(void)
+{
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    bool room = pending_jobs < PRINT_QUEUE_LENGTH && queued_bytes < PRINT_QUEUE_MAX_BYTES;
+    xSemaphoreGive(job_lock);
+    return room;
+}
+
+void print_queue_drain_spool(void)
+{
+    // Printer task only, so one buffer is enough
+    static char text[JOB_SPOOL_PAYLOAD_MAX + 1];
+    static print_label_entry_t entries[PRINT_BATCH_MAX_LABELS];
+
+    while (job_lock && queue_has_room()) {
+        print_job_request_t request;
+        uint32_t spool_ref;
+        if (!job_spool_next_recovered(&request, text, sizeof(text), entries, &spool_ref)) {
+            return;
+        }
+
+        uint32_t id;
+        esp_err_t err = submit_job(&request, spool_ref, &id, NULL);
+        if (err == ESP_ERR_INVALID_ARG) {
+            // The record can never be queued; do not replay it again
+            ESP_LOGE(TAG, "Dropping invalid spooled job");
+            job_spool_take_recovered(spool_ref);
+            job_spool_complete(spool_ref);
+            continue;
+        }
+        if (err != ESP_OK) {
+            // Queue full or out of memory for now; the record stays
+            // first in line for the next pass
+            ESP_LOGD(TAG, "Spooled job waits for room (%s)", esp_err_to_name(err));
+            return;
+        }
+        job_spool_take_recovered(spool_ref);
+        ESP_LOGI(TAG, "Recovered spooled job as job %" PRIu32, id);
+    }
+}
+
+void print_queue_resume_paused(void)
+{
+    struct {
+        uint32_t id;
+        print_priority_t priority;
+        uint32_t client;
+        uint16_t labels;
+        uint16_t labels_done;
+    } resumed[PRINT_JOB_SLOTS];
+    size_t count = 0;
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINT_JOB_SLOTS; i++) {
+        print_job_slot_t *slot = &job_slots[i];
+        if (!slot->in_use || slot->info.state != PRINT_JOB_PAUSED) {
+            continue;
+        }
+        slot->info.state = PRINT_JOB_QUEUED;
+        slot->info.resumes++;
+        slot->info.error[0] = '\0';
+        pending_jobs++;
+        resumed[count++] = {slot->info.id, slot->info.priority, slot->client,
+                            slot->info.labels, slot->info.labels_done};
+    }
+    xSemaphoreGive(job_lock);
+
+    for (size_t i = 0; i < count; i++) {
+        ESP_LOGI(TAG, "Resuming job %" PRIu32 " at label %u/%u", resumed[i].id,
+                 resumed[i].labels_done + 1, resumed[i].labels);
+        scheduler.add(resumed[i].id, resumed[i].priority, resumed[i].client,
+                      resumed[i].labels, resumed[i].labels_done);
+        last_arrival = esp_timer_get_time();
+        publish_job(resumed[i].id);
+    }
+}
+
+bool print_queue_has_work(void)
+{
+    return !scheduler.empty() || session_open;
+}
+
+uint32_t print_queue_hold_ms(void)
+{
+    // Only the label that would eject the tape is worth holding back;
+    // everything before it is chained anyway
+    if (scheduled_labels() != 1) {
+        return 0;
+    }
+
+    int64_t since_arrival_ms = (esp_timer_get_time() - last_arrival) / 1000;
+    if (since_arrival_ms >= PRINT_COALESCE_WINDOW_MS) {
+        return 0;
+    }
+    return (uint32_t)(PRINT_COALESCE_WINDOW_MS - since_arrival_ms);
+}
+
+void print_queue_run_next(PtouchPrinter *printer)
+{
+    uint32_t id;
+    uint16_t label;
+    if (!scheduler.next(&id, &label)) {
+        // A chained label was followed by a job that failed before
+        // printing anything; eject what is on the tape
+        if (session_open && printer && printer->isConnected()) {
+            printer->finalizePrint(false);
+        }
+        confirm_labels(printer, 0, false);
+        end_session();
+        return;
+    }
+
+    // Keep the tape in one chained session while more labels are waiting,
+    // whichever job or class they belong to
+    bool chain = !scheduler.empty();
+
+    // The text stays valid until the job finishes, and only this task
+    // finishes jobs, so it can be used outside the lock
+    const char *text = NULL;
+    bool cut = false;
+    uint16_t labels = 0;
+    bool cancelled = false;
+    int64_t now = esp_timer_get_time();
+
+    // A cancel aimed at an earlier label must not hit this one; the job's
+    // own flag is checked below, after the printer flag is cleared
+    if (printer) {
+        printer->clearCancel();
+    }
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *slot = find_slot(id);
+    if (slot && slot->cancelled && !job_finished(slot)) {
+        cancelled = true;
+    } else if (slot && !job_finished(slot)) {
+        if (slot->info.state == PRINT_JOB_QUEUED) {
+            pending_jobs--;
+        }
+        if (!slot->info.started_at) {
+            slot->info.started_at = now;
+            wait_stats[slot->info.priority].record((uint32_t)((now - slot->info.queued_at) / 1000));
+            metrics_record_stage(METRICS_STAGE_QUEUE_WAIT, now - slot->info.queued_at);
+            job_trace_begin(id, slot->info.queued_at, now);
+        }
+        slot->info.state = PRINT_JOB_RENDERING;
+        const print_label_entry_t *entry = label_entry(slot, label, &cut);
+        text = entry ? entry->text : NULL;
+        labels = slot->info.labels;
+    }
+    xSemaphoreGive(job_lock);
+
+    if (cancelled) {
+        finish_job(id, PRINT_JOB_CANCELLED, "Cancelled");
+        return;
+    }
+    if (!text) {
+        scheduler.remove(id);
+        return;
+    }
+
+    // A batch may ask for the tape to be cut here, ending the session
+    chain = chain && !cut;
+
+    if (!printer || !printer->isConnected()) {
+        confirm_labels(printer, 0);
+        end_session();
+        pause_job(id, "Printer not connected");
+        return;
+    }
+
+    // Render with the same 8x8 font printText() uses
+    int64_t render_start = esp_timer_get_time();
+    PtouchImage image(strlen(text) * 8, 8);
+    image.drawText(0, 0, text);
+    int64_t render_end = esp_timer_get_time();
+    metrics_record_stage(METRICS_STAGE_RENDER, render_end - render_start);
+    job_trace_record(id, JOB_TRACE_RENDER, render_start, render_end, label, 0);
+
+    // A cancel that came in while rendering did not see this job on the
+    // wire, so nothing would have stopped the label
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    cancelled = slot->cancelled;
+    if (!cancelled) {
+        slot->info.state = PRINT_JOB_PRINTING;
+        printing_job = id;
+        if (!slot->info.rendered_at) {
+            slot->info.rendered_at = esp_timer_get_time();
+        }
+    }
+    xSemaphoreGive(job_lock);
+    if (cancelled) {
+        finish_job(id, PRINT_JOB_CANCELLED, "Cancelled");
+        return;
+    }
+    publish_job(id);
+
+    ESP_LOGI(TAG, "Printing job %" PRIu32 " label %u/%u%s", id, label + 1, labels,
+             chain ? " (chained)" : "");
+
+    if (!session_open) {
+        session_started_at = esp_timer_get_time();
+        session_labels = 0;
+    }
+
+    ptouch_usb_stats_t usb_before = printer->getUsbStats();
+    int64_t print_start = esp_timer_get_time();
+    job_trace_set_label(id, label);
+    bool printed = printer->printBitmap(image.getData(), image.getWidth(), image.getHeight(), chain);
+    job_trace_set_label(0, 0);
+    int64_t sent_at = esp_timer_get_time();
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    printing_job = 0;
+    slot->all_sent = printed && label + 1 >= labels;
+    xSemaphoreGive(job_lock);
+
+    if (printed) {
+        session_labels++;
+    }
+    session_open = printed && chain;
+    if (!session_open) {
+        end_session();
+    }
+    if (!printed) {
+        // Labels sent before this one may still come out; settle them
+        // before deciding where this job resumes
+        bool cancelled_print = printer->isCancelRequested();
+        confirm_labels(printer, 0);
+
+        // The printer was resynchronised if the label was cancelled
+        if (cancelled_print) {
+            finish_job(id, PRINT_JOB_CANCELLED, "Cancelled");
+        } else {
+            pause_job(id, printer->hasError() ? printer->getErrorDescription() : "Print job failed");
+        }
+        return;
+    }
+
+    metrics_record_label(&usb_before, &printer->getUsbStats(), sent_at - print_start);
+
+    // Print-complete notifications are counted by the printer; this label
+    // is confirmed once the count passes the labels still outstanding.
+    // Counted from the status printBitmap() read before sending, so that
+    // notifications queued ahead of it are not taken for this label.
+    uint32_t printed_target = 1 + (unconfirmed_count ? unconfirmed[unconfirmed_count - 1].printed_target
+                                                     : printer->getPrintedAtReady());
+
+    uint32_t timeout_ms = PRINT_CONFIRM_TIMEOUT_MS + (uint32_t)image.getWidth() * PRINT_CONFIRM_MS_PER_LINE;
+    int64_t deadline = sent_at + (int64_t)timeout_ms * 1000;
+    unconfirmed[unconfirmed_count++] = {id, printed_target, deadline, print_start, sent_at, label};
+    confirm_labels(printer, 0, false);
+    confirm_labels(printer, PRINT_UNCONFIRMED_MAX - 1);
+}
+
+void print_queue_confirm(PtouchPrinter *printer, bool wait)
+{
+    confirm_labels(printer, 0, wait);
+}
+
+bool print_queue_unconfirmed(void)
+{
+    return unconfirmed_count > 0;
+}
+
+void print_queue_settle(PtouchPrinter *printer, uint32_t target, uint32_t timeout_ms)
+{
+    if (printer->isConnected() && printer->waitForPrinted(target, timeout_ms) == PTOUCH_WAIT_TIMEOUT) {
+        ESP_LOGW(TAG, "Print outside the queue not confirmed, expecting its status later");
+    }
+    printer->expectPrinted(target);
+}
+
+esp_err_t print_queue_cancel(uint32_t id)
+{
+    if (!job_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = ESP_OK;
+    bool running = false;
+    uint32_t spool_ref = JOB_SPOOL_NONE;
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *slot = find_slot(id);
+    if (!slot) {
+        err = ESP_ERR_NOT_FOUND;
+    } else if (job_finished(slot) || slot->all_sent) {
+        // Nothing is left to stop once the last label is on its way
+        err = ESP_ERR_INVALID_STATE;
+    } else if (slot->info.state == PRINT_JOB_QUEUED || slot->info.state == PRINT_JOB_PAUSED) {
+        // The printer task drops its scheduler entry when it comes up
+        spool_ref = finish_slot(slot, PRINT_JOB_CANCELLED, "Cancelled");
+    } else {
+        // Between its labels a job may be waiting behind another job's
+        // label; only abort the raster stream if it is this job's
+        slot->cancelled = true;
+        running = (printing_job == id);
+    }
+    xSemaphoreGive(job_lock);
+
+    job_spool_complete(spool_ref);
+    if (running) {
+        printer_task_cancel_print();
+    }
+    if (err == ESP_OK) {
+        publish_job(id);
+    }
+    return err;
+}
+
+bool print_queue_get_job(uint32_t id, print_job_info_t *info)
+{
+    if (!job_lock || !info) {
+        return false;
+    }
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *slot = find_slot(id);
+    if (slot) {
+        *info = slot->info;
+    }
+    xSemaphoreGive(job_lock);
+    return slot != NULL;
+}
+
+size_t print_queue_get_entries(uint32_t id, uint16_t *copies, size_t max)
+{
+    size_t count = 0;
+    if (!job_lock) {
+        return 0;
+    }
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *slot = find_slot(id);
+    if (slot) {
+        for (count = 0; count < slot->info.entries && count < max; count++) {
+            copies[count] = slot->entry_copies[count];
+        }
+    }
+    xSemaphoreGive(job_lock);
+    return count;
+}
+
+size_t print_queue_position(uint32_t id)
+{
+    size_t ahead = 0;
+    if (!job_lock) {
+        return 0;
+    }
+
+    // Queued jobs of a higher class, or of the same class submitted earlier
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    print_job_slot_t *job = find_slot(id);
+    if (job) {
+        for (int i = 0; i < PRINT_JOB_SLOTS; i++) {
+            const print_job_slot_t *slot = &job_slots[i];
+            if (!slot->in_use || slot == job || slot->info.state != PRINT_JOB_QUEUED) {
+                continue;
+            }
+            if (slot->info.priority < job->info.priority ||
+                (slot->info.priority == job->info.priority && slot->info.id < id)) {
+                ahead++;
+            }
+        }
+    }
+    xSemaphoreGive(job_lock);
+    return ahead;
+}
+
+size_t print_queue_pending(void)
+{
+    return pending_jobs;
+}
+
+void print_queue_get_class_stats(print_priority_t priority, print_class_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!job_lock || priority >= PRINT_PRIORITY_COUNT) {
+        return;
+    }
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINT_JOB_SLOTS; i++) {
+        const print_job_slot_t *slot = &job_slots[i];
+        if (slot->in_use && slot->info.state == PRINT_JOB_QUEUED && slot->info.priority == priority) {
+            stats->pending_jobs++;
+        }
+    }
+    const WaitStats &waits = wait_stats[priority];
+    stats->wait_p50_ms = waits.percentile(50);
+    stats->wait_p90_ms = waits.percentile(90);
+    stats->wait_p99_ms = waits.percentile(99);
+    stats->samples = waits.samples();
+    xSemaphoreGive(job_lock);
+}
+
+void print_queue_get_session_stats(print_session_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!job_lock) {
+        return;
+    }
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    *stats = session_stats;
+    xSemaphoreGive(job_lock);
+}
+
+void print_queue_get_load(print_queue_load_t *load)
+{
+    memset(load, 0, sizeof(*load));
+    load->label_ms = PRINT_DEFAULT_LABEL_MS;
+    if (!job_lock) {
+        return;
+    }
+
+    xSemaphoreTake(job_lock, portMAX_DELAY);
+    load->pending_jobs = pending_jobs;
+    load->pending_labels = pending_labels;
+    load->bytes = queued_bytes;
+    if (label_ms) {
+        load->label_ms = label_ms;
+    }
+    xSemaphoreGive(job_lock);
+}
+
+const char* print_job_state_name(print_job_state_t state)
+{
+    switch (state) {
+        case PRINT_JOB_QUEUED:    return "queued";
+        case PRINT_JOB_RENDERING: return "rendering";
+        case PRINT_JOB_PRINTING:  return "printing";
+        case PRINT_JOB_PAUSED:    return "paused";
+        case PRINT_JOB_DONE:      return "done";
+        case PRINT_JOB_FAILED:    return "failed";
+        case PRINT_JOB_CANCELLED: return "cancelled";
+        default:                  return "unknown";
+    }
+}
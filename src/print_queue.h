@@ -0,0 +1,173 @@
+/*
+ * P-touch ESP32 Print Job Queue
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PRINT_QUEUE_H
+#define PRINT_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "ptouch_esp32.h"
+#include "job_scheduler.h"
+#include "print_batch.h"
+
+// Queue configuration
+#define PRINT_QUEUE_LENGTH      8    // Jobs waiting for the printer
+#define PRINT_JOB_HISTORY       16   // Finished jobs kept for /api/jobs/{id}
+#define PRINT_JOB_ERROR_LEN     48
+#define PRINT_JOB_TEXT_MAX      1023 // Label text length
+#define PRINT_JOB_MAX_COPIES    500  // Labels per job
+#define PRINT_BULK_COPIES       10   // Jobs above this default to the bulk class
+#define PRINT_COALESCE_WINDOW_MS 150 // Hold a session's last label this long for jobs to chain onto
+#define PRINT_QUEUE_MAX_BYTES   4096 // Label text held by queued and running jobs
+#define PRINT_DEFAULT_LABEL_MS  3000 // Per-label estimate until one has been measured
+#define PRINT_CONFIRM_TIMEOUT_MS 10000 // Wait for a label's print-complete status...
+#define PRINT_CONFIRM_MS_PER_LINE 10   // ...plus this per raster line, for long labels
+#define PRINT_CONFIRM_POLL_MS   50     // Idle status poll while labels are unconfirmed
+#define PRINT_JOB_MAX_RESUMES   3    // Pauses a job may recover from before it fails
+
+// Job lifecycle
+typedef enum {
+    PRINT_JOB_QUEUED = 0,
+    PRINT_JOB_RENDERING,
+    PRINT_JOB_PRINTING,
+    PRINT_JOB_PAUSED,                   // Printer error; resumes at the first unconfirmed label
+    PRINT_JOB_DONE,
+    PRINT_JOB_FAILED,
+    PRINT_JOB_CANCELLED
+} print_job_state_t;
+
+// What a client asked for: one text, or a batch of label descriptions
+typedef struct {
+    const char *text;
+    uint16_t copies;                    // Labels, printed as one chained session; for a batch the sum of its copies
+    print_priority_t priority;
+    uint32_t client;                    // Peer address, used for fair queuing
+    uint16_t labels_done;               // Already printed; non-zero for recovered jobs
+    const print_label_entry_t *entries; // Batch jobs only; text is then unused
+    uint8_t entry_count;
+} print_job_request_t;
+
+// Snapshot of a job, copied out of the job table
+typedef struct {
+    uint32_t id;
+    print_job_state_t state;
+    print_priority_t priority;
+    uint16_t labels;
+    uint16_t labels_done;               // Confirmed by the printer's print-complete status
+    uint8_t resumes;                    // Times the job came back from PAUSED
+    uint8_t entries;                    // Label descriptions; 1 for a text job
+    int64_t queued_at;                  // esp_timer_get_time() when accepted
+    int64_t started_at;                 // First label picked up by the printer task
+    int64_t rendered_at;                // Bitmap ready, printing starts
+    int64_t finished_at;                // Done or failed
+    char error[PRINT_JOB_ERROR_LEN];    // Failure reason, empty on success
+} print_job_info_t;
+
+// Queue wait statistics for one priority class
+typedef struct {
+    size_t pending_jobs;
+    uint32_t wait_p50_ms;
+    uint32_t wait_p90_ms;
+    uint32_t wait_p99_ms;
+    size_t samples;
+} print_class_stats_t;
+
+// Chained printer sessions: one precut, labels joined with chain, one eject
+typedef struct {
+    uint32_t sessions;                  // Sessions completed since boot
+    uint32_t labels;                    // Labels printed in those sessions
+    uint16_t last_labels;               // Labels in the most recent session
+    uint32_t last_ms;                   // Duration of the most recent session
+    uint32_t labels_per_minute;         // Throughput of the most recent session
+} print_session_stats_t;
+
+// Work the printer has not finished yet, for admission control
+typedef struct {
+    size_t pending_jobs;
+    size_t pending_labels;              // Labels of queued and running jobs not printed yet
+    size_t bytes;                       // Job data held in RAM
+    uint32_t label_ms;                  // Moving average of the printer time per confirmed label
+} print_queue_load_t;
+
+// Create the job table; jobs are executed by the printer task
+esp_err_t print_queue_init(void);
+
+// Queue a label job. Returns ESP_ERR_NO_MEM when the queue or the spool is
+// full or the queue would hold more than PRINT_QUEUE_MAX_BYTES, ESP_FAIL
+// when the spool cannot write the job. Without a spool jobs run from RAM.
+esp_err_t print_queue_submit(const print_job_request_t *request, uint32_t *job_id, size_t *position);
+
+// Printer task side: hand a submitted job to the scheduler, then print
+// one label at a time so higher priority work can cut in between labels
+void print_queue_schedule(uint32_t id);
+bool print_queue_has_work(void);
+void print_queue_run_next(PtouchPrinter *printer);
+
+// Printer task side: count the print-complete status of labels already
+// sent. Without wait only what has arrived is taken and nothing blocks;
+// with wait every label is settled, as before a command that prints
+// outside the queue. print_queue_unconfirmed() says whether to poll.
+void print_queue_confirm(PtouchPrinter *printer, bool wait);
+bool print_queue_unconfirmed(void);
+
+// Printer task side: wait up to timeout_ms for the print-complete status
+// of pages printed outside the queue, until the printer's count reaches
+// target. Whatever has not come by then is expected, so that it is not
+// taken for a queued label when it arrives.
+void print_queue_settle(PtouchPrinter *printer, uint32_t target, uint32_t timeout_ms);
+
+// Move jobs recovered from the spool back into the queue while it has room
+void print_queue_drain_spool(void);
+
+// Printer task side: reschedule paused jobs once the printer reports no
+// error. Each continues at its first label not confirmed as printed.
+void print_queue_resume_paused(void);
+
+// Milliseconds to wait before printing the next label. Non-zero only when
+// that label would close the session and a job arrived inside the window.
+uint32_t print_queue_hold_ms(void);
+
+// Cancel a job. A queued or paused job is dropped at once; a running one stops at the
+// next raster line and the printer is resynchronised. Returns
+// ESP_ERR_NOT_FOUND for unknown jobs and ESP_ERR_INVALID_STATE for
+// finished ones and ones whose last label has already been sent.
+esp_err_t print_queue_cancel(uint32_t id);
+
+// Look up a queued, running or recently finished job
+bool print_queue_get_job(uint32_t id, print_job_info_t *info);
+
+// Copies of each of a job's label descriptions, in order. Returns the
+// number of descriptions, 0 for unknown jobs. With labels_done this tells
+// how far each description got.
+size_t print_queue_get_entries(uint32_t id, uint16_t *copies, size_t max);
+
+// Number of queued jobs that will start before the given job
+size_t print_queue_position(uint32_t id);
+
+// Number of jobs waiting for the printer
+size_t print_queue_pending(void);
+
+void print_queue_get_class_stats(print_priority_t priority, print_class_stats_t *stats);
+void print_queue_get_session_stats(print_session_stats_t *stats);
+void print_queue_get_load(print_queue_load_t *load);
+
+const char* print_job_state_name(print_job_state_t state);
+
+#endif // PRINT_QUEUE_H
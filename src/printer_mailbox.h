@@ -0,0 +1,96 @@
+/*
+ * P-touch ESP32 Printer Command Mailbox
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PRINTER_MAILBOX_H
+#define PRINTER_MAILBOX_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded multi-producer / single-consumer ring. Any task may push; only the
+// printer owner task pops. Each cell carries a sequence number so producers
+// claim slots with a single CAS and never take a lock.
+template <typename T, size_t N>
+class PrinterMailbox {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "Mailbox size must be a power of two");
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    Cell cells[N];
+    std::atomic<size_t> enqueue_pos;
+    std::atomic<size_t> dequeue_pos;
+
+public:
+    PrinterMailbox() : enqueue_pos(0), dequeue_pos(0) {
+        for (size_t i = 0; i < N; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false when the mailbox is full
+    bool push(const T &item) {
+        Cell *cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & (N - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; must only be called from the owner task
+    bool pop(T &item) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell *cell = &cells[pos & (N - 1)];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+            return false;
+        }
+        item = cell->data;
+        cell->sequence.store(pos + N, std::memory_order_release);
+        dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool empty() const {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        size_t seq = cells[pos & (N - 1)].sequence.load(std::memory_order_acquire);
+        return (intptr_t)seq - (intptr_t)(pos + 1) < 0;
+    }
+
+    static constexpr size_t capacity() { return N; }
+};
+
+#endif // PRINTER_MAILBOX_H
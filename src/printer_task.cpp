@@ -0,0 +1,373 @@
+/*
+ * P-touch ESP32 Printer Owner Task
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "printer_task.h"
+#include <string.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "ptouch_esp32.h"
+#include "printer_mailbox.h"
+#include "print_queue.h"
+#include "event_stream.h"
+#include "seqlock.h"
+#include "raster_stream.h"
+#include "metrics.h"
+#include "job_trace.h"
+
+static const char *TAG = "printer-task";
+
+const bool PRINTER_VERBOSE = true;
+
+// Owned by the printer task; never dereferenced anywhere else
+static PtouchPrinter *printer = nullptr;
+static bool usb_ready = false;
+
+static PrinterMailbox<printer_cmd_t, PRINTER_MAILBOX_SIZE> mailbox;
+static TaskHandle_t printer_task_handle = NULL;
+static std::atomic<bool> status_requested(false);
+
+// Idle as of the pass that had seen idle_posts commands; a command posted
+// since then makes the task busy again
+static std::atomic<uint32_t> posted_count(0);
+static std::atomic<uint32_t> idle_posts(0);
+static std::atomic<bool> task_idle(false);
+
+// What readers get: the state and its JSON, serialised once per change.
+// Published without a lock, so a status request never waits for the
+// printer task and the printer task never waits for a slow client.
+typedef struct {
+    printer_state_t state;
+    size_t json_len;
+    char json[PRINTER_STATE_JSON_MAX];
+} state_snapshot_t;
+
+static SeqLock<state_snapshot_t> published;
+
+// Printer task only
+static printer_state_t last_state = {};
+static bool state_published = false;
+
+static bool same_state(const printer_state_t &a, const printer_state_t &b)
+{
+    // The description strings are static, so comparing pointers is enough
+    return a.connected == b.connected && strcmp(a.name, b.name) == 0 &&
+           strcmp(a.status, b.status) == 0 && a.max_width == b.max_width &&
+           a.tape_width == b.tape_width && a.packbits == b.packbits && a.media_type == b.media_type &&
+           a.tape_color == b.tape_color && a.text_color == b.text_color &&
+           a.has_error == b.has_error && a.error_description == b.error_description;
+}
+
+// Copy what the printer object knows into the shared state
+static void publish_state(const char *status)
+{
+    printer_state_t next = {};
+    next.connected = printer->isConnected();
+    strncpy(next.name, printer->getPrinterName(), sizeof(next.name) - 1);
+    strncpy(next.status, status, sizeof(next.status) - 1);
+    next.max_width = printer->getMaxWidth();
+    next.tape_width = printer->getTapeWidth();
+    next.packbits = printer->usesPackBits();
+    if (next.connected) {
+        next.media_type = printer->getMediaType();
+        next.tape_color = printer->getTapeColor();
+        next.text_color = printer->getTextColor();
+        next.has_error = printer->hasError();
+        next.error_description = printer->getErrorDescription();
+    }
+
+    // The periodic poll republishes an unchanged state; only push changes
+    if (state_published && same_state(last_state, next)) {
+        return;
+    }
+    last_state = next;
+    state_published = true;
+
+    static state_snapshot_t snapshot;
+    snapshot.state = next;
+    JsonWriter out(snapshot.json, sizeof(snapshot.json));
+    printer_state_write_json(&next, out);
+    if (!out.finish()) {
+        ESP_LOGW(TAG, "Status JSON does not fit in %d bytes", PRINTER_STATE_JSON_MAX);
+        strcpy(snapshot.json, "{\"type\":\"printerStatus\",\"connected\":false}");
+    }
+    snapshot.json_len = strlen(snapshot.json);
+
+    published.store(snapshot);
+    event_stream_printer_status(snapshot.json, snapshot.json_len);
+}
+
+// Retry until a copy is not torn by a publish. Readers run at the printer
+// task's priority, so give it a tick to finish rather than spinning.
+template <typename F>
+static void read_snapshot(F &&read)
+{
+    while (!published.tryRead(read)) {
+        vTaskDelay(1);
+    }
+}
+
+static void connect_printer(void)
+{
+    if (!printer->detectPrinter()) {
+        publish_state("Not detected");
+        ESP_LOGI(TAG, "No printer detected");
+        return;
+    }
+
+    if (!printer->connect()) {
+        publish_state("Connection failed");
+        ESP_LOGI(TAG, "Failed to connect to printer");
+        return;
+    }
+
+    publish_state("Connected");
+    ESP_LOGI(TAG, "Printer connected: %s", printer->getPrinterName());
+    ESP_LOGI(TAG, "Max width: %d px, Tape width: %d px", printer->getMaxWidth(), printer->getTapeWidth());
+}
+
+static void init_printer(void)
+{
+    ESP_LOGI(TAG, "Initializing P-touch printer...");
+
+    printer->setVerbose(PRINTER_VERBOSE);
+    printer->setStepHook(job_trace_printer_step, NULL);
+
+    usb_ready = printer->begin();
+    if (!usb_ready) {
+        publish_state("USB Host init failed");
+        ESP_LOGI(TAG, "Failed to initialize USB Host");
+        return;
+    }
+
+    ESP_LOGI(TAG, "USB Host initialized");
+    connect_printer();
+}
+
+// Periodic status check; only ever runs between jobs
+static void poll_status(void)
+{
+    if (!usb_ready) {
+        return;
+    }
+
+    if (!printer->isConnected()) {
+        // Try to reconnect
+        if (printer->detectPrinter() && printer->connect()) {
+            publish_state("Connected");
+            ESP_LOGI(TAG, "Printer reconnected: %s", printer->getPrinterName());
+        }
+        return;
+    }
+
+    int previous_tape_width = printer->getTapeWidth();
+    if (!printer->getStatus()) {
+        // Connection might be lost
+        printer->disconnect();
+        usb_ready = printer->begin();
+        publish_state("Connection lost");
+        ESP_LOGI(TAG, "Printer connection lost");
+        return;
+    }
+
+    if (printer->getTapeWidth() != previous_tape_width) {
+        ESP_LOGI(TAG, "Tape width changed to: %d px", printer->getTapeWidth());
+    }
+    publish_state("Connected");
+
+    // Between jobs and with nothing left to print, an expected notification
+    // that has not come by now never will; do not let it eat a later one
+    if (!printer->isPrinting() && !print_queue_unconfirmed()) {
+        printer->clearExpected();
+    }
+
+    // Jobs paused by a printer error continue once it has been cleared
+    if (!printer->hasError()) {
+        print_queue_resume_paused();
+    }
+}
+
+static void handle_command(const printer_cmd_t &cmd)
+{
+    switch (cmd.type) {
+        case PRINTER_CMD_PRINT_JOB:
+            print_queue_schedule(cmd.arg);
+            break;
+        case PRINTER_CMD_RECONNECT:
+            ESP_LOGI(TAG, "Reconnecting printer...");
+            printer->disconnect();
+            init_printer();
+            break;
+        case PRINTER_CMD_FEED:
+            // Its status would be counted against a queued label
+            print_queue_confirm(printer, true);
+            if (!printer->feedPaper((int)cmd.arg)) {
+                ESP_LOGW(TAG, "Feed failed");
+            }
+            break;
+        case PRINTER_CMD_CUT: {
+            print_queue_confirm(printer, true);
+            // A form feed is a print command and is answered like one
+            uint32_t printed = printer->getPrintedCount();
+            if (printer->cutPaper()) {
+                print_queue_settle(printer, printed + 1, PRINT_CONFIRM_TIMEOUT_MS);
+            } else {
+                ESP_LOGW(TAG, "Cut failed");
+            }
+            break;
+        }
+        case PRINTER_CMD_RASTER: {
+            print_queue_confirm(printer, true);
+            // Upload time depends on the client, so only USB time is kept
+            ptouch_usb_stats_t usb_before = printer->getUsbStats();
+            uint32_t pages = raster_stream_print(printer);
+            metrics_record_label(&usb_before, &printer->getUsbStats(), 0);
+            if (pages > 0) {
+                print_queue_settle(printer, printer->getPrintedAtReady() + pages,
+                                   pages * PRINT_CONFIRM_TIMEOUT_MS);
+            }
+            publish_state(printer->isConnected() ? "Connected" : "Connection lost");
+            break;
+        }
+    }
+}
+
+static void printer_owner_task(void *pvParameters)
+{
+    init_printer();
+
+    TickType_t interval = pdMS_TO_TICKS(PRINTER_STATUS_CHECK_INTERVAL);
+    TickType_t last_poll = xTaskGetTickCount();
+
+    while (1) {
+        metrics_update_usb(&printer->getUsbStats());
+
+        // Jobs that were still in the spool at the last reset
+        print_queue_drain_spool();
+
+        uint32_t posted = posted_count.load();
+        printer_cmd_t cmd;
+        while (mailbox.pop(cmd)) {
+            handle_command(cmd);
+        }
+
+        // One label per pass so new jobs are scheduled between labels
+        if (print_queue_has_work()) {
+            task_idle.store(false);
+            // Give jobs arriving in a burst a chance to join the session
+            // before its last label ejects the tape
+            uint32_t hold_ms = print_queue_hold_ms();
+            if (hold_ms > 0) {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(hold_ms));
+                continue;
+            }
+
+            print_queue_run_next(printer);
+            if (!print_queue_has_work()) {
+                publish_state(printer->isConnected() ? "Connected" : "Connection lost");
+            }
+            continue;
+        }
+
+        // Mailbox drained: this is an idle gap, so a status poll cannot
+        // interleave with a raster stream. The last label sent is
+        // confirmed from here rather than by blocking after it.
+        print_queue_confirm(printer, false);
+        idle_posts.store(posted);
+        task_idle.store(!print_queue_unconfirmed());
+        TickType_t elapsed = xTaskGetTickCount() - last_poll;
+        if (status_requested.exchange(false) || elapsed >= interval) {
+            poll_status();
+            last_poll = xTaskGetTickCount();
+            elapsed = 0;
+        }
+
+        TickType_t wait = interval - elapsed;
+        if (print_queue_unconfirmed() && wait > pdMS_TO_TICKS(PRINT_CONFIRM_POLL_MS)) {
+            wait = pdMS_TO_TICKS(PRINT_CONFIRM_POLL_MS);
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+esp_err_t printer_task_start(void)
+{
+    if (printer_task_handle) {
+        return ESP_OK;
+    }
+
+    printer = new PtouchPrinter();
+    publish_state("Disconnected");
+
+    if (xTaskCreate(printer_owner_task, "printer", 6144, NULL, 5, &printer_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start printer task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+bool printer_task_post(printer_cmd_type_t type, uint32_t arg)
+{
+    printer_cmd_t cmd = {type, arg};
+    if (!mailbox.push(cmd)) {
+        return false;
+    }
+    posted_count.fetch_add(1);
+    if (printer_task_handle) {
+        xTaskNotifyGive(printer_task_handle);
+    }
+    return true;
+}
+
+bool printer_task_idle(void)
+{
+    return task_idle.load() && idle_posts.load() == posted_count.load();
+}
+
+void printer_task_cancel_print(void)
+{
+    if (printer) {
+        printer->requestCancel();
+    }
+}
+
+void printer_task_request_status(void)
+{
+    status_requested.store(true);
+    if (printer_task_handle) {
+        xTaskNotifyGive(printer_task_handle);
+    }
+}
+
+void printer_task_get_state(printer_state_t *state)
+{
+    read_snapshot([state](const state_snapshot_t &snapshot) { *state = snapshot.state; });
+}
+
+size_t printer_task_get_state_json(char *buf, size_t len)
+{
+    size_t copied = 0;
+    read_snapshot([&](const state_snapshot_t &snapshot) {
+        // A torn copy may carry any length; keep it inside the buffer
+        copied = snapshot.json_len < len ? snapshot.json_len : len - 1;
+        memcpy(buf, snapshot.json, copied);
+    });
+    buf[copied] = '\0';
+    return copied;
+}
@@ -0,0 +1,87 @@
+/*
+ * P-touch ESP32 Printer Owner Task
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PRINTER_TASK_H
+#define PRINTER_TASK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// The printer task is the only code that touches PtouchPrinter. Everything
+// else talks to it through the command mailbox below.
+#define PRINTER_MAILBOX_SIZE            16
+#define PRINTER_STATUS_CHECK_INTERVAL   5000  // milliseconds
+#define PRINTER_STATE_JSON_MAX          512   // Serialised state, as sent by GET /api/status
+#define PRINTER_FEED_MAX                32    // Line feeds per feed command; each is a blocking USB send
+
+// Commands accepted by the printer task
+typedef enum {
+    PRINTER_CMD_PRINT_JOB = 0,  // arg: job id from print_queue
+    PRINTER_CMD_RECONNECT,
+    PRINTER_CMD_FEED,           // arg: feed amount, 1 to PRINTER_FEED_MAX
+    PRINTER_CMD_CUT,
+    PRINTER_CMD_RASTER          // Print the open raster upload (raster_stream.h)
+} printer_cmd_type_t;
+
+typedef struct {
+    printer_cmd_type_t type;
+    uint32_t arg;
+} printer_cmd_t;
+
+// Last known printer state, published by the printer task
+typedef struct {
+    bool connected;
+    char name[64];
+    char status[64];
+    int max_width;
+    int tape_width;
+    bool packbits;              // Raster lines are PackBits compressed
+    const char *media_type;
+    const char *tape_color;
+    const char *text_color;
+    bool has_error;
+    const char *error_description;
+} printer_state_t;
+
+// Create the printer and start the owner task
+esp_err_t printer_task_start(void);
+
+// Post a command; returns false when the mailbox is full
+bool printer_task_post(printer_cmd_type_t type, uint32_t arg);
+
+// True while the task has no command, job or unconfirmed label to deal
+// with, so a command posted now is served at once. Safe from any task.
+bool printer_task_idle(void);
+
+// Abort the label being sent. Safe from any task: it only sets the
+// printer's cancel flag, which the raster loop checks between lines.
+void printer_task_cancel_print(void);
+
+// Ask for a status poll. Requests are merged and served between jobs.
+void printer_task_request_status(void);
+
+// Copy of the last published state. Lock-free; safe from any task.
+void printer_task_get_state(printer_state_t *state);
+
+// The same state as JSON, serialised when it was published. Returns the
+// length copied into buf, which is always terminated.
+size_t printer_task_get_state_json(char *buf, size_t len);
+
+#endif // PRINTER_TASK_H
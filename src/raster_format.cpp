@@ -0,0 +1,216 @@
+/*
+ * P-touch ESP32 Raster Upload Formats
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "raster_format.h"
+#include <string.h>
+
+bool raster_orientation_from_name(const char *name, raster_orientation_t *orientation)
+{
+    if (!name) {
+        return false;
+    }
+    if (strcmp(name, "portrait") == 0) {
+        *orientation = RASTER_ORIENTATION_PORTRAIT;
+        return true;
+    }
+    if (strcmp(name, "landscape") == 0) {
+        *orientation = RASTER_ORIENTATION_LANDSCAPE;
+        return true;
+    }
+    return false;
+}
+
+// Pre-encoded uploads hold raster lines only
+static const ptouch_command_def_t raster_line_commands[] = {
+    {{RASTER_CMD_LINE}, 1, 2, PTOUCH_LENGTH_LE16, PTOUCH_CMD_RASTER_LINE, "Raster line"},
+    {{RASTER_CMD_ZERO}, 1, 0, PTOUCH_LENGTH_NONE, PTOUCH_CMD_ZERO_LINE, "Empty raster line"},
+};
+
+RasterStreamValidator::RasterStreamValidator(size_t line_bytes, bool packbits, uint32_t max_lines)
+    : line_bytes(line_bytes), packbits(packbits), max_lines(max_lines),
+      state(RAW_DATA), remaining(0), literal(0), decoded(0),
+      line_count(0), failed(false), failure(NULL)
+{
+    ptouch_parser_init(&parser, raster_line_commands,
+                       sizeof(raster_line_commands) / sizeof(raster_line_commands[0]));
+}
+
+bool RasterStreamValidator::fail(const char *reason)
+{
+    failed = true;
+    failure = reason;
+    return false;
+}
+
+bool RasterStreamValidator::endLine()
+{
+    if (++line_count > max_lines) {
+        return fail("More raster lines than announced");
+    }
+    return true;
+}
+
+bool RasterStreamValidator::beginLine(size_t length)
+{
+    remaining = length;
+    decoded = 0;
+    if (remaining == 0) {
+        return fail("Empty raster line");
+    }
+    if (!packbits && remaining > line_bytes) {
+        return fail("Raster line wider than the printer");
+    }
+    state = packbits ? RUN_HEADER : RAW_DATA;
+    return true;
+}
+
+// Check a chunk of the current line's data, at most what is left of it
+bool RasterStreamValidator::lineData(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len) {
+        uint8_t byte = data[i];
+
+        switch (state) {
+            case RAW_DATA:
+            case RUN_LITERAL: {
+                size_t want = state == RUN_LITERAL ? literal : remaining;
+                size_t take = len - i < want ? len - i : want;
+                i += take;
+                remaining -= take;
+                if (state == RUN_LITERAL) {
+                    literal -= take;
+                    if (literal == 0) {
+                        state = RUN_HEADER;
+                    }
+                }
+                break;
+            }
+
+            case RUN_HEADER: {
+                i++;
+                remaining--;
+                int8_t control = (int8_t)byte;
+                if (control == -128) {
+                    // No-op per the PackBits definition
+                    break;
+                }
+                size_t produced = control >= 0 ? (size_t)control + 1 : (size_t)(1 - control);
+                size_t needed = control >= 0 ? produced : 1;
+                decoded += produced;
+                if (decoded > line_bytes) {
+                    return fail("Raster line wider than the printer");
+                }
+                if (needed > remaining) {
+                    return fail("PackBits run past the end of its line");
+                }
+                literal = produced;
+                state = control >= 0 ? RUN_LITERAL : RUN_REPEAT;
+                break;
+            }
+
+            case RUN_REPEAT:
+                i++;
+                remaining--;
+                state = RUN_HEADER;
+                break;
+        }
+    }
+    return remaining > 0 || endLine();
+}
+
+bool RasterStreamValidator::feed(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !failed) {
+        size_t used;
+        ptouch_parse_event_t event = ptouch_parser_step(&parser, data + i, len - i, &used);
+        const uint8_t *taken = data + i;
+        i += used;
+
+        switch (event) {
+            case PTOUCH_PARSE_COMMAND:
+                if (parser.def->type == PTOUCH_CMD_ZERO_LINE) {
+                    endLine();
+                } else {
+                    beginLine(parser.length);
+                }
+                break;
+            case PTOUCH_PARSE_DATA:
+                lineData(taken, used);
+                break;
+            case PTOUCH_PARSE_ERROR:
+                return fail("Unexpected command in raster data");
+            case PTOUCH_PARSE_MORE:
+                break;
+        }
+    }
+    return !failed;
+}
+
+RasterJobScanner::RasterJobScanner()
+{
+    reset();
+}
+
+void RasterJobScanner::reset()
+{
+    ptouch_parser_init(&parser, NULL, 0);
+    page_count = 0;
+    ended = false;
+    failure = NULL;
+}
+
+size_t RasterJobScanner::scan(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !ended && !failure) {
+        size_t used;
+        ptouch_parse_event_t event = ptouch_parser_step(&parser, data + i, len - i, &used);
+        i += used;
+
+        if (event == PTOUCH_PARSE_ERROR) {
+            failure = "Unknown command in printer stream";
+        } else if (event == PTOUCH_PARSE_COMMAND) {
+            if (parser.def->type == PTOUCH_CMD_PRINT) {
+                page_count++;
+            } else if (parser.def->type == PTOUCH_CMD_FINALIZE) {
+                page_count++;
+                ended = true;
+            }
+        }
+    }
+    return i;
+}
+
+void raster_rotate_line(const uint8_t *bitmap, int width, int height, int x, uint8_t *line)
+{
+    int stride = (width + 7) / 8;
+    int line_bytes = (height + 7) / 8;
+    memset(line, 0, line_bytes);
+
+    const uint8_t *column = bitmap + x / 8;
+    uint8_t mask = 0x80 >> (x % 8);
+    for (int y = 0; y < height; y++) {
+        if (column[y * stride] & mask) {
+            int pixel = height - 1 - y;
+            line[pixel / 8] |= 0x80 >> (pixel % 8);
+        }
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * P-touch ESP32 Raster Upload Formats
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RASTER_FORMAT_H
+#define RASTER_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ptouch_protocol.h"
+
+// Brother raster line commands accepted in pre-encoded uploads
+#define RASTER_CMD_LINE         0x47    // 'G' n1 n2 data: n1 + 256 * n2 bytes follow
+#define RASTER_CMD_ZERO         0x5A    // 'Z': an empty line
+
+// The rest of a complete printer job, as sent by the Brother drivers
+#define RASTER_CMD_INVALIDATE   0x00    // Padding that resynchronises the printer
+#define RASTER_CMD_ESC          0x1B    // ESC '@' initialise, ESC 'i' settings
+#define RASTER_CMD_COMPRESSION  0x4D    // 'M' mode
+#define RASTER_CMD_LINE_LEGACY  0x67    // 'g' 0 n data, on printers without PackBits
+#define RASTER_CMD_PRINT        0x0C    // Print the page, more pages follow
+#define RASTER_CMD_PRINT_FEED   0x1A    // Print the last page and eject: the job ends
+
+// How an uploaded 1bpp bitmap lies on the tape
+typedef enum {
+    RASTER_ORIENTATION_PORTRAIT = 0,    // Each row is one raster line; width runs across the tape
+    RASTER_ORIENTATION_LANDSCAPE        // Width runs along the tape, as text is printed
+} raster_orientation_t;
+
+bool raster_orientation_from_name(const char *name, raster_orientation_t *orientation);
+
+// Checks a stream of pre-encoded raster line commands as it arrives,
+// without buffering any of it. Lines must decode to at most line_bytes,
+// and PackBits runs must end exactly at the end of their line.
+class RasterStreamValidator {
+public:
+    RasterStreamValidator(size_t line_bytes, bool packbits, uint32_t max_lines);
+
+    // False at the first malformed byte; error() says why. Once failed,
+    // every later call fails too.
+    bool feed(const uint8_t *data, size_t len);
+
+    // The stream so far ends on a command boundary
+    bool complete() const { return ptouch_parser_idle(&parser) && !failed; }
+
+    uint32_t lines() const { return line_count; }
+    const char* error() const { return failure; }
+
+private:
+    // Where the line data of the current raster line is
+    enum State {
+        RAW_DATA,                       // Uncompressed line bytes
+        RUN_HEADER,                     // PackBits control byte
+        RUN_LITERAL,                    // Bytes copied as they are
+        RUN_REPEAT                      // The byte a run repeats
+    };
+
+    size_t line_bytes;
+    bool packbits;
+    uint32_t max_lines;
+    ptouch_parser_t parser;             // Knows only 'G' and 'Z'
+    State state;
+    size_t remaining;                   // Encoded bytes left in the current line
+    size_t literal;                     // Bytes left in the current literal run
+    size_t decoded;                     // Line bytes produced so far
+    uint32_t line_count;
+    bool failed;
+    const char *failure;
+
+    bool fail(const char *reason);
+    bool beginLine(size_t length);
+    bool lineData(const uint8_t *data, size_t len);
+    bool endLine();
+};
+
+// Finds job boundaries in a raw printer stream, as CUPS and the Brother
+// drivers send it to port 9100. Commands are split by the protocol parser,
+// so a 0x1A inside raster data is not taken for the end of the job.
+class RasterJobScanner {
+public:
+    RasterJobScanner();
+
+    // Bytes of data that belong to the current job: all of len, or up to
+    // and including the command that ends it, after which jobEnded() is
+    // true until reset(). An unknown command sets failed(); the stream
+    // cannot be split any further.
+    size_t scan(const uint8_t *data, size_t len);
+
+    bool jobEnded() const { return ended; }
+    bool failed() const { return failure != NULL; }
+    const char* error() const { return failure; }
+    uint32_t pages() const { return page_count; }
+
+    // Start on the next job
+    void reset();
+
+private:
+    ptouch_parser_t parser;
+    uint32_t page_count;
+    bool ended;
+    const char *failure;
+};
+
+// Raster line x of a landscape bitmap: column x, bottom row first, so the
+// image's top edge lands at the end of the line. line must hold
+// (height + 7) / 8 bytes.
+void raster_rotate_line(const uint8_t *bitmap, int width, int height, int x, uint8_t *line);
+
+#endif // RASTER_FORMAT_H
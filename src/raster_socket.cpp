@@ -0,0 +1,357 @@
+/*
+ * P-touch ESP32 Raster WebSocket
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "raster_socket.h"
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include "esp_log.h"
+#include "json_lite.h"
+#include "printer_task.h"
+#include "raster_stream.h"
+
+static const char *TAG = "raster-socket";
+
+// The open upload; only touched from the httpd task. The raster stream
+// takes one upload at a time, so one session is enough.
+typedef struct {
+    int fd;                             // -1 when no upload is open
+    RasterUploadConsumer *upload;
+    uint8_t *frame;                     // Receive buffer, one window of lines
+    size_t line_bytes;
+    uint32_t lines;                     // Announced by the client
+    uint32_t received;
+    uint32_t window;
+    uint32_t granted;                   // Lines the client may have sent in total
+    bool sent;                          // All lines are in; waiting for the printer
+} raster_session_t;
+
+static httpd_handle_t socket_server = NULL;
+static raster_session_t session = { .fd = -1 };
+static uint32_t generation = 0;         // Tells stale credit work from the open session's
+
+// Written by the printer task, read by the httpd task
+static std::atomic<uint32_t> lines_printed(0);
+static std::atomic<bool> printer_done(false);
+static std::atomic<const char *> printer_error(nullptr);
+static std::atomic<bool> credit_queued(false);
+static std::atomic<uint32_t> credit_step(1);
+
+static void send_json(int fd, JsonWriter &out, const char *json)
+{
+    if (!out.finish()) {
+        return;
+    }
+    httpd_ws_frame_t frame = {};
+    frame.final = true;
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.payload = (uint8_t *)json;
+    frame.len = out.length();
+    httpd_ws_send_frame_async(socket_server, fd, &frame);
+}
+
+// {"type": type, key: value}
+static void send_message(int fd, const char *type, const char *key, uint32_t value)
+{
+    char json[RASTER_SOCKET_JSON_MAX];
+    JsonWriter out(json, sizeof(json));
+    out.beginObject();
+    out.string("type", type);
+    out.number(key, value);
+    out.endObject();
+    send_json(fd, out, json);
+}
+
+static void send_error(int fd, const char *error)
+{
+    char json[RASTER_SOCKET_JSON_MAX];
+    JsonWriter out(json, sizeof(json));
+    out.beginObject();
+    out.string("type", "error");
+    out.string("error", error);
+    out.endObject();
+    send_json(fd, out, json);
+}
+
+// Dropping an unfinished upload aborts the label; nothing here waits for
+// the printer task
+static void close_session(void)
+{
+    delete session.upload;
+    free(session.frame);
+    session.upload = NULL;
+    session.frame = NULL;
+    session.fd = -1;
+    generation++;
+}
+
+static void fail_session(const char *error)
+{
+    ESP_LOGW(TAG, "Upload on %d failed: %s", session.fd, error);
+    send_error(session.fd, error);
+    close_session();
+}
+
+// httpd task: pass on the credit the printer has freed up
+static void grant_credit(void *arg)
+{
+    credit_queued.store(false);
+    if ((uint32_t)(uintptr_t)arg != generation || session.fd < 0) {
+        return;
+    }
+    if (printer_done.load()) {
+        const char *error = printer_error.load();
+        if (!session.sent) {
+            // The printer let go before the client finished the label
+            fail_session(error ? error : "Printer stopped the label");
+        } else if (error) {
+            fail_session(error);
+        } else {
+            ESP_LOGI(TAG, "Upload on %d done", session.fd);
+            send_message(session.fd, "done", "lines", session.lines);
+            close_session();
+        }
+        return;
+    }
+    if (session.sent) {
+        return;
+    }
+
+    uint32_t until = lines_printed.load() + session.window;
+    until = until < session.lines ? until : session.lines;
+    if (until > session.granted) {
+        session.granted = until;
+        send_message(session.fd, "credit", "until", until);
+    }
+}
+
+// Printer task: credit goes out in steps, not a frame per line. The last
+// call also ends the upload on the socket.
+static void on_progress(uint32_t lines_sent, bool done, const char *error, void *ctx)
+{
+    lines_printed.store(lines_sent);
+    if (done) {
+        printer_error.store(error);
+        printer_done.store(true);
+    } else if (lines_sent % credit_step.load() != 0) {
+        return;
+    }
+    if (!credit_queued.exchange(true) && httpd_queue_work(socket_server, grant_credit, ctx) != ESP_OK) {
+        credit_queued.store(false);
+    }
+}
+
+// Session context of the socket, so an upload does not outlive it
+static void socket_closed(void *ctx)
+{
+    int fd = *(int *)ctx;
+    if (session.fd == fd) {
+        ESP_LOGI(TAG, "Socket %d closed mid-upload", fd);
+        close_session();
+    }
+    free(ctx);
+}
+
+static void start_session(httpd_req_t *req, int fd, long width, long lines)
+{
+    if (session.fd >= 0) {
+        if (session.fd != fd) {
+            send_error(fd, "Another upload is open");
+            return;
+        }
+        close_session();
+    }
+
+    printer_state_t state;
+    printer_task_get_state(&state);
+
+    raster_upload_t upload = {};
+    upload.format = RASTER_UPLOAD_BITMAP;
+    upload.orientation = RASTER_ORIENTATION_PORTRAIT;
+    upload.width = (int)width;
+    upload.height = (int)lines;
+    upload.max_px = state.max_width;
+    upload.progress = on_progress;
+    upload.progress_ctx = (void *)(uintptr_t)(generation + 1);
+
+    size_t line_bytes = (width + 7) / 8;
+    const char *error = width > 0 && lines > 0 ? raster_upload_check(&upload, line_bytes * lines) :
+                        "Invalid width or lines";
+    if (error) {
+        send_error(fd, error);
+        return;
+    }
+
+    // The window always fits the stream buffer, so writes never wait on the printer
+    uint32_t window = RASTER_STREAM_BUFFER / line_bytes;
+    window = window < RASTER_SOCKET_MAX_AHEAD ? window : RASTER_SOCKET_MAX_AHEAD;
+
+    if (!req->sess_ctx) {
+        int *ctx = (int *)malloc(sizeof(int));
+        if (ctx) {
+            *ctx = fd;
+            req->sess_ctx = ctx;
+            req->free_ctx = socket_closed;
+        }
+    }
+
+    generation++;
+    lines_printed.store(0);
+    printer_done.store(false);
+    printer_error.store(nullptr);
+    credit_step.store(window / 4 ? window / 4 : 1);
+
+    session.fd = fd;
+    session.line_bytes = line_bytes;
+    session.lines = (uint32_t)lines;
+    session.received = 0;
+    session.sent = false;
+    session.window = window;
+    session.granted = window < session.lines ? window : session.lines;
+    session.frame = (uint8_t *)malloc(window * line_bytes);
+    session.upload = new (std::nothrow) RasterUploadConsumer(&upload);
+    if (!session.frame || !session.upload) {
+        fail_session("Out of memory");
+        return;
+    }
+    if (!session.upload->begin(line_bytes * lines)) {
+        fail_session(session.upload->status() == ESP_ERR_INVALID_STATE ? "Printer busy" : session.upload->error());
+        return;
+    }
+
+    ESP_LOGI(TAG, "Upload on %d: %ld lines of %u bytes, window %u", fd, lines,
+             (unsigned)line_bytes, (unsigned)window);
+    send_message(fd, "credit", "until", session.granted);
+}
+
+static esp_err_t handle_control(httpd_req_t *req, int fd, httpd_ws_frame_t *frame)
+{
+    char buf[RASTER_SOCKET_CONTROL_MAX];
+    if (frame->len >= sizeof(buf)) {
+        return ESP_FAIL;
+    }
+    frame->payload = (uint8_t *)buf;
+    esp_err_t err = httpd_ws_recv_frame(req, frame, frame->len);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    json_token_t tokens[8];
+    int count = json_parse(buf, frame->len, tokens, 8);
+    int type = count > 0 && tokens[0].type == JSON_OBJECT ? json_object_get(buf, tokens, count, 0, "type") : -1;
+    char name[8];
+    if (type < 0 || !json_token_string(buf, &tokens[type], name, sizeof(name))) {
+        send_error(fd, "Invalid message");
+        return ESP_OK;
+    }
+
+    if (strcmp(name, "start") == 0) {
+        int width = json_object_get(buf, tokens, count, 0, "width");
+        int lines = json_object_get(buf, tokens, count, 0, "lines");
+        long width_value = 0;
+        long lines_value = 0;
+        if (width >= 0 && lines >= 0 && json_token_int(buf, &tokens[width], &width_value) &&
+            json_token_int(buf, &tokens[lines], &lines_value)) {
+            start_session(req, fd, width_value, lines_value);
+        } else {
+            send_error(fd, "Invalid width or lines");
+        }
+    } else if (strcmp(name, "abort") == 0) {
+        if (session.fd == fd) {
+            fail_session("Aborted");
+        }
+    } else {
+        send_error(fd, "Unknown message type");
+    }
+    return ESP_OK;
+}
+
+static esp_err_t handle_lines(httpd_req_t *req, int fd, httpd_ws_frame_t *frame)
+{
+    // Frames beyond the credit or outside an upload leave the socket out of
+    // step, so they close it
+    if (session.fd != fd || frame->len == 0 || frame->len % session.line_bytes != 0 ||
+        session.received + frame->len / session.line_bytes > session.granted) {
+        ESP_LOGW(TAG, "Unexpected raster frame of %u bytes on %d", (unsigned)frame->len, fd);
+        if (session.fd == fd) {
+            close_session();
+        }
+        return ESP_FAIL;
+    }
+
+    frame->payload = session.frame;
+    esp_err_t err = httpd_ws_recv_frame(req, frame, frame->len);
+    if (err != ESP_OK) {
+        close_session();
+        return err;
+    }
+
+    if (!session.upload->consume((const char *)session.frame, frame->len)) {
+        fail_session(session.upload->error());
+        return ESP_OK;
+    }
+    session.received += frame->len / session.line_bytes;
+
+    if (session.received == session.lines) {
+        // The printer task sends the last window on its own; "done" goes
+        // out from grant_credit() once it reports the label finished
+        if (!session.upload->detach()) {
+            fail_session(session.upload->error());
+            return ESP_OK;
+        }
+        session.sent = true;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t raster_ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET) {
+        ESP_LOGI(TAG, "Raster socket %d opened", httpd_req_to_sockfd(req));
+        return ESP_OK;
+    }
+
+    httpd_ws_frame_t frame = {};
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    int fd = httpd_req_to_sockfd(req);
+    if (frame.type == HTTPD_WS_TYPE_TEXT) {
+        return handle_control(req, fd, &frame);
+    }
+    if (frame.type == HTTPD_WS_TYPE_BINARY) {
+        return handle_lines(req, fd, &frame);
+    }
+    return ESP_OK;
+}
+
+esp_err_t raster_socket_start(httpd_handle_t server)
+{
+    socket_server = server;
+
+    httpd_uri_t ws = {};
+    ws.uri = RASTER_SOCKET_URI;
+    ws.method = HTTP_GET;
+    ws.handler = raster_ws_handler;
+    ws.is_websocket = true;
+    return httpd_register_uri_handler(server, &ws);
+}
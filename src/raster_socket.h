@@ -0,0 +1,45 @@
+/*
+ * P-touch ESP32 Raster WebSocket
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RASTER_SOCKET_H
+#define RASTER_SOCKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// Labels drawn in the browser, streamed over a WebSocket as they are
+// rendered. The client opens an upload with a text frame
+//   {"type": "start", "width": 128, "lines": 400}
+// and sends raster lines of (width + 7) / 8 bytes in binary frames. It
+// may send up to the line count in the latest {"type": "credit", "until": n};
+// credit follows the lines the printer has taken over USB, so the client
+// is never more than RASTER_SOCKET_MAX_AHEAD lines ahead and the server
+// holds at most one window whatever the label length. The upload ends
+// with {"type": "done"} or {"type": "error"}; {"type": "abort"} drops it.
+#define RASTER_SOCKET_URI           "/ws/raster"
+#define RASTER_SOCKET_MAX_AHEAD     128     // Lines the browser may be ahead of the printer
+#define RASTER_SOCKET_CONTROL_MAX   128     // Text frames from the client
+#define RASTER_SOCKET_JSON_MAX      96
+
+// Register the handler on a running server
+esp_err_t raster_socket_start(httpd_handle_t server);
+
+#endif // RASTER_SOCKET_H
@@ -0,0 +1,411 @@
+/*
+ * P-touch ESP32 Raster Upload Stream
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "raster_stream.h"
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "printer_task.h"
+
+static const char *TAG = "raster-stream";
+
+typedef enum {
+    STREAM_IDLE = 0,
+    STREAM_WRITING,
+    STREAM_FINISHED,                    // All data is in the buffer
+    STREAM_ABORTED                      // The upload failed; drop the label
+} stream_state_t;
+
+// What the printer task needs to know about the open upload
+typedef struct {
+    bool job;                           // Complete printer job, sent without a header of ours
+    bool rows;                          // Plain rows to wrap, not encoded commands
+    size_t line_bytes;
+    uint32_t lines;
+    raster_progress_cb_t progress;
+    void *progress_ctx;
+} stream_job_t;
+
+static StreamBufferHandle_t stream = NULL;
+static SemaphoreHandle_t label_done = NULL;    // Given by the printer task when it lets go
+static std::atomic<bool> claimed(false);
+static std::atomic<int> writer_state(STREAM_IDLE);
+static std::atomic<bool> printer_failed(false);
+
+// Who lets go of the stream: the writer once label_done comes, or the
+// printer task when the writer is not waiting for it
+typedef enum {
+    HANDOFF_OPEN = 0,
+    HANDOFF_PRINTED,                    // Printer task is done with the label
+    HANDOFF_DETACHED                    // Writer is not waiting; the printer task cleans up
+} handoff_t;
+static std::atomic<int> handoff(HANDOFF_OPEN);
+
+// Set by the HTTP side before the command is posted
+static stream_job_t active;
+// Set by the printer task before it gives label_done
+static const char *print_error = NULL;
+
+esp_err_t raster_stream_init(void)
+{
+    stream = xStreamBufferCreate(RASTER_STREAM_BUFFER, 1);
+    label_done = xSemaphoreCreateBinary();
+    if (!stream || !label_done) {
+        ESP_LOGE(TAG, "Failed to create raster stream");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+size_t raster_upload_bytes(const raster_upload_t *upload)
+{
+    if (upload->format != RASTER_UPLOAD_BITMAP || upload->width <= 0 || upload->height <= 0) {
+        return 0;
+    }
+    return (size_t)((upload->width + 7) / 8) * upload->height;
+}
+
+const char* raster_upload_check(const raster_upload_t *upload, size_t content_len)
+{
+    if (upload->format == RASTER_UPLOAD_JOB) {
+        return NULL;
+    }
+    if (upload->format == RASTER_UPLOAD_ENCODED) {
+        if (upload->lines == 0 || upload->lines > RASTER_UPLOAD_MAX_LINES) {
+            return "Invalid X-Label-Lines";
+        }
+        return content_len > 0 ? NULL : "Empty raster data";
+    }
+
+    if (upload->width <= 0 || upload->height <= 0) {
+        return "Invalid X-Label-Width or X-Label-Height";
+    }
+    bool portrait = upload->orientation == RASTER_ORIENTATION_PORTRAIT;
+    if ((portrait ? upload->width : upload->height) > upload->max_px) {
+        return "Bitmap wider than the print head";
+    }
+    if ((uint32_t)(portrait ? upload->height : upload->width) > RASTER_UPLOAD_MAX_LINES) {
+        return "Label too long";
+    }
+    if (content_len != raster_upload_bytes(upload)) {
+        return "Body size does not match width and height";
+    }
+    if (!portrait && content_len > RASTER_LANDSCAPE_MAX_BYTES) {
+        return "Landscape bitmap too large, send it in portrait";
+    }
+    return NULL;
+}
+
+RasterUploadConsumer::RasterUploadConsumer(const raster_upload_t *upload)
+    : upload(*upload),
+      validator(upload->max_px / 8, upload->packbits, upload->lines),
+      landscape(NULL), received(0), line_count(0), opened(false),
+      err(ESP_OK), message(NULL)
+{
+}
+
+RasterUploadConsumer::~RasterUploadConsumer()
+{
+    if (opened) {
+        release(false);
+    }
+    free(landscape);
+}
+
+bool RasterUploadConsumer::refuse(esp_err_t status, const char *reason)
+{
+    if (err == ESP_OK) {
+        err = status;
+        message = reason;
+    }
+    return false;
+}
+
+bool RasterUploadConsumer::open()
+{
+    bool expected = false;
+    if (!claimed.compare_exchange_strong(expected, true)) {
+        return refuse(ESP_ERR_INVALID_STATE, "Another raster upload is printing");
+    }
+
+    bool rows = upload.format == RASTER_UPLOAD_BITMAP;
+    bool portrait = upload.orientation == RASTER_ORIENTATION_PORTRAIT;
+    active.job = upload.format == RASTER_UPLOAD_JOB;
+    active.rows = rows;
+    active.line_bytes = rows ? ((portrait ? upload.width : upload.height) + 7) / 8 : 0;
+    active.lines = rows ? (portrait ? upload.height : upload.width) : upload.lines;
+    active.progress = upload.progress;
+    active.progress_ctx = upload.progress_ctx;
+    print_error = NULL;
+    printer_failed.store(false);
+    handoff.store(HANDOFF_OPEN);
+    writer_state.store(STREAM_WRITING);
+    xSemaphoreTake(label_done, 0);
+
+    if (!printer_task_post(PRINTER_CMD_RASTER, 0)) {
+        writer_state.store(STREAM_IDLE);
+        claimed.store(false);
+        return refuse(ESP_ERR_INVALID_STATE, "Printer busy");
+    }
+    opened = true;
+    return true;
+}
+
+// Blocks while the buffer is full, which in turn holds back the client
+bool RasterUploadConsumer::write(const uint8_t *data, size_t len)
+{
+    TickType_t last_progress = xTaskGetTickCount();
+    while (len > 0) {
+        if (printer_failed.load()) {
+            return refuse(ESP_FAIL, "Printer stopped the label");
+        }
+        size_t sent = xStreamBufferSend(stream, data, len, pdMS_TO_TICKS(RASTER_STREAM_POLL_MS));
+        if (sent > 0) {
+            data += sent;
+            len -= sent;
+            last_progress = xTaskGetTickCount();
+        } else if (xTaskGetTickCount() - last_progress >= pdMS_TO_TICKS(RASTER_STREAM_TIMEOUT_MS)) {
+            return refuse(ESP_FAIL, "Printer stopped taking data");
+        }
+    }
+    return true;
+}
+
+static void release_stream(void)
+{
+    xStreamBufferReset(stream);
+    writer_state.store(STREAM_IDLE);
+    claimed.store(false);
+}
+
+// Tell the printer task the data is complete, or that it never will be,
+// and leave the stream to it
+void RasterUploadConsumer::release(bool complete)
+{
+    writer_state.store(complete ? STREAM_FINISHED : STREAM_ABORTED);
+    opened = false;
+    if (handoff.exchange(HANDOFF_DETACHED) == HANDOFF_PRINTED) {
+        // Let go just now; label_done follows at once
+        xSemaphoreTake(label_done, pdMS_TO_TICKS(RASTER_STREAM_TIMEOUT_MS));
+        release_stream();
+    }
+}
+
+// Tell the printer task the data is complete and wait for it to let go
+// of the stream. The wait is bounded: past it the label is abandoned and
+// the printer task releases the stream.
+const char* RasterUploadConsumer::finish()
+{
+    writer_state.store(STREAM_FINISHED);
+    opened = false;
+    if (xSemaphoreTake(label_done, pdMS_TO_TICKS(RASTER_STREAM_TIMEOUT_MS)) != pdTRUE) {
+        writer_state.store(STREAM_ABORTED);
+        if (handoff.exchange(HANDOFF_DETACHED) != HANDOFF_PRINTED) {
+            return "Printer did not finish the label";
+        }
+        xSemaphoreTake(label_done, pdMS_TO_TICKS(RASTER_STREAM_TIMEOUT_MS));
+    }
+    const char *error = print_error;
+    release_stream();
+    return error;
+}
+
+bool RasterUploadConsumer::begin(size_t content_len)
+{
+    if (upload.format == RASTER_UPLOAD_BITMAP && upload.orientation == RASTER_ORIENTATION_LANDSCAPE) {
+        // Rotation needs every row, so this one is collected first
+        landscape = (uint8_t *)malloc(content_len);
+        if (!landscape) {
+            return refuse(ESP_ERR_NO_MEM, "Out of memory");
+        }
+        return true;
+    }
+    return open();
+}
+
+bool RasterUploadConsumer::consume(const char *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    if (landscape) {
+        memcpy(landscape + received, bytes, len);
+        received += len;
+        return true;
+    }
+
+    // Checked before it is passed on, then forwarded unchanged
+    if (upload.format == RASTER_UPLOAD_ENCODED && !validator.feed(bytes, len)) {
+        return refuse(ESP_ERR_INVALID_ARG, validator.error());
+    }
+    received += len;
+    return write(bytes, len);
+}
+
+bool RasterUploadConsumer::sendLandscape()
+{
+    if (!open()) {
+        return false;
+    }
+    uint8_t line[PTOUCH_MAX_PACKET_SIZE];
+    size_t line_bytes = (upload.height + 7) / 8;
+    for (int x = 0; x < upload.width; x++) {
+        raster_rotate_line(landscape, upload.width, upload.height, x, line);
+        if (!write(line, line_bytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks and sends whatever is left once the body is in
+bool RasterUploadConsumer::complete()
+{
+    if (upload.format == RASTER_UPLOAD_ENCODED) {
+        if (!validator.complete() || validator.lines() != upload.lines) {
+            return refuse(ESP_ERR_INVALID_ARG, "Raster data does not end after X-Label-Lines lines");
+        }
+        line_count = validator.lines();
+    } else if (upload.format == RASTER_UPLOAD_JOB) {
+        line_count = 0;
+    } else if (landscape) {
+        if (!sendLandscape()) {
+            return false;
+        }
+        line_count = upload.width;
+    } else {
+        line_count = upload.height;
+    }
+    return true;
+}
+
+bool RasterUploadConsumer::end()
+{
+    if (!complete()) {
+        return false;
+    }
+    const char *error = finish();
+    if (error) {
+        return refuse(ESP_FAIL, error);
+    }
+    return true;
+}
+
+bool RasterUploadConsumer::detach()
+{
+    if (!complete()) {
+        return false;
+    }
+    release(true);
+    return true;
+}
+
+uint32_t raster_stream_print(PtouchPrinter *printer)
+{
+    const char *error = NULL;
+    uint32_t pages = 0;
+    uint8_t packet[PTOUCH_MAX_PACKET_SIZE];
+    size_t filled = 0;
+    uint32_t lines_sent = 0;
+    RasterJobScanner job_pages;         // Print commands in a job sent as it is
+
+    // A cancel aimed at a queued job's label must not hit this one
+    printer->clearCancel();
+    if (writer_state.load() == STREAM_ABORTED) {
+        error = "Upload aborted";
+    } else if (!printer->isConnected()) {
+        error = "Printer not connected";
+    } else if (!printer->waitForDataReady()) {
+        error = printer->getErrorDescription();
+    } else if (!active.job && !printer->beginRaster(active.lines)) {
+        error = "Failed to start the label";
+    }
+    bool started = error == NULL;
+
+    TickType_t last_data = xTaskGetTickCount();
+    while (!error) {
+        size_t want = active.rows ? active.line_bytes - filled : sizeof(packet);
+        size_t got = xStreamBufferReceive(stream, packet + filled, want, pdMS_TO_TICKS(RASTER_STREAM_POLL_MS));
+        if (got == 0) {
+            int state = writer_state.load();
+            if (state == STREAM_ABORTED) {
+                error = "Upload aborted";
+            } else if (state == STREAM_FINISHED && xStreamBufferIsEmpty(stream)) {
+                if (filled > 0) {
+                    error = "Upload ended inside a raster line";
+                }
+                break;
+            } else if (xTaskGetTickCount() - last_data >= pdMS_TO_TICKS(RASTER_STREAM_TIMEOUT_MS)) {
+                error = "Upload stalled";
+            }
+            continue;
+        }
+        last_data = xTaskGetTickCount();
+
+        if (printer->isCancelRequested()) {
+            error = "Cancelled";
+        } else if (!active.rows) {
+            // Pre-encoded commands go out exactly as they were uploaded
+            if (!printer->sendRasterData(packet, got)) {
+                error = "USB transfer failed";
+            } else if (active.job) {
+                job_pages.scan(packet, got);
+            }
+        } else if ((filled += got) == active.line_bytes) {
+            if (!printer->sendRasterRow(packet, filled)) {
+                error = "USB transfer failed";
+            } else if (active.progress) {
+                active.progress(++lines_sent, false, NULL, active.progress_ctx);
+            }
+            filled = 0;
+        }
+    }
+
+    if (active.job) {
+        // Pages already sent print even if the rest of the job is dropped
+        pages = job_pages.pages();
+    } else if (!error) {
+        if (printer->finalizePrint(false)) {
+            pages = 1;
+        } else {
+            error = "Failed to finish the label";
+        }
+    }
+    if (error) {
+        ESP_LOGW(TAG, "Raster upload failed: %s", error);
+        printer_failed.store(true);
+        if (started) {
+            printer->abortPrint();
+        }
+    }
+
+    print_error = error;
+    if (active.progress) {
+        active.progress(lines_sent, true, error, active.progress_ctx);
+    }
+    if (handoff.exchange(HANDOFF_PRINTED) == HANDOFF_DETACHED) {
+        release_stream();
+    } else {
+        xSemaphoreGive(label_done);
+    }
+    return pages;
+}
@@ -0,0 +1,122 @@
+/*
+ * P-touch ESP32 Raster Upload Stream
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RASTER_STREAM_H
+#define RASTER_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "ptouch_esp32.h"
+#include "body_reader.h"
+#include "raster_format.h"
+
+// Labels uploaded as raster data are not queued: the HTTP task hands the
+// body to the printer task through a small stream buffer while it is still
+// arriving, so a label of any length needs only RASTER_STREAM_BUFFER bytes.
+// One upload runs at a time, from HTTP or from the raw listener.
+#define RASTER_STREAM_BUFFER        4096
+#define RASTER_STREAM_POLL_MS       20      // How often a blocked side looks for an abort
+#define RASTER_STREAM_TIMEOUT_MS    10000   // Either side gives up when the other stalls this long
+#define RASTER_UPLOAD_MAX_BYTES     (4 * 1024 * 1024)
+#define RASTER_UPLOAD_MAX_LINES     65535
+#define RASTER_LANDSCAPE_MAX_BYTES  32768   // Landscape bitmaps are rotated, so held whole
+
+typedef enum {
+    RASTER_UPLOAD_BITMAP = 0,           // Raw 1bpp rows, MSB first, rows padded to a byte
+    RASTER_UPLOAD_ENCODED,              // Brother raster line commands ('G' and 'Z')
+    RASTER_UPLOAD_JOB                   // A whole printer job, commands and all (port 9100)
+} raster_upload_format_t;
+
+// Printer task: lines sent over USB so far, and once more with done set
+// when it lets go of the upload, with error NULL if the label was sent.
+// Lets a sender pace itself on the printer.
+typedef void (*raster_progress_cb_t)(uint32_t lines_sent, bool done, const char *error, void *ctx);
+
+typedef struct {
+    raster_upload_format_t format;
+    raster_orientation_t orientation;   // Bitmaps only
+    int width;                          // Bitmaps only, in pixels
+    int height;
+    uint32_t lines;                     // Encoded only: raster lines that will follow
+    int max_px;                         // Printer head width
+    bool packbits;                      // Encoded lines are PackBits compressed
+    raster_progress_cb_t progress;      // Optional; bitmaps only
+    void *progress_ctx;
+} raster_upload_t;
+
+// Create the stream buffer; call before the web server starts
+esp_err_t raster_stream_init(void);
+
+// Check an upload's geometry against the printer before any data is read.
+// content_len is the size of the decoded body. Returns NULL when it is
+// acceptable, otherwise the reason.
+const char* raster_upload_check(const raster_upload_t *upload, size_t content_len);
+
+// Body size a bitmap upload must have; 0 for other formats
+size_t raster_upload_bytes(const raster_upload_t *upload);
+
+// Body consumer for POST /api/print/raster. Opens the stream on the first
+// data, feeds the printer task as the body arrives and, in end(), waits
+// up to RASTER_STREAM_TIMEOUT_MS for the label to be sent; after that the
+// label is abandoned. detach() ends the upload without waiting; the
+// outcome then comes only through the progress callback. Destroying an
+// open consumer detaches it as aborted. status() says why it refused:
+// ESP_ERR_INVALID_ARG for bad data, ESP_ERR_INVALID_STATE when another
+// upload is running, ESP_ERR_NO_MEM when a landscape bitmap does not fit,
+// ESP_FAIL when the printer failed.
+class RasterUploadConsumer : public BodyConsumer {
+public:
+    explicit RasterUploadConsumer(const raster_upload_t *upload);
+    ~RasterUploadConsumer() override;
+
+    bool begin(size_t content_len) override;
+    bool consume(const char *data, size_t len) override;
+    bool end() override;
+    bool detach();
+
+    esp_err_t status() const { return err; }
+    const char* error() const { return message; }
+    uint32_t lines() const { return line_count; }
+
+private:
+    raster_upload_t upload;
+    RasterStreamValidator validator;
+    uint8_t *landscape;                 // Whole bitmap, for rotation
+    size_t received;
+    uint32_t line_count;
+    bool opened;
+    esp_err_t err;
+    const char *message;
+
+    bool refuse(esp_err_t status, const char *reason);
+    bool open();
+    bool write(const uint8_t *data, size_t len);
+    bool sendLandscape();
+    bool complete();
+    void release(bool complete);
+    const char* finish();
+};
+
+// Printer task side: print the open upload, for PRINTER_CMD_RASTER.
+// Returns the pages sent with a print command, each of which has a
+// print-complete status still to come, counted from getPrintedAtReady().
+uint32_t raster_stream_print(PtouchPrinter *printer);
+
+#endif // RASTER_STREAM_H
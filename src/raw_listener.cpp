@@ -0,0 +1,209 @@
+/*
+ * P-touch ESP32 Raw Print Listener
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "raw_listener.h"
+#include <string.h>
+#include <inttypes.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "raster_format.h"
+#include "raster_stream.h"
+#include "printer_task.h"
+
+static const char *TAG = "raw-listener";
+
+static TaskHandle_t listener_task = NULL;
+static std::atomic<bool> connected(false);
+static std::atomic<uint32_t> connections(0);
+static std::atomic<uint32_t> jobs(0);
+static std::atomic<uint32_t> failed(0);
+static std::atomic<uint32_t> pages(0);
+static std::atomic<uint32_t> bytes(0);
+
+// Claim the raster stream for the next job, waiting while an HTTP upload
+// has it or queued labels are still printing; the printer task would not
+// drain the stream before they are confirmed. The socket is not read
+// meanwhile, so the sender is held back.
+static std::unique_ptr<RasterUploadConsumer> open_job(void)
+{
+    printer_state_t state;
+    printer_task_get_state(&state);
+
+    raster_upload_t upload = {};
+    upload.format = RASTER_UPLOAD_JOB;
+    upload.max_px = state.max_width;
+
+    TickType_t start = xTaskGetTickCount();
+    while (xTaskGetTickCount() - start < pdMS_TO_TICKS(RAW_LISTENER_IDLE_MS)) {
+        if (!printer_task_idle()) {
+            vTaskDelay(pdMS_TO_TICKS(RAW_LISTENER_BUSY_POLL_MS));
+            continue;
+        }
+        std::unique_ptr<RasterUploadConsumer> job(new (std::nothrow) RasterUploadConsumer(&upload));
+        if (!job) {
+            return NULL;
+        }
+        if (job->begin(0)) {
+            return job;
+        }
+        if (job->status() != ESP_ERR_INVALID_STATE) {
+            ESP_LOGW(TAG, "Job refused: %s", job->error());
+            return NULL;
+        }
+        vTaskDelay(pdMS_TO_TICKS(RAW_LISTENER_BUSY_POLL_MS));
+    }
+    ESP_LOGW(TAG, "Printer stayed busy, dropping the connection");
+    return NULL;
+}
+
+// Read jobs off one connection until it closes or something goes wrong
+static void serve_connection(int sock)
+{
+    // Only one connection is served at a time, so one buffer will do
+    static uint8_t rx[RAW_LISTENER_RECV_BUFFER];
+
+    RasterJobScanner scanner;
+    std::unique_ptr<RasterUploadConsumer> job;
+    const char *error = NULL;
+
+    while (!error) {
+        int len = recv(sock, rx, sizeof(rx), 0);
+        if (len <= 0) {
+            if (job) {
+                error = len < 0 ? "Connection idle inside a job" : "Connection closed inside a job";
+            }
+            break;
+        }
+        bytes.fetch_add(len);
+
+        size_t pos = 0;
+        while (pos < (size_t)len && !error) {
+            if (!job) {
+                // Padding between jobs is dropped; the printer is already in sync
+                while (pos < (size_t)len && rx[pos] == RASTER_CMD_INVALIDATE) {
+                    pos++;
+                }
+                if (pos == (size_t)len) {
+                    break;
+                }
+                job = open_job();
+                if (!job) {
+                    error = "Printer unavailable";
+                    break;
+                }
+            }
+
+            size_t take = scanner.scan(rx + pos, len - pos);
+            if (scanner.failed()) {
+                error = scanner.error();
+            } else if (!job->consume((const char *)rx + pos, take)) {
+                error = job->error();
+            } else if (scanner.jobEnded()) {
+                if (!job->end()) {
+                    error = job->error();
+                    break;
+                }
+                jobs.fetch_add(1);
+                pages.fetch_add(scanner.pages());
+                ESP_LOGI(TAG, "Printed a %" PRIu32 " page job", scanner.pages());
+                job.reset();
+                scanner.reset();
+            }
+            pos += take;
+        }
+    }
+
+    if (error) {
+        // Dropping an open job aborts the label
+        ESP_LOGW(TAG, "Raw job failed: %s", error);
+        failed.fetch_add(1);
+    }
+}
+
+static void raw_listener_task(void *arg)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listener < 0) {
+        ESP_LOGE(TAG, "Failed to create socket");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(RAW_LISTENER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 1) != 0) {
+        ESP_LOGE(TAG, "Failed to listen on port %d", RAW_LISTENER_PORT);
+        close(listener);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Listening for raw print jobs on port %d", RAW_LISTENER_PORT);
+
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int sock = accept(listener, (struct sockaddr *)&peer, &peer_len);
+        if (sock < 0) {
+            vTaskDelay(pdMS_TO_TICKS(RAW_LISTENER_BUSY_POLL_MS));
+            continue;
+        }
+
+        struct timeval timeout = {};
+        timeout.tv_sec = RAW_LISTENER_IDLE_MS / 1000;
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        connections.fetch_add(1);
+        connected.store(true);
+        serve_connection(sock);
+        connected.store(false);
+        close(sock);
+    }
+}
+
+esp_err_t raw_listener_start(void)
+{
+    if (listener_task) {
+        return ESP_OK;
+    }
+    if (xTaskCreate(raw_listener_task, "raw_listener", 4096, NULL, 4, &listener_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start raw listener task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void raw_listener_get_stats(raw_listener_stats_t *stats)
+{
+    stats->connected = connected.load();
+    stats->connections = connections.load();
+    stats->jobs = jobs.load();
+    stats->failed = failed.load();
+    stats->pages = pages.load();
+    stats->bytes = bytes.load();
+}
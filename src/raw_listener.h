@@ -0,0 +1,52 @@
+/*
+ * P-touch ESP32 Raw Print Listener
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RAW_LISTENER_H
+#define RAW_LISTENER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// "Raw"/JetDirect printing: CUPS and label servers open a TCP connection
+// and send complete Brother printer jobs. The stream is split into jobs at
+// their final print command and each goes to the printer through the
+// raster stream, so it waits for HTTP uploads and queued labels and the
+// socket is only read as fast as the printer takes data.
+#define RAW_LISTENER_PORT           9100
+#define RAW_LISTENER_RECV_BUFFER    1460    // One TCP segment, reused for every read
+#define RAW_LISTENER_IDLE_MS        30000   // Connections that send nothing this long are closed
+#define RAW_LISTENER_BUSY_POLL_MS   100     // Retry while another upload holds the printer
+
+// Counters for /api/queue
+typedef struct {
+    bool connected;
+    uint32_t connections;
+    uint32_t jobs;                      // Sent to the printer
+    uint32_t failed;                    // Malformed, cut off or refused by the printer
+    uint32_t pages;
+    uint32_t bytes;
+} raw_listener_stats_t;
+
+// Start the listener task; call after the raster stream exists
+esp_err_t raw_listener_start(void);
+
+void raw_listener_get_stats(raw_listener_stats_t *stats);
+
+#endif // RAW_LISTENER_H
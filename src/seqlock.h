@@ -0,0 +1,71 @@
+/*
+ * P-touch ESP32 Sequence Lock
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <string.h>
+#include <stdint.h>
+#include <type_traits>
+
+// Single-writer sequence lock for snapshots that are read far more often
+// than they change. The writer never waits; a reader copies what it needs
+// and retries if a write overlapped the copy. The sequence is odd while a
+// write is in progress.
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+
+private:
+    std::atomic<uint32_t> sequence;
+    T data;
+
+public:
+    SeqLock() : sequence(0), data() {}
+
+    // Writer side; only one task may call this
+    void store(const T &value) {
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&data, &value, sizeof(T));
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // One read attempt: read(const T &) copies out what it needs. Returns
+    // false if a write got in the way; the copy must then be discarded.
+    // Readers that can preempt the writer must back off before retrying.
+    template <typename F>
+    bool tryRead(F &&read) const {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+        read(data);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    // Completed writes so far
+    uint32_t version() const {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+};
+
+#endif // SEQLOCK_H
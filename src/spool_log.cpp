@@ -0,0 +1,505 @@
+/*
+ * P-touch ESP32 Spool Log
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "spool_log.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+#endif
+
+#define SPOOL_RECORD_MAGIC      0x4c4f4f50  // "POOL"
+#define SPOOL_INDEX_COMMITTED   'C'
+#define SPOOL_INDEX_COMPLETED   'D'
+#define SPOOL_INDEX_CHECKPOINT  'K'
+
+// Log record: this header followed by the label text, no terminator. A
+// batch instead carries one entry per label description: copies (uint16),
+// cut (uint8), then the text with its terminator.
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t text_len;                  // Payload bytes
+    uint16_t copies;
+    uint8_t priority;
+    uint8_t entries;                    // Label descriptions; 0 for a plain text job
+    uint8_t reserved[2];
+    uint32_t client;
+    uint32_t crc;                       // Header with crc = 0, then the payload
+} spool_record_t;
+
+#define SPOOL_ENTRY_HEADER      3
+
+// Index entry; check catches an entry torn by a reset
+typedef struct __attribute__((packed)) {
+    uint32_t offset;                    // Record position in the log
+    uint8_t state;
+    uint8_t reserved;
+    uint16_t labels_done;               // Checkpoint entries: labels confirmed printed
+    uint32_t check;
+} spool_index_t;
+
+// CRC-32 as zlib computes it; the ROM has it on the device
+static uint32_t crc32_le(uint32_t crc, const uint8_t *buf, size_t len)
+{
+#ifdef ESP_PLATFORM
+    return esp_rom_crc32_le(crc, buf, len);
+#else
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+#endif
+}
+
+static uint32_t index_check(uint32_t offset, uint8_t state, uint16_t labels_done)
+{
+    return offset ^ (state * 0x01010101u) ^ ((uint32_t)labels_done << 8) ^ 0xa5a5a5a5u;
+}
+
+static uint32_t header_crc(const spool_record_t *record)
+{
+    spool_record_t header = *record;
+    header.crc = 0;
+    return crc32_le(0, (const uint8_t *)&header, sizeof(header));
+}
+
+static void entry_header(const print_label_entry_t *entry, uint8_t header[SPOOL_ENTRY_HEADER])
+{
+    memcpy(header, &entry->copies, sizeof(entry->copies));
+    header[2] = (uint8_t)entry->cut;
+}
+
+// Point entries at the descriptions in a batch payload read back from the log
+static bool decode_entries(const spool_record_t *record, char *payload, print_label_entry_t *entries)
+{
+    if (record->entries > PRINT_BATCH_MAX_LABELS) {
+        return false;
+    }
+    size_t pos = 0;
+    for (int i = 0; i < record->entries; i++) {
+        if (pos + SPOOL_ENTRY_HEADER >= record->text_len) {
+            return false;
+        }
+        memcpy(&entries[i].copies, payload + pos, sizeof(entries[i].copies));
+        entries[i].cut = (print_cut_t)(uint8_t)payload[pos + 2];
+        entries[i].text = payload + pos + SPOOL_ENTRY_HEADER;
+        pos += SPOOL_ENTRY_HEADER + strnlen(entries[i].text, record->text_len - pos - SPOOL_ENTRY_HEADER) + 1;
+        if (pos > record->text_len) {
+            return false;
+        }
+    }
+    return pos == record->text_len;
+}
+
+static bool sync_file(FILE *file)
+{
+    return fflush(file) == 0 && fsync(fileno(file)) == 0;
+}
+
+static bool file_exists(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+static size_t file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static bool write_entry(FILE *file, uint32_t offset, uint8_t state, uint16_t labels_done)
+{
+    spool_index_t entry = {};
+    entry.offset = offset;
+    entry.state = state;
+    entry.labels_done = labels_done;
+    entry.check = index_check(offset, state, labels_done);
+    return fwrite(&entry, sizeof(entry), 1, file) == 1;
+}
+
+// Read and verify one record; the payload goes to text, terminated
+static bool read_record(FILE *file, uint32_t offset, spool_record_t *record, char *text, size_t capacity)
+{
+    if (fseek(file, offset, SEEK_SET) != 0 || fread(record, sizeof(*record), 1, file) != 1) {
+        return false;
+    }
+    if (record->magic != SPOOL_RECORD_MAGIC || record->text_len > SPOOL_LOG_PAYLOAD_MAX ||
+        record->text_len >= capacity) {
+        return false;
+    }
+    if (fread(text, 1, record->text_len, file) != record->text_len) {
+        return false;
+    }
+    text[record->text_len] = '\0';
+    return crc32_le(header_crc(record), (const uint8_t *)text, record->text_len) == record->crc;
+}
+
+SpoolLog::SpoolLog(const char *log_path, const char *index_path, size_t max_bytes,
+                   size_t max_index_bytes, size_t compact_bytes)
+    : max_bytes(max_bytes), max_index_bytes(max_index_bytes), compact_bytes(compact_bytes),
+      log_file(NULL), index_file(NULL), log_size(0), index_size(0),
+      live_count(0), next_ref(0), compaction_count(0), dropped_count(0)
+{
+    snprintf(this->log_path, sizeof(this->log_path), "%s", log_path);
+    snprintf(this->index_path, sizeof(this->index_path), "%s", index_path);
+}
+
+SpoolLog::~SpoolLog()
+{
+    close();
+}
+
+void SpoolLog::close()
+{
+    if (log_file) {
+        fclose(log_file);
+    }
+    if (index_file) {
+        fclose(index_file);
+    }
+    log_file = index_file = NULL;
+}
+
+int SpoolLog::find(uint32_t ref) const
+{
+    for (size_t i = 0; i < live_count; i++) {
+        if (live[i].ref == ref) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+bool SpoolLog::openFiles()
+{
+    log_file = fopen(log_path, "ab");
+    index_file = fopen(index_path, "ab");
+    if (!log_file || !index_file) {
+        close();
+        return false;
+    }
+    log_size = file_size(log_path);
+    index_size = file_size(index_path);
+    return true;
+}
+
+bool SpoolLog::writeIndex(uint32_t offset, uint8_t state, uint16_t labels_done)
+{
+    bool ok = write_entry(index_file, offset, state, labels_done) && sync_file(index_file);
+    long end = ftell(index_file);
+    index_size = end >= 0 ? (size_t)end : index_size + sizeof(spool_index_t);
+    return ok;
+}
+
+// The old index going away is the commit point: before it, the old pair
+// is the spool and the copies are dropped; after it, the copies are
+void SpoolLog::finishCompaction()
+{
+    char log_tmp[SPOOL_LOG_PATH_MAX + 4];
+    char index_tmp[SPOOL_LOG_PATH_MAX + 4];
+    snprintf(log_tmp, sizeof(log_tmp), "%s.tmp", log_path);
+    snprintf(index_tmp, sizeof(index_tmp), "%s.tmp", index_path);
+
+    if (file_exists(index_tmp) && !file_exists(index_path)) {
+        if (file_exists(log_tmp)) {
+            unlink(log_path);
+            rename(log_tmp, log_path);
+        }
+        rename(index_tmp, index_path);
+    } else {
+        unlink(index_tmp);
+        unlink(log_tmp);
+    }
+}
+
+bool SpoolLog::compact()
+{
+    char log_tmp[SPOOL_LOG_PATH_MAX + 4];
+    char index_tmp[SPOOL_LOG_PATH_MAX + 4];
+    snprintf(log_tmp, sizeof(log_tmp), "%s.tmp", log_path);
+    snprintf(index_tmp, sizeof(index_tmp), "%s.tmp", index_path);
+
+    // Copy the live records with their latest checkpoint
+    FILE *log_in = live_count ? fopen(log_path, "rb") : NULL;
+    FILE *log_out = fopen(log_tmp, "wb");
+    FILE *index_out = fopen(index_tmp, "wb");
+    bool ok = log_out && index_out && (live_count == 0 || log_in);
+    uint32_t offsets[SPOOL_LOG_MAX_LIVE];
+    size_t out_size = 0;
+    for (size_t i = 0; ok && i < live_count; i++) {
+        spool_record_t record;
+        ok = read_record(log_in, live[i].offset, &record, scratch, sizeof(scratch)) &&
+             fwrite(&record, sizeof(record), 1, log_out) == 1 &&
+             fwrite(scratch, 1, record.text_len, log_out) == record.text_len &&
+             write_entry(index_out, out_size, SPOOL_INDEX_COMMITTED, 0) &&
+             (live[i].labels_done == 0 ||
+              write_entry(index_out, out_size, SPOOL_INDEX_CHECKPOINT, live[i].labels_done));
+        offsets[i] = out_size;
+        out_size += sizeof(record) + record.text_len;
+    }
+    ok = ok && sync_file(log_out) && sync_file(index_out);
+    if (log_in) {
+        fclose(log_in);
+    }
+    if (log_out) {
+        fclose(log_out);
+    }
+    if (index_out) {
+        fclose(index_out);
+    }
+    if (!ok) {
+        unlink(log_tmp);
+        unlink(index_tmp);
+        return false;
+    }
+
+    close();
+    unlink(index_path);
+    finishCompaction();
+    for (size_t i = 0; i < live_count; i++) {
+        live[i].offset = offsets[i];
+    }
+    compaction_count++;
+    return openFiles();
+}
+
+bool SpoolLog::open()
+{
+    close();
+    live_count = 0;
+    dropped_count = 0;
+    finishCompaction();
+
+    // Replay the index: committed entries become live, checkpoints move
+    // their resume point forward, completed ones drop out
+    bool torn = false;
+    FILE *index = fopen(index_path, "rb");
+    if (index) {
+        spool_index_t entry;
+        size_t good = 0;
+        while (fread(&entry, sizeof(entry), 1, index) == 1) {
+            if (entry.check != index_check(entry.offset, entry.state, entry.labels_done)) {
+                break;
+            }
+            good += sizeof(entry);
+            int i = -1;
+            for (size_t j = 0; j < live_count; j++) {
+                if (live[j].offset == entry.offset) {
+                    i = (int)j;
+                }
+            }
+            if (entry.state == SPOOL_INDEX_COMMITTED && i < 0 && live_count < SPOOL_LOG_MAX_LIVE) {
+                live[live_count++] = {next_ref++, entry.offset, 0};
+            } else if (entry.state == SPOOL_INDEX_CHECKPOINT && i >= 0) {
+                live[i].labels_done = entry.labels_done;
+            } else if (entry.state == SPOOL_INDEX_COMPLETED && i >= 0) {
+                memmove(&live[i], &live[i + 1], (live_count - i - 1) * sizeof(live[0]));
+                live_count--;
+            }
+        }
+        fclose(index);
+        torn = good != file_size(index_path);
+    }
+
+    // Only records that read back intact and have labels left are kept
+    FILE *log = live_count ? fopen(log_path, "rb") : NULL;
+    size_t kept = 0;
+    for (size_t i = 0; i < live_count; i++) {
+        spool_record_t record;
+        if (log && read_record(log, live[i].offset, &record, scratch, sizeof(scratch)) &&
+            live[i].labels_done < record.copies) {
+            live[kept++] = live[i];
+        } else {
+            dropped_count++;
+        }
+    }
+    live_count = kept;
+    if (log) {
+        fclose(log);
+    }
+
+    if (!openFiles()) {
+        return false;
+    }
+    // A torn entry would misalign everything appended after it
+    if ((torn || dropped_count > 0 || (live_count == 0 && log_size > 0)) && !compact()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+spool_append_t SpoolLog::append(const spool_job_t &job, uint32_t *ref)
+{
+    *ref = SPOOL_LOG_NONE;
+
+    // Batches are written piece by piece, so the payload is never assembled
+    size_t text_len = 0;
+    if (job.entries) {
+        if (job.entry_count > PRINT_BATCH_MAX_LABELS) {
+            return SPOOL_APPEND_TOO_LARGE;
+        }
+        for (int i = 0; i < job.entry_count; i++) {
+            text_len += SPOOL_ENTRY_HEADER + strlen(job.entries[i].text) + 1;
+        }
+    } else {
+        text_len = strlen(job.text);
+    }
+    if (text_len > SPOOL_LOG_PAYLOAD_MAX) {
+        return SPOOL_APPEND_TOO_LARGE;
+    }
+    if (!log_file) {
+        return SPOOL_APPEND_IO_ERROR;
+    }
+    if (live_count >= SPOOL_LOG_MAX_LIVE) {
+        return SPOOL_APPEND_FULL;
+    }
+
+    // Make room by dropping completed records; if the live ones alone do
+    // not leave room, the job cannot be made durable
+    size_t size = sizeof(spool_record_t) + text_len;
+    if (log_size + size > max_bytes || index_size + sizeof(spool_index_t) > max_index_bytes) {
+        if (!compact()) {
+            return SPOOL_APPEND_IO_ERROR;
+        }
+        if (log_size + size > max_bytes || index_size + sizeof(spool_index_t) > max_index_bytes) {
+            return SPOOL_APPEND_FULL;
+        }
+    }
+
+    spool_record_t record = {};
+    record.magic = SPOOL_RECORD_MAGIC;
+    record.text_len = (uint16_t)text_len;
+    record.copies = job.copies;
+    record.priority = job.priority;
+    record.entries = job.entries ? job.entry_count : 0;
+    record.client = job.client;
+    if (job.entries) {
+        uint32_t crc = header_crc(&record);
+        for (int i = 0; i < job.entry_count; i++) {
+            uint8_t header[SPOOL_ENTRY_HEADER];
+            entry_header(&job.entries[i], header);
+            crc = crc32_le(crc, header, sizeof(header));
+            crc = crc32_le(crc, (const uint8_t *)job.entries[i].text, strlen(job.entries[i].text) + 1);
+        }
+        record.crc = crc;
+    } else {
+        record.crc = crc32_le(header_crc(&record), (const uint8_t *)job.text, text_len);
+    }
+
+    // Record first, then the index entry that commits it
+    uint32_t offset = log_size;
+    bool ok = fwrite(&record, sizeof(record), 1, log_file) == 1;
+    if (job.entries) {
+        for (int i = 0; ok && i < job.entry_count; i++) {
+            uint8_t header[SPOOL_ENTRY_HEADER];
+            entry_header(&job.entries[i], header);
+            size_t len = strlen(job.entries[i].text) + 1;
+            ok = fwrite(header, 1, sizeof(header), log_file) == sizeof(header) &&
+                 fwrite(job.entries[i].text, 1, len, log_file) == len;
+        }
+    } else {
+        ok = ok && fwrite(job.text, 1, text_len, log_file) == text_len;
+    }
+    ok = ok && sync_file(log_file) && writeIndex(offset, SPOOL_INDEX_COMMITTED);
+    long end = ftell(log_file);
+    log_size = end >= 0 ? (size_t)end : log_size + size;
+    if (!ok) {
+        return SPOOL_APPEND_IO_ERROR;
+    }
+
+    if (next_ref == SPOOL_LOG_NONE) {
+        next_ref = 0;
+    }
+    live[live_count++] = {next_ref, offset, 0};
+    *ref = next_ref++;
+    return SPOOL_APPEND_OK;
+}
+
+bool SpoolLog::complete(uint32_t ref)
+{
+    int i = find(ref);
+    if (i < 0 || !index_file) {
+        return false;
+    }
+    uint32_t offset = live[i].offset;
+    memmove(&live[i], &live[i + 1], (live_count - i - 1) * sizeof(live[0]));
+    live_count--;
+
+    if ((live_count == 0 && log_size >= compact_bytes) ||
+        index_size + sizeof(spool_index_t) > max_index_bytes) {
+        // The record is left out of the copy, which completes it
+        if (compact()) {
+            return true;
+        }
+    }
+    return writeIndex(offset, SPOOL_INDEX_COMPLETED);
+}
+
+bool SpoolLog::checkpoint(uint32_t ref, uint16_t labels_done)
+{
+    int i = find(ref);
+    if (i < 0 || !index_file) {
+        return false;
+    }
+    live[i].labels_done = labels_done;
+
+    // A copy carries the checkpoint over; otherwise it is appended
+    if (index_size + sizeof(spool_index_t) > max_index_bytes && compact()) {
+        return true;
+    }
+    return writeIndex(live[i].offset, SPOOL_INDEX_CHECKPOINT, labels_done);
+}
+
+bool SpoolLog::read(uint32_t ref, spool_job_t *job, char *text_buf, size_t text_len,
+                    print_label_entry_t *entries, uint16_t *labels_done)
+{
+    int i = find(ref);
+    if (i < 0) {
+        return false;
+    }
+
+    FILE *log = fopen(log_path, "rb");
+    spool_record_t record;
+    bool ok = log && read_record(log, live[i].offset, &record, text_buf, text_len) &&
+              (record.entries == 0 || decode_entries(&record, text_buf, entries));
+    if (log) {
+        fclose(log);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    memset(job, 0, sizeof(*job));
+    job->text = text_buf;
+    if (record.entries) {
+        job->entries = entries;
+        job->entry_count = record.entries;
+    }
+    job->copies = record.copies;
+    job->priority = record.priority;
+    job->client = record.client;
+    *labels_done = live[i].labels_done;
+    return true;
+}
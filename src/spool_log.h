@@ -0,0 +1,120 @@
+/*
+ * P-touch ESP32 Spool Log
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPOOL_LOG_H
+#define SPOOL_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "print_batch.h"
+
+#define SPOOL_LOG_MAX_LIVE      32              // Records committed but not completed
+#define SPOOL_LOG_NONE          UINT32_MAX      // Not a record
+#define SPOOL_LOG_PATH_MAX      48
+#define SPOOL_LOG_MAX_FILES     5               // Open at once: log and index, plus three while compacting
+// Largest record payload: a batch's texts plus a 3-byte header per label description
+#define SPOOL_LOG_PAYLOAD_MAX   (PRINT_BATCH_TEXT_MAX + 1 + PRINT_BATCH_MAX_LABELS * 3)
+
+// A job as it is written to and read back from the log
+typedef struct {
+    const char *text;                   // Plain text job
+    const print_label_entry_t *entries; // Batch job, or NULL
+    uint8_t entry_count;
+    uint16_t copies;
+    uint8_t priority;
+    uint32_t client;
+} spool_job_t;
+
+typedef enum {
+    SPOOL_APPEND_OK = 0,
+    SPOOL_APPEND_FULL,                  // No room for it even after compaction
+    SPOOL_APPEND_TOO_LARGE,             // Payload over SPOOL_LOG_PAYLOAD_MAX
+    SPOOL_APPEND_IO_ERROR
+} spool_append_t;
+
+// The files behind the job spool: an append-only log of records and an
+// append-only index that commits, checkpoints and completes them. When the
+// log or the index reach their limit, the live records are copied into a
+// fresh pair of files, which replaces the old pair once the old index has
+// been removed; open() finishes or rolls back a compaction cut short by a
+// reset. Records are named by refs that stay valid across compactions but
+// not across open(). Not thread safe.
+class SpoolLog {
+public:
+    SpoolLog(const char *log_path, const char *index_path, size_t max_bytes,
+             size_t max_index_bytes, size_t compact_bytes);
+    ~SpoolLog();
+
+    // Replay the index and keep the committed, not completed records that
+    // read back intact. A torn index tail or damaged records are cleaned
+    // up by compacting. False if the files cannot be opened.
+    bool open();
+    void close();
+    bool isOpen() const { return log_file != NULL; }
+
+    spool_append_t append(const spool_job_t &job, uint32_t *ref);
+    bool complete(uint32_t ref);
+    bool checkpoint(uint32_t ref, uint16_t labels_done);
+
+    // Copy a live record back. Texts point into text_buf, which should
+    // hold SPOOL_LOG_PAYLOAD_MAX + 1 bytes; a batch's descriptions go to
+    // entries, which must hold PRINT_BATCH_MAX_LABELS.
+    bool read(uint32_t ref, spool_job_t *job, char *text_buf, size_t text_len,
+              print_label_entry_t *entries, uint16_t *labels_done);
+
+    size_t liveCount() const { return live_count; }
+    uint32_t liveRef(size_t i) const { return live[i].ref; }  // Oldest first
+    size_t logBytes() const { return log_size; }
+    size_t indexBytes() const { return index_size; }
+    uint32_t compactions() const { return compaction_count; }
+    uint32_t dropped() const { return dropped_count; }      // Damaged records found by open()
+
+private:
+    struct Live {
+        uint32_t ref;
+        uint32_t offset;                // Record position in the log
+        uint16_t labels_done;           // Latest checkpoint
+    };
+
+    char log_path[SPOOL_LOG_PATH_MAX];
+    char index_path[SPOOL_LOG_PATH_MAX];
+    size_t max_bytes;
+    size_t max_index_bytes;
+    size_t compact_bytes;               // Start over once nothing is live and the log is this big
+
+    FILE *log_file;
+    FILE *index_file;
+    size_t log_size;
+    size_t index_size;
+
+    Live live[SPOOL_LOG_MAX_LIVE];
+    size_t live_count;
+    uint32_t next_ref;
+    uint32_t compaction_count;
+    uint32_t dropped_count;
+    char scratch[SPOOL_LOG_PAYLOAD_MAX + 1];
+
+    int find(uint32_t ref) const;
+    bool openFiles();
+    bool writeIndex(uint32_t offset, uint8_t state, uint16_t labels_done = 0);
+    bool compact();
+    void finishCompaction();
+};
+
+#endif // SPOOL_LOG_H
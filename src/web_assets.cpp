@@ -0,0 +1,189 @@
+/*
+ * P-touch ESP32 Web Assets
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "web_assets.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "web-assets";
+
+#if WEB_ASSETS_EMBEDDED
+// Added by target_add_binary_data in src/CMakeLists.txt
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+extern const uint8_t style_css_gz_start[] asm("_binary_style_css_gz_start");
+extern const uint8_t style_css_gz_end[] asm("_binary_style_css_gz_end");
+extern const uint8_t script_js_gz_start[] asm("_binary_script_js_gz_start");
+extern const uint8_t script_js_gz_end[] asm("_binary_script_js_gz_end");
+#define EMBEDDED(name) name##_gz_start, name##_gz_end
+#else
+#define EMBEDDED(name) NULL, NULL
+#endif
+
+typedef struct {
+    const char *uri;
+    const char *file;
+    const char *type;
+    const uint8_t *embedded;            // gzip copy in rodata, NULL unless embedded
+    const uint8_t *embedded_end;
+    bool has_gzip;                      // file.gz exists
+    char etag[WEB_ASSET_ETAG_LEN];      // Of the gzip copy, or of the plain file without one
+    char plain_etag[WEB_ASSET_ETAG_LEN];
+} web_asset_t;
+
+static web_asset_t assets[] = {
+    {"/",           "index.html", "text/html",              EMBEDDED(index_html), false, "", ""},
+    {"/style.css",  "style.css",  "text/css",               EMBEDDED(style_css),  false, "", ""},
+    {"/script.js",  "script.js",  "application/javascript", EMBEDDED(script_js),  false, "", ""},
+};
+
+// CRC-32 of a whole file, read once at startup
+static bool hash_file(const char *path, uint32_t *crc, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char buffer[WEB_ASSET_CHUNK];
+    size_t bytes_read;
+    *crc = 0;
+    *size = 0;
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        *crc = esp_rom_crc32_le(*crc, (const uint8_t *)buffer, bytes_read);
+        *size += bytes_read;
+    }
+    fclose(file);
+    return true;
+}
+
+static void asset_path(const web_asset_t *asset, bool gzip, char *path, size_t len)
+{
+    snprintf(path, len, "%s/%s%s", WEB_ASSETS_DIR, asset->file, gzip ? ".gz" : "");
+}
+
+static bool client_accepts_gzip(httpd_req_t *req)
+{
+    char value[64];
+    return httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value)) == ESP_OK &&
+           strstr(value, "gzip") != NULL;
+}
+
+// If-None-Match holds the ETag we would send, or "*"
+static bool client_has(httpd_req_t *req, const char *etag)
+{
+    char value[128];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strstr(value, etag) != NULL || strcmp(value, "*") == 0;
+}
+
+static esp_err_t asset_get_handler(httpd_req_t *req)
+{
+    const web_asset_t *asset = (const web_asset_t *)req->user_ctx;
+    bool gzip = asset->embedded || (asset->has_gzip && client_accepts_gzip(req));
+    const char *etag = gzip || !asset->has_gzip ? asset->etag : asset->plain_etag;
+
+    // Always revalidated; the ETag makes that a 304 when nothing changed
+    if (etag[0]) {
+        httpd_resp_set_hdr(req, "ETag", etag);
+    }
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+    if (etag[0] && client_has(req, etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, asset->type);
+    if (gzip) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+    if (asset->embedded) {
+        // Straight from flash, in one go
+        return httpd_resp_send(req, (const char *)asset->embedded, asset->embedded_end - asset->embedded);
+    }
+
+    char path[64];
+    asset_path(asset, gzip, path, sizeof(path));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_FAIL;
+    }
+
+    char buffer[WEB_ASSET_CHUNK];
+    size_t bytes_read;
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        if (httpd_resp_send_chunk(req, buffer, bytes_read) != ESP_OK) {
+            fclose(file);
+            return ESP_FAIL;
+        }
+    }
+
+    fclose(file);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t web_assets_register(httpd_handle_t server)
+{
+    for (web_asset_t &asset : assets) {
+        char path[64];
+        uint32_t crc = 0;
+        size_t size = 0;
+
+        if (asset.embedded) {
+            size = asset.embedded_end - asset.embedded;
+            crc = esp_rom_crc32_le(0, asset.embedded, size);
+            asset.has_gzip = true;
+        } else {
+            asset_path(&asset, true, path, sizeof(path));
+            asset.has_gzip = hash_file(path, &crc, &size);
+        }
+        if (asset.has_gzip) {
+            snprintf(asset.etag, sizeof(asset.etag), "\"%08" PRIx32 "-gz\"", crc);
+            snprintf(asset.plain_etag, sizeof(asset.plain_etag), "\"%08" PRIx32 "\"", crc);
+        } else {
+            asset_path(&asset, false, path, sizeof(path));
+            if (hash_file(path, &crc, &size)) {
+                snprintf(asset.etag, sizeof(asset.etag), "\"%08" PRIx32 "\"", crc);
+            } else {
+                ESP_LOGW(TAG, "%s missing from the filesystem image", asset.file);
+            }
+        }
+        ESP_LOGI(TAG, "%s: %u bytes%s%s", asset.file, (unsigned)size, asset.has_gzip ? " gzipped" : "",
+                 asset.embedded ? ", embedded" : "");
+
+        httpd_uri_t handler = {};
+        handler.uri = asset.uri;
+        handler.method = HTTP_GET;
+        handler.handler = asset_get_handler;
+        handler.user_ctx = &asset;
+        esp_err_t err = httpd_register_uri_handler(server, &handler);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
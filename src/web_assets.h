@@ -0,0 +1,48 @@
+/*
+ * P-touch ESP32 Web Assets
+ * Copyright (C) 2024 tanvach
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// The web UI's files. The filesystem build stores a gzip copy next to each
+// (tools/compress_assets.py), which is what browsers get; the plain file is
+// the fallback for clients without gzip and for older images. Responses
+// carry a strong ETag and Cache-Control: no-cache, so a repeat visit is
+// answered with 304 and no body, and the URLs are not versioned, so a new
+// filesystem image is picked up on the next load rather than after a
+// max-age has run out.
+//
+// Built with -DEMBED_WEB_ASSETS=ON, the gzip copies are compiled into the
+// image instead and each response is one send from memory-mapped flash,
+// with no filesystem access; all clients then get gzip.
+#define WEB_ASSETS_DIR          "/spiffs"
+#define WEB_ASSET_CHUNK         1024
+#define WEB_ASSET_ETAG_LEN      24
+#define WEB_ASSET_MAX_FILES     1       // Open at once; the server task serves one request at a time
+
+// Hash the files and register a handler per asset; call after the
+// filesystem is mounted
+esp_err_t web_assets_register(httpd_handle_t server);
+
+#endif // WEB_ASSETS_H
@@ -0,0 +1,69 @@
+// Host benchmark: json_lite against cJSON on a typical /api/print/text body.
+// Built only when cJSON is installed (see CMakeLists.txt); not part of ctest.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "cJSON.h"
+#include "json_lite.h"
+
+static const char *BODY = "{\"text\":\"Shelf A3 \\u2013 M4 bolts\",\"copies\":12,\"priority\":\"bulk\"}";
+static const int ITERATIONS = 200000;
+
+static size_t allocations = 0;
+
+static void *counting_malloc(size_t size)
+{
+    allocations++;
+    return malloc(size);
+}
+
+template <typename F>
+static double time_ns(F body)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        body();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+}
+
+int main()
+{
+    cJSON_Hooks hooks = {counting_malloc, free};
+    cJSON_InitHooks(&hooks);
+
+    size_t len = strlen(BODY);
+    char buf[128];
+    volatile long sink = 0;
+
+    allocations = 0;
+    double cjson_ns = time_ns([&] {
+        cJSON *doc = cJSON_Parse(BODY);
+        sink += cJSON_GetObjectItem(doc, "copies")->valueint;
+        sink += strlen(cJSON_GetStringValue(cJSON_GetObjectItem(doc, "text")));
+        cJSON_Delete(doc);
+    });
+    size_t cjson_allocs = allocations;
+
+    allocations = 0;
+    double lite_ns = time_ns([&] {
+        memcpy(buf, BODY, len + 1);
+        json_token_t tokens[16];
+        int count = json_parse(buf, len, tokens, 16);
+        long copies = 0;
+        json_token_int(buf, &tokens[json_object_get(buf, tokens, count, 0, "copies")], &copies);
+        int text = json_object_get(buf, tokens, count, 0, "text");
+        char *out = buf + tokens[text].start;
+        json_token_string(buf, &tokens[text], out, tokens[text].end - tokens[text].start + 1);
+        sink += copies + strlen(out);
+    });
+    size_t lite_allocs = allocations;
+
+    printf("%-10s %10s %14s\n", "parser", "ns/parse", "allocs/parse");
+    printf("%-10s %10.0f %14.1f\n", "cJSON", cjson_ns, (double)cjson_allocs / ITERATIONS);
+    printf("%-10s %10.0f %14.1f\n", "json_lite", lite_ns, (double)lite_allocs / ITERATIONS);
+    return 0;
+}
@@ -0,0 +1,202 @@
+// Host benchmark: plain against gzip and deflate bodies for POST /api/print/raster.
+// Built only when zlib is installed (see CMakeLists.txt); not part of ctest.
+//
+//   bench_upload                   sizes and compression ratios only
+//   bench_upload 192.168.1.50 3    also time 3 uploads of each label and encoding end to end
+//
+// Timed runs print real labels.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <zlib.h>
+
+struct Label {
+    const char *name;
+    int width;                          // Pixels across the tape
+    int height;                         // Raster lines
+    std::vector<uint8_t> bitmap;        // Portrait rows, MSB first
+};
+
+static void set_pixel(Label &label, int x, int y)
+{
+    int stride = (label.width + 7) / 8;
+    label.bitmap[y * stride + x / 8] |= 0x80 >> (x % 8);
+}
+
+// Rows of glyph-sized cells with a few strokes each, margins left white:
+// close enough to rendered text for compression ratios
+static Label text_label(const char *name, int width, int height, int lines_of_text)
+{
+    Label label = {name, width, height, std::vector<uint8_t>((size_t)(width + 7) / 8 * height)};
+    uint32_t seed = 12345;
+    int cell = 24;
+    int text_height = (width - 16) / lines_of_text;
+    for (int row = 0; row < lines_of_text; row++) {
+        for (int y0 = 16; y0 + cell < height - 16; y0 += cell) {
+            for (int stroke = 0; stroke < 4; stroke++) {
+                seed = seed * 1103515245 + 12345;
+                int x = 8 + row * text_height + (seed >> 8) % (text_height - 4);
+                int len = 4 + (seed >> 16) % (cell - 6);
+                bool vertical = seed & 1;
+                for (int i = 0; i < len; i++) {
+                    for (int t = 0; t < 3; t++) {
+                        int px = vertical ? x + t : x + i % (text_height - 4);
+                        int py = vertical ? y0 + i : y0 + t + stroke * 5;
+                        if (px < width && py < height) {
+                            set_pixel(label, px, py);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return label;
+}
+
+static Label barcode_label(const char *name, int width, int height)
+{
+    Label label = {name, width, height, std::vector<uint8_t>((size_t)(width + 7) / 8 * height)};
+    uint32_t seed = 777;
+    for (int y = 20; y < height - 20;) {
+        seed = seed * 1103515245 + 12345;
+        int bar = 2 + (seed >> 12) % 6;
+        bool black = (seed >> 20) & 1;
+        for (int i = 0; i < bar && y < height - 20; i++, y++) {
+            for (int x = 10; black && x < width - 10; x++) {
+                set_pixel(label, x, y);
+            }
+        }
+    }
+    return label;
+}
+
+static std::vector<uint8_t> compress(const std::vector<uint8_t> &data, bool gzip, double *ms)
+{
+    z_stream stream = {};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY);
+    std::vector<uint8_t> out(deflateBound(&stream, data.size()));
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+
+    auto start = std::chrono::steady_clock::now();
+    deflate(&stream, Z_FINISH);
+    *ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+// One blocking HTTP/1.1 POST; returns the milliseconds until the reply is in, or -1
+static double post(const char *host, const Label &label, const std::vector<uint8_t> &body, const char *encoding)
+{
+    addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addr = NULL;
+    if (getaddrinfo(host, "80", &hints, &addr) != 0) {
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (sock < 0 || connect(sock, addr->ai_addr, addr->ai_addrlen) != 0) {
+        freeaddrinfo(addr);
+        if (sock >= 0) {
+            close(sock);
+        }
+        return -1;
+    }
+    freeaddrinfo(addr);
+
+    char header[512];
+    int len = snprintf(header, sizeof(header),
+                       "POST /api/print/raster HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n"
+                       "X-Label-Width: %d\r\nX-Label-Height: %d\r\n%s%s%sContent-Length: %zu\r\n\r\n",
+                       host, label.width, label.height, encoding ? "Content-Encoding: " : "",
+                       encoding ? encoding : "", encoding ? "\r\n" : "", body.size());
+    bool ok = send(sock, header, len, 0) == len;
+    for (size_t sent = 0; ok && sent < body.size();) {
+        ssize_t n = send(sock, body.data() + sent, body.size() - sent, 0);
+        ok = n > 0;
+        sent += ok ? n : 0;
+    }
+
+    char reply[512];
+    std::string response;
+    ssize_t n;
+    while (ok && (n = recv(sock, reply, sizeof(reply), 0)) > 0) {
+        response.append(reply, n);
+    }
+    close(sock);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!ok || response.compare(0, 12, "HTTP/1.1 200") != 0) {
+        fprintf(stderr, "  %s upload failed: %.60s\n", encoding ? encoding : "plain", response.c_str());
+        return -1;
+    }
+    return ms;
+}
+
+static double median(std::vector<double> values)
+{
+    if (values.empty()) {
+        return -1;
+    }
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+    const char *host = argc > 1 ? argv[1] : NULL;
+    int runs = argc > 2 ? atoi(argv[2]) : 1;
+
+    std::vector<Label> labels;
+    labels.push_back(text_label("text 12mm x 300", 128, 300, 1));
+    labels.push_back(text_label("text 24mm x 2000", 256, 2000, 3));
+    labels.push_back(barcode_label("barcode 12mm x 800", 128, 800));
+
+    printf("%-20s %9s %9s %9s %8s", "label", "plain B", "gzip B", "deflate B", "zip ms");
+    if (host) {
+        printf(" %9s %9s %11s", "plain ms", "gzip ms", "deflate ms");
+    }
+    printf("\n");
+
+    for (const Label &label : labels) {
+        double gzip_ms = 0, deflate_ms = 0;
+        std::vector<uint8_t> gzip = compress(label.bitmap, true, &gzip_ms);
+        std::vector<uint8_t> deflated = compress(label.bitmap, false, &deflate_ms);
+        printf("%-20s %9zu %9zu %9zu %8.2f", label.name, label.bitmap.size(), gzip.size(),
+               deflated.size(), gzip_ms);
+
+        if (host) {
+            std::vector<double> plain_runs, gzip_runs, deflate_runs;
+            for (int i = 0; i < runs; i++) {
+                double ms;
+                if ((ms = post(host, label, label.bitmap, NULL)) >= 0) {
+                    plain_runs.push_back(ms);
+                }
+                if ((ms = post(host, label, gzip, "gzip")) >= 0) {
+                    gzip_runs.push_back(ms);
+                }
+                if ((ms = post(host, label, deflated, "deflate")) >= 0) {
+                    deflate_runs.push_back(ms);
+                }
+            }
+            printf(" %9.1f %9.1f %11.1f", median(plain_runs), median(gzip_runs), median(deflate_runs));
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef MOCK_ESP_ROM_CRC_H
+#define MOCK_ESP_ROM_CRC_H
+
+// The ROM's CRC-32 matches zlib's: reflected, inverted in and out
+#include <stdint.h>
+#include <zlib.h>
+
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    return (uint32_t)crc32(crc, buf, len);
+}
+
+#endif // MOCK_ESP_ROM_CRC_H
@@ -0,0 +1,110 @@
+#ifndef MOCK_MINIZ_H
+#define MOCK_MINIZ_H
+
+// Host stand-in for the tinfl API in the ESP32 ROM, backed by zlib.
+// Only what src/body_inflate.cpp uses: streaming into a wrapping 32K
+// window, zlib or raw deflate input, and tinfl's status codes. zlib's
+// allocations come from an arena inside the decompressor, so freeing
+// the decompressor mid-stream does not leak, just as with tinfl.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+typedef enum {
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct {
+    mz_uint32 m_state;                  // 0 until the first call, 2 once done
+    z_stream stream;
+    size_t arena_used;
+    alignas(16) uint8_t arena[48 * 1024];   // inflate state and its 32K window
+} tinfl_decompressor;
+
+#define tinfl_init(r) do { (r)->m_state = 0; } while (0)
+
+static inline voidpf mock_tinfl_alloc(voidpf opaque, uInt items, uInt size)
+{
+    tinfl_decompressor *r = (tinfl_decompressor *)opaque;
+    size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+    if (r->arena_used + bytes > sizeof(r->arena)) {
+        return Z_NULL;
+    }
+    voidpf p = r->arena + r->arena_used;
+    r->arena_used += bytes;
+    return p;
+}
+
+static inline void mock_tinfl_free(voidpf opaque, voidpf address)
+{
+    (void)opaque;
+    (void)address;
+}
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next,
+                                            size_t *pIn_buf_size, mz_uint8 *pOut_buf_start,
+                                            mz_uint8 *pOut_buf_next, size_t *pOut_buf_size,
+                                            const mz_uint32 decomp_flags)
+{
+    (void)pOut_buf_start;
+    if (r->m_state == 2) {
+        *pIn_buf_size = 0;
+        *pOut_buf_size = 0;
+        return TINFL_STATUS_DONE;
+    }
+    if (r->m_state == 0) {
+        memset(&r->stream, 0, sizeof(r->stream));
+        r->arena_used = 0;
+        r->stream.zalloc = mock_tinfl_alloc;
+        r->stream.zfree = mock_tinfl_free;
+        r->stream.opaque = r;
+        int bits = (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? 15 : -15;
+        if (inflateInit2(&r->stream, bits) != Z_OK) {
+            return TINFL_STATUS_BAD_PARAM;
+        }
+        r->m_state = 1;
+    }
+
+    r->stream.next_in = (Bytef *)pIn_buf_next;
+    r->stream.avail_in = (uInt)*pIn_buf_size;
+    r->stream.next_out = pOut_buf_next;
+    r->stream.avail_out = (uInt)*pOut_buf_size;
+    int ret = inflate(&r->stream, Z_NO_FLUSH);
+    *pIn_buf_size -= r->stream.avail_in;
+    *pOut_buf_size -= r->stream.avail_out;
+
+    if (ret == Z_STREAM_END) {
+        r->m_state = 2;
+        return TINFL_STATUS_DONE;
+    }
+    if (ret == Z_DATA_ERROR) {
+        return strcmp(r->stream.msg ? r->stream.msg : "", "incorrect data check") == 0 ?
+               TINFL_STATUS_ADLER32_MISMATCH : TINFL_STATUS_FAILED;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return TINFL_STATUS_FAILED;
+    }
+    return r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+#endif // MOCK_MINIZ_H
@@ -0,0 +1,57 @@
+#include "test_runner.h"
+#include "admission.h"
+
+// Tests for print request admission control (src/admission.cpp)
+
+TEST(RateLimiterAllowsBurstThenRefuses) {
+    ClientRateLimiter limiter(60, 3);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(limiter.allow(1, 0));
+    }
+
+    uint32_t wait_ms = 0;
+    ASSERT_FALSE(limiter.allow(1, 0, &wait_ms));
+    ASSERT_EQ(1000u, wait_ms);
+
+    // One token per second at 60 per minute
+    ASSERT_FALSE(limiter.allow(1, 500, &wait_ms));
+    ASSERT_EQ(500u, wait_ms);
+    ASSERT_TRUE(limiter.allow(1, 1000));
+}
+
+TEST(RateLimiterRefillsUnderRapidRetries) {
+    // At 30 per minute a millisecond is worth half a milli-token
+    ClientRateLimiter limiter(30, 1);
+    ASSERT_TRUE(limiter.allow(1, 0));
+    for (int64_t now = 1; now < 2000; now++) {
+        ASSERT_FALSE(limiter.allow(1, now));
+    }
+    ASSERT_TRUE(limiter.allow(1, 2000));
+}
+
+TEST(RateLimiterTracksClientsSeparately) {
+    ClientRateLimiter limiter(60, 1);
+    ASSERT_TRUE(limiter.allow(1, 0));
+    ASSERT_FALSE(limiter.allow(1, 0));
+    ASSERT_TRUE(limiter.allow(2, 0));
+    ASSERT_FALSE(limiter.allow(2, 0));
+}
+
+TEST(RateLimiterRecyclesLeastRecentClient) {
+    ClientRateLimiter limiter(60, 1);
+    for (uint32_t client = 1; client <= ADMISSION_MAX_CLIENTS; client++) {
+        ASSERT_TRUE(limiter.allow(client, client));
+    }
+
+    // A new client evicts client 1, which then comes back with a full bucket
+    ASSERT_TRUE(limiter.allow(100, 20));
+    ASSERT_TRUE(limiter.allow(1, 21));
+    ASSERT_FALSE(limiter.allow(100, 22));
+}
+
+TEST(RetryAfterFromPendingWork) {
+    ASSERT_EQ(1u, admission_retry_after_s(0, 3000));
+    ASSERT_EQ(9u, admission_retry_after_s(3, 3000));
+    ASSERT_EQ(2u, admission_retry_after_s(1, 1001));
+    ASSERT_EQ((uint32_t)ADMISSION_MAX_RETRY_AFTER_S, admission_retry_after_s(100000, 3000));
+}
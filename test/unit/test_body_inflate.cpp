@@ -0,0 +1,226 @@
+#include "test_runner.h"
+#include "body_inflate.h"
+#include <string.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// Tests for gzip and deflate request bodies (src/body_inflate.cpp)
+
+namespace {
+
+// Collects the decoded body
+struct StringConsumer : public BodyConsumer {
+    std::string body;
+    size_t announced = 0;
+
+    bool begin(size_t content_len) override { announced = content_len; return true; }
+    bool consume(const char *data, size_t len) override { body.append(data, len); return true; }
+};
+
+// Label-like payload: long runs with some variety, larger than the window
+std::string sample_body(size_t len)
+{
+    std::string body;
+    for (size_t i = 0; body.size() < len; i++) {
+        body += (i % 7 == 0) ? std::string(40, '\0') : std::string("\x0f\xf0\x3c", 3);
+        body += (char)(i * 31);
+    }
+    body.resize(len);
+    return body;
+}
+
+// zlib stream (window_bits 15) or raw deflate (-15)
+std::vector<uint8_t> deflate_body(const std::string &body, int window_bits)
+{
+    z_stream stream = {};
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    std::vector<uint8_t> out(deflateBound(&stream, body.size()));
+    stream.next_in = (Bytef *)body.data();
+    stream.avail_in = (uInt)body.size();
+    stream.next_out = out.data();
+    stream.avail_out = (uInt)out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+void put_le32(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+// gzip member with every optional header field
+std::vector<uint8_t> gzip_body(const std::string &body)
+{
+    std::vector<uint8_t> out = {0x1f, 0x8b, 8, 0x02 | 0x04 | 0x08 | 0x10, 0, 0, 0, 0, 0, 3};
+    const char extra[] = "AP\x02\x00xy";
+    out.push_back(sizeof(extra) - 1);
+    out.push_back(0);
+    out.insert(out.end(), extra, extra + sizeof(extra) - 1);
+    const char name[] = "label.bin";
+    out.insert(out.end(), name, name + sizeof(name));
+    const char comment[] = "from a test";
+    out.insert(out.end(), comment, comment + sizeof(comment));
+    uint32_t header_crc = (uint32_t)crc32(0, out.data(), (uInt)out.size());
+    out.push_back((uint8_t)header_crc);
+    out.push_back((uint8_t)(header_crc >> 8));
+
+    std::vector<uint8_t> deflated = deflate_body(body, -15);
+    out.insert(out.end(), deflated.begin(), deflated.end());
+    put_le32(out, (uint32_t)crc32(0, (const Bytef *)body.data(), (uInt)body.size()));
+    put_le32(out, (uint32_t)body.size());
+    return out;
+}
+
+// Feed the body in pieces of the given size, as body_read() would
+bool decode(InflateConsumer &inflate, const std::vector<uint8_t> &data, size_t piece)
+{
+    if (!inflate.begin(data.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < data.size(); i += piece) {
+        size_t n = data.size() - i < piece ? data.size() - i : piece;
+        if (!inflate.consume((const char *)data.data() + i, n)) {
+            return false;
+        }
+    }
+    return inflate.end();
+}
+
+} // namespace
+
+TEST(ContentEncodingNames) {
+    content_encoding_t encoding;
+    ASSERT_TRUE(content_encoding_from_name(NULL, &encoding));
+    ASSERT_EQ(CONTENT_ENCODING_IDENTITY, encoding);
+    ASSERT_TRUE(content_encoding_from_name("GZIP", &encoding));
+    ASSERT_EQ(CONTENT_ENCODING_GZIP, encoding);
+    ASSERT_TRUE(content_encoding_from_name("x-gzip", &encoding));
+    ASSERT_EQ(CONTENT_ENCODING_GZIP, encoding);
+    ASSERT_TRUE(content_encoding_from_name("deflate", &encoding));
+    ASSERT_EQ(CONTENT_ENCODING_DEFLATE, encoding);
+    ASSERT_FALSE(content_encoding_from_name("br", &encoding));
+}
+
+TEST(InflateGzipHeaderSplitAcrossReads) {
+    std::string body = sample_body(100000);
+    std::vector<uint8_t> gzip = gzip_body(body);
+
+    // One byte at a time splits every header field, the deflate stream and the trailer
+    const size_t pieces[] = {1, 3, 17, 1436, gzip.size()};
+    for (size_t piece : pieces) {
+        StringConsumer out;
+        InflateConsumer inflate(CONTENT_ENCODING_GZIP, &out, body.size(), body.size());
+        ASSERT_TRUE(decode(inflate, gzip, piece));
+        ASSERT_TRUE(out.body == body);
+        ASSERT_EQ(body.size(), out.announced);
+        ASSERT_EQ(body.size(), inflate.decodedLength());
+    }
+}
+
+TEST(InflateGzipChecksumMismatch) {
+    std::string body = sample_body(5000);
+    std::vector<uint8_t> gzip = gzip_body(body);
+    gzip[gzip.size() - 8] ^= 0x01;
+
+    StringConsumer out;
+    InflateConsumer inflate(CONTENT_ENCODING_GZIP, &out, 0, 65536);
+    ASSERT_FALSE(decode(inflate, gzip, 512));
+    ASSERT_STREQ("gzip checksum mismatch", inflate.error());
+
+    // A wrong size in the trailer is caught the same way
+    gzip = gzip_body(body);
+    gzip[gzip.size() - 4] ^= 0x01;
+    StringConsumer out2;
+    InflateConsumer inflate2(CONTENT_ENCODING_GZIP, &out2, 0, 65536);
+    ASSERT_FALSE(decode(inflate2, gzip, 512));
+    ASSERT_STREQ("gzip checksum mismatch", inflate2.error());
+}
+
+TEST(InflateRejectsOversizedOutput) {
+    // A megabyte of zeros deflates to about a kilobyte
+    std::string body(1 << 20, '\0');
+    std::vector<uint8_t> deflated = deflate_body(body, 15);
+    ASSERT_TRUE(deflated.size() < 4096);
+
+    StringConsumer out;
+    InflateConsumer inflate(CONTENT_ENCODING_DEFLATE, &out, 0, 65536);
+    ASSERT_FALSE(decode(inflate, deflated, deflated.size()));
+    ASSERT_STREQ("Decoded body too large", inflate.error());
+    ASSERT_TRUE(out.body.size() <= 65536 + BODY_INFLATE_WINDOW);
+
+    // More than the announced decoded length, though under max_len
+    StringConsumer out2;
+    InflateConsumer inflate2(CONTENT_ENCODING_DEFLATE, &out2, 1000, body.size());
+    ASSERT_FALSE(decode(inflate2, deflated, deflated.size()));
+    ASSERT_STREQ("Decoded body too large", inflate2.error());
+
+    // And less than announced
+    StringConsumer out3;
+    InflateConsumer inflate3(CONTENT_ENCODING_DEFLATE, &out3, body.size() + 1, body.size() + 1);
+    ASSERT_FALSE(decode(inflate3, deflated, deflated.size()));
+    ASSERT_STREQ("Decoded body has the wrong size", inflate3.error());
+}
+
+TEST(InflateDeflateAcceptsZlibAndRaw) {
+    std::string body = sample_body(70000);
+    const int window_bits[] = {15, -15};
+    for (int bits : window_bits) {
+        std::vector<uint8_t> deflated = deflate_body(body, bits);
+        // A single first byte leaves the zlib header check to the next read
+        const size_t pieces[] = {1, 2, 700};
+        for (size_t piece : pieces) {
+            StringConsumer out;
+            InflateConsumer inflate(CONTENT_ENCODING_DEFLATE, &out, body.size(), body.size());
+            ASSERT_TRUE(decode(inflate, deflated, piece));
+            ASSERT_TRUE(out.body == body);
+        }
+    }
+
+    // A damaged Adler-32 shows the zlib header was parsed, not skipped as raw data
+    std::vector<uint8_t> zlib = deflate_body(body, 15);
+    zlib[zlib.size() - 1] ^= 0x01;
+    StringConsumer out;
+    InflateConsumer inflate(CONTENT_ENCODING_DEFLATE, &out, 0, body.size());
+    ASSERT_FALSE(decode(inflate, zlib, 700));
+    ASSERT_STREQ("Invalid compressed data", inflate.error());
+}
+
+TEST(InflateRejectsDataAfterStream) {
+    std::string body = sample_body(3000);
+
+    std::vector<uint8_t> gzip = gzip_body(body);
+    gzip.push_back(0x1f);
+    StringConsumer out;
+    InflateConsumer inflate(CONTENT_ENCODING_GZIP, &out, 0, 65536);
+    ASSERT_FALSE(decode(inflate, gzip, 256));
+    ASSERT_STREQ("Data after the end of the compressed stream", inflate.error());
+
+    // Trailing bytes arriving with the end of the deflate stream
+    std::vector<uint8_t> deflated = deflate_body(body, -15);
+    deflated.insert(deflated.end(), {'j', 'u', 'n', 'k'});
+    StringConsumer out2;
+    InflateConsumer inflate2(CONTENT_ENCODING_DEFLATE, &out2, 0, 65536);
+    ASSERT_FALSE(decode(inflate2, deflated, deflated.size()));
+    ASSERT_STREQ("Data after the end of the compressed stream", inflate2.error());
+}
+
+TEST(InflateRejectsTruncatedAndForeignData) {
+    std::string body = sample_body(3000);
+    std::vector<uint8_t> gzip = gzip_body(body);
+    gzip.resize(gzip.size() - 3);
+    StringConsumer out;
+    InflateConsumer inflate(CONTENT_ENCODING_GZIP, &out, 0, 65536);
+    ASSERT_FALSE(decode(inflate, gzip, 256));
+    ASSERT_STREQ("Compressed data ends early", inflate.error());
+
+    std::vector<uint8_t> plain(body.begin(), body.begin() + 100);
+    StringConsumer out2;
+    InflateConsumer inflate2(CONTENT_ENCODING_GZIP, &out2, 0, 65536);
+    ASSERT_FALSE(decode(inflate2, plain, plain.size()));
+    ASSERT_STREQ("Not a gzip stream", inflate2.error());
+}
@@ -0,0 +1,137 @@
+#include "test_runner.h"
+#include "body_reader.h"
+#include <string.h>
+#include <string>
+
+// Tests for streaming request body ingestion (src/body_reader.cpp)
+
+namespace {
+
+// Plays back a body in fixed pieces, with timeouts or a close injected
+struct ScriptedSocket {
+    ScriptedSocket(const char *data, size_t len, size_t piece) : data(data), len(len), piece(piece) {}
+
+    const char *data;
+    size_t len;
+    size_t pos = 0;
+    size_t piece;
+    int timeouts_before_each = 0;
+    int timeouts_left = 0;
+    size_t close_at = (size_t)-1;
+    size_t calls = 0;
+};
+
+int scripted_recv(void *ctx, char *buf, size_t len)
+{
+    ScriptedSocket *sock = (ScriptedSocket *)ctx;
+    sock->calls++;
+    if (sock->timeouts_left > 0) {
+        sock->timeouts_left--;
+        return BODY_RECV_TIMEOUT;
+    }
+    sock->timeouts_left = sock->timeouts_before_each;
+    if (sock->pos >= sock->close_at) {
+        return 0;
+    }
+    size_t n = len < sock->piece ? len : sock->piece;
+    if (n > sock->len - sock->pos) {
+        n = sock->len - sock->pos;
+    }
+    memcpy(buf, sock->data + sock->pos, n);
+    sock->pos += n;
+    return (int)n;
+}
+
+class CollectingConsumer : public BodyConsumer {
+public:
+    std::string data;
+    size_t calls = 0;
+    size_t largest = 0;
+    size_t reject_after = (size_t)-1;
+    bool ended = false;
+
+    bool consume(const char *chunk, size_t len) override {
+        calls++;
+        largest = len > largest ? len : largest;
+        data.append(chunk, len);
+        return data.size() <= reject_after;
+    }
+    bool end() override { ended = true; return true; }
+};
+
+}
+
+TEST(BodyReaderDeliversLargeBodyInChunks) {
+    std::string body(5000, 'x');
+    for (size_t i = 0; i < body.size(); i++) {
+        body[i] = (char)('a' + i % 26);
+    }
+    ScriptedSocket sock(body.data(), body.size(), 1460);
+    body_limits_t limits = {8192, 0};
+    CollectingConsumer consumer;
+
+    ASSERT_EQ(BODY_OK, body_read(scripted_recv, &sock, body.size(), &limits, &consumer));
+    ASSERT_TRUE(consumer.data == body);
+    ASSERT_TRUE(consumer.ended);
+    ASSERT_TRUE(consumer.largest <= (size_t)BODY_READ_CHUNK);
+}
+
+TEST(BodyReaderRejectsOversizedBeforeReading) {
+    ScriptedSocket sock("{}", 2, 2);
+    body_limits_t limits = {1, 0};
+    CollectingConsumer consumer;
+
+    ASSERT_EQ(BODY_TOO_LARGE, body_read(scripted_recv, &sock, 2, &limits, &consumer));
+    ASSERT_EQ(0u, sock.calls);
+}
+
+TEST(BodyReaderToleratesShortStalls) {
+    const char *body = "0123456789";
+    ScriptedSocket sock(body, 10, 3);
+    sock.timeouts_before_each = 1;
+    sock.timeouts_left = 1;
+    body_limits_t limits = {64, 2};
+    CollectingConsumer consumer;
+
+    ASSERT_EQ(BODY_OK, body_read(scripted_recv, &sock, 10, &limits, &consumer));
+    ASSERT_TRUE(consumer.data == body);
+
+    // Two silent waits in a row end the upload
+    ScriptedSocket stalled(body, 10, 3);
+    stalled.timeouts_before_each = 2;
+    stalled.timeouts_left = 0;
+    CollectingConsumer partial;
+    ASSERT_EQ(BODY_TIMEOUT, body_read(scripted_recv, &stalled, 10, &limits, &partial));
+    ASSERT_FALSE(partial.ended);
+}
+
+TEST(BodyReaderReportsCloseAndRejection) {
+    const char *body = "0123456789";
+    ScriptedSocket sock(body, 10, 4);
+    sock.close_at = 4;
+    body_limits_t limits = {64, 0};
+    CollectingConsumer consumer;
+    ASSERT_EQ(BODY_CLOSED, body_read(scripted_recv, &sock, 10, &limits, &consumer));
+
+    ScriptedSocket again(body, 10, 4);
+    CollectingConsumer picky;
+    picky.reject_after = 5;
+    ASSERT_EQ(BODY_REJECTED, body_read(scripted_recv, &again, 10, &limits, &picky));
+    ASSERT_EQ(2u, picky.calls);
+}
+
+TEST(BufferConsumerTerminatesAndBounds) {
+    char buf[8];
+    const char *body = "{\"a\":1}";
+    ScriptedSocket sock(body, 7, 2);
+    body_limits_t limits = {64, 0};
+    BufferConsumer consumer(buf, sizeof(buf));
+    ASSERT_EQ(BODY_OK, body_read(scripted_recv, &sock, 7, &limits, &consumer));
+    ASSERT_EQ(7u, consumer.length());
+    ASSERT_EQ(0, strcmp(buf, body));
+
+    // No room for the terminator
+    ScriptedSocket full("12345678", 8, 8);
+    BufferConsumer small(buf, sizeof(buf));
+    ASSERT_EQ(BODY_REJECTED, body_read(scripted_recv, &full, 8, &limits, &small));
+}
@@ -0,0 +1,44 @@
+#include "test_runner.h"
+#include "histogram.h"
+#include <thread>
+#include <vector>
+
+// Tests for the lock-free metrics histogram (src/histogram.h)
+
+static const uint32_t BOUNDS[] = {10, 100, 1000};
+
+TEST(HistogramPlacesSamplesAtUpperBounds) {
+    Histogram<3> histogram(BOUNDS);
+    histogram.record(0);
+    histogram.record(10);                // Bounds are inclusive
+    histogram.record(11);
+    histogram.record(1000);
+    histogram.record(5000);              // Overflow bucket
+
+    ASSERT_EQ(3u, histogram.buckets());
+    ASSERT_EQ(2u, histogram.cumulative(0));
+    ASSERT_EQ(3u, histogram.cumulative(1));
+    ASSERT_EQ(4u, histogram.cumulative(2));
+    ASSERT_EQ(5u, histogram.cumulative(3));
+    ASSERT_EQ(5u, histogram.count());
+    ASSERT_EQ(6021u, histogram.sum());
+}
+
+TEST(HistogramCountsConcurrentRecords) {
+    Histogram<3> histogram(BOUNDS);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&histogram, t]() {
+            for (uint32_t i = 0; i < 10000; i++) {
+                histogram.record(t * 400 + i % 2);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(40000u, histogram.count());
+    ASSERT_EQ(10000u, histogram.cumulative(0));
+    ASSERT_EQ(20000u, histogram.cumulative(2) - histogram.cumulative(0));
+}
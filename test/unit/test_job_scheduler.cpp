@@ -0,0 +1,120 @@
+#include "test_runner.h"
+#include "job_scheduler.h"
+
+// Tests for the label scheduler and wait statistics (src/job_scheduler.cpp)
+
+TEST(SchedulerServesHigherClassFirst) {
+    JobScheduler scheduler;
+    ASSERT_TRUE(scheduler.empty());
+
+    ASSERT_TRUE(scheduler.add(1, PRINT_PRIORITY_BULK, 10, 2));
+    ASSERT_TRUE(scheduler.add(2, PRINT_PRIORITY_INTERACTIVE, 20, 1));
+    ASSERT_EQ(2u, scheduler.pendingLabels(PRINT_PRIORITY_BULK));
+
+    uint32_t job = 0;
+    uint16_t label = 0;
+    print_priority_t priority = PRINT_PRIORITY_COUNT;
+    ASSERT_TRUE(scheduler.next(&job, &label, &priority));
+    ASSERT_EQ(2u, job);
+    ASSERT_EQ(PRINT_PRIORITY_INTERACTIVE, priority);
+
+    ASSERT_TRUE(scheduler.next(&job, &label));
+    ASSERT_EQ(1u, job);
+    ASSERT_EQ(0, label);
+    ASSERT_TRUE(scheduler.next(&job, &label));
+    ASSERT_EQ(1u, job);
+    ASSERT_EQ(1, label);
+    ASSERT_FALSE(scheduler.next(&job, &label));
+    ASSERT_TRUE(scheduler.empty());
+}
+
+TEST(SchedulerInterleavesInteractiveBetweenBatchLabels) {
+    JobScheduler scheduler;
+    uint32_t job = 0;
+    uint16_t label = 0;
+
+    scheduler.add(1, PRINT_PRIORITY_BULK, 10, 100);
+    ASSERT_TRUE(scheduler.next(&job, &label));
+    ASSERT_EQ(0, label);
+
+    // Arrives mid-batch and is printed before the batch's next label
+    scheduler.add(2, PRINT_PRIORITY_INTERACTIVE, 20, 1);
+    ASSERT_TRUE(scheduler.next(&job, &label));
+    ASSERT_EQ(2u, job);
+    ASSERT_TRUE(scheduler.next(&job, &label));
+    ASSERT_EQ(1u, job);
+    ASSERT_EQ(1, label);
+}
+
+TEST(SchedulerRoundRobinsClientsWithinClass) {
+    JobScheduler scheduler;
+    scheduler.add(1, PRINT_PRIORITY_NORMAL, 10, 3);
+    scheduler.add(2, PRINT_PRIORITY_NORMAL, 10, 1);
+    scheduler.add(3, PRINT_PRIORITY_NORMAL, 20, 2);
+
+    const uint32_t expected[] = {1, 3, 1, 3, 1, 2};
+    uint32_t job = 0;
+    uint16_t label = 0;
+    for (uint32_t id : expected) {
+        ASSERT_TRUE(scheduler.next(&job, &label));
+        ASSERT_EQ(id, job);
+    }
+    ASSERT_TRUE(scheduler.empty());
+}
+
+TEST(SchedulerRemoveDropsRemainingLabels) {
+    JobScheduler scheduler;
+    scheduler.add(1, PRINT_PRIORITY_NORMAL, 10, 5);
+    scheduler.add(2, PRINT_PRIORITY_NORMAL, 20, 1);
+
+    scheduler.remove(1);
+    ASSERT_EQ(1u, scheduler.pendingLabels(PRINT_PRIORITY_NORMAL));
+
+    uint32_t job = 0;
+    uint16_t label = 0;
+    ASSERT_TRUE(scheduler.next(&job, &label));
+    ASSERT_EQ(2u, job);
+    ASSERT_FALSE(scheduler.next(&job, &label));
+}
+
+TEST(SchedulerResumesAtFirstUnprintedLabel) {
+    JobScheduler scheduler;
+    ASSERT_FALSE(scheduler.add(1, PRINT_PRIORITY_NORMAL, 10, 5, 5));
+
+    ASSERT_TRUE(scheduler.add(1, PRINT_PRIORITY_NORMAL, 10, 5, 3));
+    ASSERT_EQ(2u, scheduler.pendingLabels(PRINT_PRIORITY_NORMAL));
+
+    uint32_t job = 0;
+    uint16_t label = 0;
+    ASSERT_TRUE(scheduler.next(&job, &label));
+    ASSERT_EQ(3, label);
+    ASSERT_TRUE(scheduler.next(&job, &label));
+    ASSERT_EQ(4, label);
+    ASSERT_FALSE(scheduler.next(&job, &label));
+}
+
+TEST(PriorityNamesRoundTrip) {
+    for (int i = 0; i < PRINT_PRIORITY_COUNT; i++) {
+        print_priority_t parsed = PRINT_PRIORITY_COUNT;
+        ASSERT_TRUE(print_priority_from_name(print_priority_name((print_priority_t)i), &parsed));
+        ASSERT_EQ(i, (int)parsed);
+    }
+    print_priority_t parsed;
+    ASSERT_FALSE(print_priority_from_name("urgent", &parsed));
+    ASSERT_FALSE(print_priority_from_name(nullptr, &parsed));
+}
+
+TEST(WaitStatsPercentiles) {
+    WaitStats stats;
+    ASSERT_EQ(0u, stats.percentile(50));
+
+    for (uint32_t ms = 1; ms <= 100; ms++) {
+        stats.record(ms);
+    }
+    // Only the last WINDOW samples (37..100) are kept
+    ASSERT_EQ(WaitStats::WINDOW, stats.samples());
+    ASSERT_EQ(100u, stats.recorded());
+    ASSERT_EQ(68u, stats.percentile(50));
+    ASSERT_EQ(94u, stats.percentile(90));
+    ASSERT_EQ(100u, stats.percentile(99));
+}
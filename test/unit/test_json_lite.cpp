@@ -0,0 +1,131 @@
+#include "test_runner.h"
+#include "json_lite.h"
+#include <string>
+#include <string.h>
+
+// Tests for the zero-allocation JSON tokenizer and writer (src/json_lite.cpp)
+
+TEST(JsonParseFindsObjectMembers) {
+    const char *js = "{\"text\": \"Hi\", \"opts\": {\"a\": [1, 2, {\"b\": null}]}, \"copies\": 3}";
+    json_token_t tokens[16];
+    int count = json_parse(js, strlen(js), tokens, 16);
+    ASSERT_EQ(14, count);
+    ASSERT_EQ(JSON_OBJECT, tokens[0].type);
+    ASSERT_EQ(3, tokens[0].size);
+
+    // The nested object is skipped as a whole
+    int copies = json_object_get(js, tokens, count, 0, "copies");
+    ASSERT_TRUE(copies > 0);
+    long value = 0;
+    ASSERT_TRUE(json_token_int(js, &tokens[copies], &value));
+    ASSERT_EQ(3, value);
+
+    char text[8];
+    int t = json_object_get(js, tokens, count, 0, "text");
+    ASSERT_TRUE(json_token_string(js, &tokens[t], text, sizeof(text)));
+    ASSERT_EQ(std::string("Hi"), std::string(text));
+
+    ASSERT_EQ(-1, json_object_get(js, tokens, count, 0, "missing"));
+    ASSERT_EQ(-1, json_object_get(js, tokens, count, 0, "b"));
+}
+
+TEST(JsonParseRejectsMalformedInput) {
+    json_token_t tokens[8];
+    ASSERT_EQ(JSON_ERROR_INVAL, json_parse("{\"a\" 1}", 7, tokens, 8));
+    ASSERT_EQ(JSON_ERROR_INVAL, json_parse("[1,]", 4, tokens, 8));
+    ASSERT_EQ(JSON_ERROR_INVAL, json_parse("{\"a\":01}", 8, tokens, 8));
+    ASSERT_EQ(JSON_ERROR_INVAL, json_parse("{} x", 4, tokens, 8));
+    ASSERT_EQ(JSON_ERROR_INVAL, json_parse("\"bad \\q\"", 8, tokens, 8));
+    ASSERT_EQ(JSON_ERROR_PART, json_parse("{\"a\": [1, 2", 11, tokens, 8));
+    ASSERT_EQ(JSON_ERROR_PART, json_parse("tru", 3, tokens, 8));
+    ASSERT_EQ(JSON_ERROR_NOMEM, json_parse("[1, 2, 3]", 9, tokens, 3));
+
+    std::string deep(JSON_MAX_DEPTH + 1, '[');
+    deep += std::string(JSON_MAX_DEPTH + 1, ']');
+    json_token_t many[64];
+    ASSERT_EQ(JSON_ERROR_INVAL, json_parse(deep.c_str(), deep.size(), many, 64));
+}
+
+TEST(JsonTokenValuesAreChecked) {
+    const char *js = "[\"caf\\u00e9 \\\"x\\\"\\n\", \"\\ud83d\\ude00\", 2.5, -7, true, \"long string\"]";
+    json_token_t tokens[8];
+    ASSERT_EQ(7, json_parse(js, strlen(js), tokens, 8));
+
+    char buf[16];
+    ASSERT_TRUE(json_token_string(js, &tokens[1], buf, sizeof(buf)));
+    ASSERT_EQ(std::string("caf\xc3\xa9 \"x\"\n"), std::string(buf));
+    ASSERT_TRUE(json_token_string(js, &tokens[2], buf, sizeof(buf)));
+    ASSERT_EQ(std::string("\xf0\x9f\x98\x80"), std::string(buf));
+
+    long value = 0;
+    ASSERT_FALSE(json_token_int(js, &tokens[3], &value));
+    ASSERT_TRUE(json_token_int(js, &tokens[4], &value));
+    ASSERT_EQ(-7, value);
+    ASSERT_FALSE(json_token_int(js, &tokens[1], &value));
+
+    bool flag = false;
+    ASSERT_TRUE(json_token_bool(js, &tokens[5], &flag));
+    ASSERT_TRUE(flag);
+
+    // Does not fit, including the terminator
+    char small[11];
+    ASSERT_FALSE(json_token_string(js, &tokens[6], small, sizeof(small)));
+}
+
+TEST(JsonWriterBuildsNestedDocument) {
+    char buf[128];
+    JsonWriter out(buf, sizeof(buf));
+    out.beginObject();
+    out.number("id", 42);
+    out.string("text", "a \"b\"\n\x01");
+    out.beginArray("list");
+    out.number(1);
+    out.boolean(false);
+    out.beginObject();
+    out.endObject();
+    out.null();
+    out.endArray();
+    out.boolean("ok", true);
+    out.endObject();
+    ASSERT_TRUE(out.finish());
+    ASSERT_EQ(std::string("{\"id\":42,\"text\":\"a \\\"b\\\"\\n\\u0001\",\"list\":[1,false,{},null],\"ok\":true}"),
+              std::string(buf));
+    ASSERT_EQ(strlen(buf), out.length());
+
+    // Output that does not fit, or unbalanced brackets, is an error
+    char tiny[8];
+    JsonWriter small(tiny, sizeof(tiny));
+    small.beginObject();
+    small.string("text", "too long");
+    small.endObject();
+    ASSERT_FALSE(small.finish());
+
+    JsonWriter open(buf, sizeof(buf));
+    open.beginArray();
+    ASSERT_FALSE(open.finish());
+}
+
+static bool append_sink(void *ctx, const char *data, size_t len)
+{
+    std::string *out = (std::string *)ctx;
+    out->append(data, len);
+    return true;
+}
+
+TEST(JsonWriterStreamsThroughSink) {
+    std::string streamed;
+    JsonWriter out(append_sink, &streamed);
+    out.beginArray();
+    for (int i = 0; i < 200; i++) {
+        out.string("label");
+    }
+    out.endArray();
+    ASSERT_TRUE(out.finish());
+    ASSERT_EQ(out.length(), streamed.size());
+    ASSERT_EQ(1u + 200u * 8u - 1u + 1u, streamed.size());
+
+    // And reads back
+    json_token_t tokens[256];
+    ASSERT_EQ(201, json_parse(streamed.c_str(), streamed.size(), tokens, 256));
+    ASSERT_EQ(200, tokens[0].size);
+}
@@ -0,0 +1,122 @@
+#include "test_runner.h"
+#include "print_batch.h"
+#include <string.h>
+#include <string>
+
+// Tests for the incremental batch request parser (src/print_batch.cpp)
+
+static bool feed_in_pieces(BatchParser &parser, const std::string &body, size_t piece)
+{
+    for (size_t i = 0; i < body.size(); i += piece) {
+        if (!parser.consume(body.data() + i, std::min(piece, body.size() - i))) {
+            return false;
+        }
+    }
+    return parser.end();
+}
+
+TEST(BatchParserReadsLabelsAcrossChunks) {
+    std::string body =
+        "{\"priority\": \"bulk\", \"labels\": [\n"
+        "  {\"text\": \"Shelf {A}\", \"copies\": 2, \"cut\": \"end\"},\n"
+        "  {\"text\": \"Caf\\u00e9 \\\"B\\\"\", \"extra\": [1, {\"x\": \"]\"}]}\n"
+        "], \"note\": {\"nested\": [true]}}";
+
+    for (size_t piece = 1; piece <= 7; piece += 3) {
+        BatchParser *parser = new BatchParser();
+        ASSERT_TRUE(feed_in_pieces(*parser, body, piece));
+        ASSERT_EQ(2u, parser->count());
+        ASSERT_EQ(3, parser->copies());
+        ASSERT_TRUE(parser->hasPriority());
+        ASSERT_EQ(PRINT_PRIORITY_BULK, parser->priority());
+
+        const print_label_entry_t *entries = parser->entries();
+        ASSERT_EQ(0, strcmp("Shelf {A}", entries[0].text));
+        ASSERT_EQ(2, entries[0].copies);
+        ASSERT_EQ(PRINT_CUT_END, entries[0].cut);
+        ASSERT_EQ(0, strcmp("Caf\xc3\xa9 \"B\"", entries[1].text));
+        ASSERT_EQ(1, entries[1].copies);
+        ASSERT_EQ(PRINT_CUT_NONE, entries[1].cut);
+        delete parser;
+    }
+}
+
+TEST(BatchParserReportsTheFaultyLabel) {
+    BatchParser *parser = new BatchParser();
+    std::string body = "{\"labels\": [{\"text\": \"ok\"}, {\"text\": \"x\", \"copies\": 0}]}";
+    ASSERT_FALSE(feed_in_pieces(*parser, body, body.size()));
+    ASSERT_EQ(1, parser->errorIndex());
+    ASSERT_TRUE(strcmp("Invalid copies", parser->error()) == 0);
+    delete parser;
+
+    parser = new BatchParser();
+    body = "{\"labels\": [{\"copies\": 1}]}";
+    ASSERT_FALSE(feed_in_pieces(*parser, body, body.size()));
+    ASSERT_EQ(0, parser->errorIndex());
+    delete parser;
+
+    parser = new BatchParser();
+    body = "{\"labels\": [{\"text\": \"a\", \"cut\": \"sometimes\"}]}";
+    ASSERT_FALSE(feed_in_pieces(*parser, body, body.size()));
+    ASSERT_TRUE(strcmp("Invalid cut", parser->error()) == 0);
+    delete parser;
+}
+
+TEST(BatchParserEnforcesLimits) {
+    // Each description is within limits, the batch as a whole is not
+    std::string body = "{\"labels\": [";
+    for (int i = 0; i < 3; i++) {
+        body += std::string(i ? "," : "") + "{\"text\": \"t\", \"copies\": 200}";
+    }
+    body += "]}";
+    BatchParser *parser = new BatchParser();
+    ASSERT_FALSE(feed_in_pieces(*parser, body, 64));
+    ASSERT_EQ(2, parser->errorIndex());
+    delete parser;
+
+    body = "{\"labels\": [";
+    for (int i = 0; i <= PRINT_BATCH_MAX_LABELS; i++) {
+        body += std::string(i ? "," : "") + "{\"text\": \"t\"}";
+    }
+    body += "]}";
+    parser = new BatchParser();
+    ASSERT_FALSE(feed_in_pieces(*parser, body, 64));
+    ASSERT_EQ(PRINT_BATCH_MAX_LABELS, parser->errorIndex());
+    delete parser;
+
+    // Texts share one budget
+    std::string text(600, 'x');
+    body = "{\"labels\": [{\"text\": \"" + text + "\"}, {\"text\": \"" + text + "\"}]}";
+    parser = new BatchParser();
+    ASSERT_FALSE(feed_in_pieces(*parser, body, 100));
+    ASSERT_EQ(1, parser->errorIndex());
+    delete parser;
+}
+
+TEST(BatchParserRejectsMalformedBodies) {
+    const char *bodies[] = {
+        "[]",
+        "{\"labels\": {}}",
+        "{\"labels\": []}",
+        "{\"labels\": [{\"text\": \"a\"}]",
+        "{\"labels\": [{\"text\": \"a\"}]} x",
+        "{\"priority\": \"urgent\", \"labels\": [{\"text\": \"a\"}]}",
+        "{\"labels\": [\"a\"]}",
+    };
+    for (const char *body : bodies) {
+        BatchParser *parser = new BatchParser();
+        ASSERT_FALSE(feed_in_pieces(*parser, body, 5));
+        ASSERT_TRUE(parser->error() != nullptr);
+        delete parser;
+    }
+}
+
+TEST(CutNamesRoundTrip) {
+    for (int i = PRINT_CUT_NONE; i <= PRINT_CUT_END; i++) {
+        print_cut_t cut = PRINT_CUT_NONE;
+        ASSERT_TRUE(print_cut_from_name(print_cut_name((print_cut_t)i), &cut));
+        ASSERT_EQ(i, (int)cut);
+    }
+    print_cut_t cut;
+    ASSERT_FALSE(print_cut_from_name("never", &cut));
+}
@@ -0,0 +1,79 @@
+#include "test_runner.h"
+#include "printer_mailbox.h"
+#include <thread>
+#include <vector>
+
+// Tests for the lock-free printer command mailbox (src/printer_mailbox.h)
+
+TEST(MailboxPushPopPreservesOrder) {
+    PrinterMailbox<int, 8> mailbox;
+    ASSERT_TRUE(mailbox.empty());
+
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(mailbox.push(i));
+    }
+    ASSERT_FALSE(mailbox.empty());
+
+    int value = -1;
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(mailbox.pop(value));
+        ASSERT_EQ(i, value);
+    }
+    ASSERT_FALSE(mailbox.pop(value));
+    ASSERT_TRUE(mailbox.empty());
+}
+
+TEST(MailboxRejectsPushWhenFull) {
+    PrinterMailbox<int, 4> mailbox;
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(mailbox.push(i));
+    }
+    ASSERT_FALSE(mailbox.push(99));
+
+    // Freeing one slot makes room again, including across the wrap point
+    int value = 0;
+    ASSERT_TRUE(mailbox.pop(value));
+    ASSERT_TRUE(mailbox.push(4));
+    for (int expected = 1; expected <= 4; expected++) {
+        ASSERT_TRUE(mailbox.pop(value));
+        ASSERT_EQ(expected, value);
+    }
+}
+
+TEST(MailboxConcurrentProducersDeliverEveryCommand) {
+    const int producers = 4;
+    const int per_producer = 5000;
+    PrinterMailbox<int, 16> mailbox;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&mailbox, p]() {
+            for (int i = 0; i < per_producer; i++) {
+                while (!mailbox.push(p * per_producer + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Single consumer: every command arrives once, in order per producer
+    std::vector<int> last_seen(producers, -1);
+    int received = 0;
+    while (received < producers * per_producer) {
+        int value;
+        if (!mailbox.pop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        int p = value / per_producer;
+        int seq = value % per_producer;
+        ASSERT_EQ(last_seen[p] + 1, seq);
+        last_seen[p] = seq;
+        received++;
+    }
+
+    for (auto &t : threads) {
+        t.join();
+    }
+    ASSERT_TRUE(mailbox.empty());
+}
@@ -1,10 +1,104 @@
 #include "test_runner.h"
 #include "test_data.h"
+#include "ptouch_protocol.h"
+#include <vector>
 
-// Placeholder tests for protocol parsing
-// TODO: Implement actual protocol parsing tests
+// Tests for the raster protocol parser (components/ptouch-esp32/src/ptouch_protocol.c)
 
-TEST(protocol_parsing_placeholder) {
-    // Simple placeholder test
-    ASSERT_TRUE(true);
-} 
\ No newline at end of file
+// Invalidate, init, raster mode, compression, a line holding 0x1A, an empty line, then eject
+static const uint8_t JOB[] = {
+    0x00, 0x00, 0x1B, '@', 0x1B, 'i', 'a', 0x01, 0x1B, 'i', 'z', 0x84, 0x00, 0x0C, 0x00,
+    0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 'M', 0x02, 'G', 0x03, 0x00, 0x02, 0x1A, 0x0C,
+    'Z', 0x1A,
+};
+
+static const ptouch_protocol_cmd_t JOB_COMMANDS[] = {
+    PTOUCH_CMD_INVALIDATE, PTOUCH_CMD_INVALIDATE, PTOUCH_CMD_INIT, PTOUCH_CMD_RASTER_START,
+    PTOUCH_CMD_INFO, PTOUCH_CMD_COMPRESSION, PTOUCH_CMD_RASTER_LINE, PTOUCH_CMD_ZERO_LINE,
+    PTOUCH_CMD_FINALIZE,
+};
+
+// Feed data in buffers of at most chunk bytes; collect commands and line data
+static void parse(const uint8_t *data, size_t len, size_t chunk,
+                  std::vector<ptouch_protocol_cmd_t> *commands, size_t *line_data)
+{
+    ptouch_parser_t parser;
+    ptouch_parser_init(&parser, NULL, 0);
+    *line_data = 0;
+    for (size_t pos = 0; pos < len; pos += chunk) {
+        size_t end = pos + chunk < len ? pos + chunk : len;
+        size_t i = pos;
+        while (i < end) {
+            size_t used;
+            ptouch_parse_event_t event = ptouch_parser_step(&parser, data + i, end - i, &used);
+            i += used;
+            if (event == PTOUCH_PARSE_COMMAND) {
+                commands->push_back(parser.def->type);
+            } else if (event == PTOUCH_PARSE_DATA) {
+                *line_data += used;
+            } else if (event == PTOUCH_PARSE_ERROR) {
+                commands->push_back(PTOUCH_CMD_UNKNOWN);
+            }
+        }
+    }
+}
+
+TEST(ProtocolParserSplitsCoalescedBuffer) {
+    std::vector<ptouch_protocol_cmd_t> commands;
+    size_t line_data;
+    parse(JOB, sizeof(JOB), sizeof(JOB), &commands, &line_data);
+
+    ASSERT_EQ(sizeof(JOB_COMMANDS) / sizeof(JOB_COMMANDS[0]), commands.size());
+    for (size_t i = 0; i < commands.size(); i++) {
+        ASSERT_EQ(JOB_COMMANDS[i], commands[i]);
+    }
+    ASSERT_EQ(3u, line_data);
+}
+
+TEST(ProtocolParserCarriesStateAcrossTransfers) {
+    for (size_t chunk = 1; chunk < sizeof(JOB); chunk++) {
+        std::vector<ptouch_protocol_cmd_t> commands;
+        size_t line_data;
+        parse(JOB, sizeof(JOB), chunk, &commands, &line_data);
+        ASSERT_EQ(sizeof(JOB_COMMANDS) / sizeof(JOB_COMMANDS[0]), commands.size());
+        ASSERT_EQ(PTOUCH_CMD_RASTER_LINE, commands[6]);
+        ASSERT_EQ(PTOUCH_CMD_FINALIZE, commands.back());
+        ASSERT_EQ(3u, line_data);
+    }
+}
+
+TEST(ProtocolParserReadsArgumentsAndLengths) {
+    ptouch_parser_t parser;
+    ptouch_parser_init(&parser, NULL, 0);
+
+    const uint8_t margin[] = {0x1B, 'i', 'd', 0x0E, 0x00};
+    size_t used;
+    ASSERT_EQ(PTOUCH_PARSE_COMMAND, ptouch_parser_step(&parser, margin, sizeof(margin), &used));
+    ASSERT_EQ(sizeof(margin), used);
+    ASSERT_EQ(PTOUCH_CMD_MARGIN, parser.def->type);
+    ASSERT_EQ(0x0E, parser.args[0]);
+    ASSERT_TRUE(ptouch_parser_idle(&parser));
+
+    // 'G' has a 16-bit length, 'g' a zero byte and then the length
+    const uint8_t wide[] = {'G', 0x02, 0x01};
+    ASSERT_EQ(PTOUCH_PARSE_COMMAND, ptouch_parser_step(&parser, wide, sizeof(wide), &used));
+    ASSERT_EQ(258u, parser.length);
+    ASSERT_FALSE(ptouch_parser_idle(&parser));
+    ptouch_parser_reset(&parser);
+
+    const uint8_t legacy[] = {'g', 0x00, 0x05};
+    ASSERT_EQ(PTOUCH_PARSE_COMMAND, ptouch_parser_step(&parser, legacy, sizeof(legacy), &used));
+    ASSERT_EQ(5u, parser.length);
+}
+
+TEST(ProtocolParserResynchronisesAfterUnknownCommand) {
+    const uint8_t stream[] = {0x1B, 'i', 'Q', 0x7F, 0x0C};
+    std::vector<ptouch_protocol_cmd_t> commands;
+    size_t line_data;
+    parse(stream, sizeof(stream), sizeof(stream), &commands, &line_data);
+
+    ASSERT_EQ(3u, commands.size());
+    ASSERT_EQ(PTOUCH_CMD_UNKNOWN, commands[0]);
+    ASSERT_EQ(PTOUCH_CMD_UNKNOWN, commands[1]);
+    ASSERT_EQ(PTOUCH_CMD_PRINT, commands[2]);
+}
@@ -0,0 +1,120 @@
+#include "test_runner.h"
+#include "raster_format.h"
+
+// Tests for raster upload validation and rotation (src/raster_format.cpp)
+
+TEST(RasterValidatorAcceptsPackBitsLines) {
+    // 16-byte lines: a literal of 2, a run of 14 zeros, then an empty line
+    const uint8_t stream[] = {
+        'G', 5, 0, 0x01, 0xAA, 0x55, 0xF3, 0x00,
+        'Z',
+    };
+    RasterStreamValidator validator(16, true, 2);
+    ASSERT_TRUE(validator.feed(stream, sizeof(stream)));
+    ASSERT_TRUE(validator.complete());
+    ASSERT_EQ(2u, validator.lines());
+}
+
+TEST(RasterValidatorCarriesStateAcrossBuffers) {
+    const uint8_t stream[] = {'G', 4, 0, 0x02, 1, 2, 3, 'G', 2, 0, 0xFE, 0xFF};
+    RasterStreamValidator validator(16, true, 10);
+    for (size_t i = 0; i < sizeof(stream); i++) {
+        ASSERT_TRUE(validator.feed(&stream[i], 1));
+        ASSERT_EQ(i == 6 || i == 11, validator.complete());
+    }
+    ASSERT_EQ(2u, validator.lines());
+}
+
+TEST(RasterValidatorRejectsMalformedStreams) {
+    // Decodes to 17 bytes on a 16-byte head
+    const uint8_t too_wide[] = {'G', 2, 0, 0xF0, 0x00};
+    RasterStreamValidator wide(16, true, 10);
+    ASSERT_FALSE(wide.feed(too_wide, sizeof(too_wide)));
+    ASSERT_TRUE(wide.error() != nullptr);
+
+    // Literal of 4 in a 3-byte line
+    const uint8_t overrun[] = {'G', 3, 0, 0x03, 1, 2};
+    RasterStreamValidator run(16, true, 10);
+    ASSERT_FALSE(run.feed(overrun, sizeof(overrun)));
+
+    const uint8_t unknown[] = {0x1B, 0x69};
+    RasterStreamValidator command(16, true, 10);
+    ASSERT_FALSE(command.feed(unknown, sizeof(unknown)));
+
+    const uint8_t extra[] = {'Z', 'Z'};
+    RasterStreamValidator lines(16, true, 1);
+    ASSERT_FALSE(lines.feed(extra, sizeof(extra)));
+
+    // Uncompressed lines are only checked for width
+    const uint8_t raw[] = {'G', 3, 0, 0xFF, 0xFF, 0xFF};
+    RasterStreamValidator plain(2, false, 10);
+    ASSERT_FALSE(plain.feed(raw, sizeof(raw)));
+    RasterStreamValidator fits(4, false, 10);
+    ASSERT_TRUE(fits.feed(raw, sizeof(raw)));
+    ASSERT_TRUE(fits.complete());
+
+    // A truncated stream is not complete
+    RasterStreamValidator partial(16, true, 10);
+    ASSERT_TRUE(partial.feed(raw, 4));
+    ASSERT_FALSE(partial.complete());
+}
+
+TEST(RasterRotateLineTakesColumnBottomUp) {
+    // 10 x 3 bitmap, two bytes per row; column 9 has its top and bottom pixels set
+    const uint8_t bitmap[] = {
+        0x00, 0x40,
+        0x00, 0x00,
+        0x80, 0x40,
+    };
+    uint8_t line[1];
+    raster_rotate_line(bitmap, 10, 3, 9, line);
+    ASSERT_EQ(0xA0, line[0]);
+    raster_rotate_line(bitmap, 10, 3, 0, line);
+    ASSERT_EQ(0x80, line[0]);
+}
+
+TEST(RasterOrientationNames) {
+    raster_orientation_t orientation = RASTER_ORIENTATION_PORTRAIT;
+    ASSERT_TRUE(raster_orientation_from_name("landscape", &orientation));
+    ASSERT_EQ(RASTER_ORIENTATION_LANDSCAPE, orientation);
+    ASSERT_TRUE(raster_orientation_from_name("portrait", &orientation));
+    ASSERT_EQ(RASTER_ORIENTATION_PORTRAIT, orientation);
+    ASSERT_FALSE(raster_orientation_from_name("sideways", &orientation));
+    ASSERT_FALSE(raster_orientation_from_name(nullptr, &orientation));
+}
+
+TEST(RasterJobScannerSplitsJobsAtPrintFeed) {
+    // Invalidate, init, raster mode, margin, a line holding 0x1A, a page, then the last page
+    const uint8_t stream[] = {
+        0x00, 0x00, 0x1B, '@', 0x1B, 'i', 'a', 0x01, 0x1B, 'i', 'd', 0x0E, 0x00,
+        'M', 0x02, 'G', 0x02, 0x00, 0x1A, 0x0C, 'Z', 0x0C,
+        'g', 0x00, 0x01, 0x1A, 0x1A,
+        0x1B, '@',
+    };
+    RasterJobScanner scanner;
+    size_t first = scanner.scan(stream, sizeof(stream));
+    ASSERT_EQ(sizeof(stream) - 2, first);
+    ASSERT_TRUE(scanner.jobEnded());
+    ASSERT_EQ(2u, scanner.pages());
+
+    // Nothing more is taken until the next job starts
+    ASSERT_EQ(0u, scanner.scan(stream + first, 2));
+    scanner.reset();
+    ASSERT_EQ(2u, scanner.scan(stream + first, 2));
+    ASSERT_FALSE(scanner.jobEnded());
+}
+
+TEST(RasterJobScannerCarriesStateAcrossBuffers) {
+    const uint8_t stream[] = {0x1B, 'i', 'z', 0x1A, 1, 2, 3, 4, 5, 6, 7, 8, 9, 'G', 1, 0, 0x1A, 0x1A};
+    RasterJobScanner scanner;
+    for (size_t i = 0; i < sizeof(stream); i++) {
+        ASSERT_EQ(1u, scanner.scan(&stream[i], 1));
+        ASSERT_EQ(i == sizeof(stream) - 1, scanner.jobEnded());
+    }
+
+    const uint8_t unknown[] = {0x1B, 'i', 'Q', 0x00};
+    scanner.reset();
+    scanner.scan(unknown, sizeof(unknown));
+    ASSERT_TRUE(scanner.failed());
+    ASSERT_TRUE(scanner.error() != nullptr);
+}
@@ -0,0 +1,68 @@
+#include "test_runner.h"
+#include "seqlock.h"
+#include <thread>
+#include <atomic>
+
+// Tests for the status snapshot sequence lock (src/seqlock.h)
+
+struct Snapshot {
+    uint32_t values[16];
+};
+
+TEST(SeqLockReadsLastStoredValue) {
+    SeqLock<Snapshot> lock;
+    ASSERT_EQ(0u, lock.version());
+
+    Snapshot snap;
+    for (int i = 0; i < 16; i++) {
+        snap.values[i] = 7;
+    }
+    lock.store(snap);
+    ASSERT_EQ(1u, lock.version());
+
+    uint32_t first = 0;
+    ASSERT_TRUE(lock.tryRead([&first](const Snapshot &s) { first = s.values[0]; }));
+    ASSERT_EQ(7u, first);
+}
+
+TEST(SeqLockRejectsReadOverlappingWrite) {
+    SeqLock<Snapshot> lock;
+    Snapshot snap = {};
+
+    // A write landing during the copy invalidates it
+    bool ok = lock.tryRead([&](const Snapshot &) { lock.store(snap); });
+    ASSERT_FALSE(ok);
+    ASSERT_TRUE(lock.tryRead([](const Snapshot &) {}));
+}
+
+TEST(SeqLockConcurrentReadersNeverSeeTornSnapshots) {
+    SeqLock<Snapshot> lock;
+    std::atomic<bool> stop(false);
+
+    std::thread writer([&]() {
+        Snapshot snap;
+        for (uint32_t n = 1; n <= 20000; n++) {
+            for (int i = 0; i < 16; i++) {
+                snap.values[i] = n;
+            }
+            lock.store(snap);
+        }
+        stop.store(true);
+    });
+
+    // Every accepted copy holds one write's values throughout
+    int accepted = 0;
+    while (!stop.load() || accepted == 0) {
+        Snapshot copy;
+        if (!lock.tryRead([&copy](const Snapshot &s) { copy = s; })) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (int i = 1; i < 16; i++) {
+            ASSERT_EQ(copy.values[0], copy.values[i]);
+        }
+        accepted++;
+    }
+    writer.join();
+    ASSERT_EQ(20000u, lock.version());
+}
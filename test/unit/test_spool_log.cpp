@@ -0,0 +1,271 @@
+#include "test_runner.h"
+#include "spool_log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+
+// Tests for the job spool files (src/spool_log.cpp)
+
+#define LOG_MAX     2048
+#define INDEX_MAX   256
+#define COMPACT_AT  1024
+
+// A scratch directory holding one log and index pair
+struct SpoolDir {
+    char dir[32];
+    std::string log;
+    std::string index;
+
+    SpoolDir() {
+        strcpy(dir, "/tmp/spoolXXXXXX");
+        mkdtemp(dir);
+        log = std::string(dir) + "/spool.log";
+        index = std::string(dir) + "/spool.idx";
+    }
+    ~SpoolDir() {
+        unlink(log.c_str());
+        unlink(index.c_str());
+        unlink((log + ".tmp").c_str());
+        unlink((index + ".tmp").c_str());
+        rmdir(dir);
+    }
+    SpoolLog *open() const {
+        SpoolLog *spool = new SpoolLog(log.c_str(), index.c_str(), LOG_MAX, INDEX_MAX, COMPACT_AT);
+        return spool->open() ? spool : (delete spool, nullptr);
+    }
+};
+
+static size_t size_of(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static spool_job_t text_job(const char *text, uint16_t copies)
+{
+    spool_job_t job = {};
+    job.text = text;
+    job.copies = copies;
+    job.priority = 1;
+    job.client = 0x0a000001;
+    return job;
+}
+
+static bool read_text(SpoolLog *spool, uint32_t ref, std::string *text, uint16_t *labels_done)
+{
+    static char buf[SPOOL_LOG_PAYLOAD_MAX + 1];
+    static print_label_entry_t entries[PRINT_BATCH_MAX_LABELS];
+    spool_job_t job;
+    if (!spool->read(ref, &job, buf, sizeof(buf), entries, labels_done)) {
+        return false;
+    }
+    *text = job.text;
+    return true;
+}
+
+TEST(SpoolLogRecoversJobsAndCheckpoints) {
+    SpoolDir dir;
+    SpoolLog *spool = dir.open();
+    ASSERT_TRUE(spool != nullptr);
+
+    print_label_entry_t batch[2] = {{"Shelf A", 2, PRINT_CUT_END}, {"Shelf B", 1, PRINT_CUT_NONE}};
+    spool_job_t batch_job = text_job(NULL, 3);
+    batch_job.entries = batch;
+    batch_job.entry_count = 2;
+
+    uint32_t first, second, third;
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("done", 1), &first));
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("Hello", 4), &second));
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(batch_job, &third));
+    ASSERT_TRUE(spool->complete(first));
+    ASSERT_TRUE(spool->checkpoint(second, 3));
+    delete spool;
+
+    spool = dir.open();
+    ASSERT_TRUE(spool != nullptr);
+    ASSERT_EQ(2u, spool->liveCount());
+
+    std::string text;
+    uint16_t labels_done;
+    ASSERT_TRUE(read_text(spool, spool->liveRef(0), &text, &labels_done));
+    ASSERT_STREQ("Hello", text.c_str());
+    ASSERT_EQ(3, labels_done);
+
+    char buf[SPOOL_LOG_PAYLOAD_MAX + 1];
+    print_label_entry_t entries[PRINT_BATCH_MAX_LABELS];
+    spool_job_t job;
+    ASSERT_TRUE(spool->read(spool->liveRef(1), &job, buf, sizeof(buf), entries, &labels_done));
+    ASSERT_EQ(2, job.entry_count);
+    ASSERT_EQ(3, job.copies);
+    ASSERT_EQ(1, job.priority);
+    ASSERT_EQ(0x0a000001u, job.client);
+    ASSERT_STREQ("Shelf B", job.entries[1].text);
+    ASSERT_EQ(2, job.entries[0].copies);
+    ASSERT_EQ(PRINT_CUT_END, job.entries[0].cut);
+    ASSERT_EQ(0, labels_done);
+    delete spool;
+}
+
+TEST(SpoolLogDropsTornAndCorruptRecords) {
+    SpoolDir dir;
+    SpoolLog *spool = dir.open();
+    uint32_t ref;
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("kept", 1), &ref));
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("flipped", 1), &ref));
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("torn", 1), &ref));
+    delete spool;
+
+    // A byte of the second payload flipped, the third cut short by a reset
+    FILE *log = fopen(dir.log.c_str(), "r+b");
+    size_t record = (size_t)size_of(dir.log) - 2 * 20 - strlen("flipped") - strlen("torn");
+    fseek(log, record + 20, SEEK_SET);
+    fputc('F', log);
+    fclose(log);
+    ASSERT_EQ(0, truncate(dir.log.c_str(), size_of(dir.log) - 2));
+
+    spool = dir.open();
+    ASSERT_TRUE(spool != nullptr);
+    ASSERT_EQ(1u, spool->liveCount());
+    ASSERT_EQ(2u, spool->dropped());
+    std::string text;
+    uint16_t labels_done;
+    ASSERT_TRUE(read_text(spool, spool->liveRef(0), &text, &labels_done));
+    ASSERT_STREQ("kept", text.c_str());
+    delete spool;
+}
+
+TEST(SpoolLogIgnoresTornIndexEntry) {
+    SpoolDir dir;
+    SpoolLog *spool = dir.open();
+    uint32_t ref;
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("first", 1), &ref));
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("second", 1), &ref));
+    delete spool;
+
+    // The commit of the second record was cut short
+    ASSERT_EQ(0, truncate(dir.index.c_str(), size_of(dir.index) - 5));
+
+    spool = dir.open();
+    ASSERT_TRUE(spool != nullptr);
+    ASSERT_EQ(1u, spool->liveCount());
+    ASSERT_EQ(0u, spool->indexBytes() % 12);
+
+    // Entries appended after the torn one must still line up
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("third", 1), &ref));
+    delete spool;
+
+    spool = dir.open();
+    ASSERT_EQ(2u, spool->liveCount());
+    std::string text;
+    uint16_t labels_done;
+    ASSERT_TRUE(read_text(spool, spool->liveRef(1), &text, &labels_done));
+    ASSERT_STREQ("third", text.c_str());
+    delete spool;
+}
+
+TEST(SpoolLogCompactsLiveRecordsUnderLoad) {
+    SpoolDir dir;
+    SpoolLog *spool = dir.open();
+    std::string text(200, 'x');
+
+    // One job stays live throughout while others come and go
+    uint32_t pinned;
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("pinned", 5), &pinned));
+    ASSERT_TRUE(spool->checkpoint(pinned, 2));
+    for (int i = 0; i < 40; i++) {
+        uint32_t ref;
+        ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job(text.c_str(), 1), &ref));
+        ASSERT_TRUE(spool->complete(ref));
+        ASSERT_TRUE(spool->logBytes() <= LOG_MAX);
+        ASSERT_TRUE(spool->indexBytes() <= INDEX_MAX);
+    }
+    ASSERT_TRUE(spool->compactions() > 0);
+    ASSERT_TRUE(spool->checkpoint(pinned, 3));
+    delete spool;
+
+    spool = dir.open();
+    ASSERT_EQ(1u, spool->liveCount());
+    std::string read;
+    uint16_t labels_done;
+    ASSERT_TRUE(read_text(spool, spool->liveRef(0), &read, &labels_done));
+    ASSERT_STREQ("pinned", read.c_str());
+    ASSERT_EQ(3, labels_done);
+    delete spool;
+}
+
+TEST(SpoolLogBoundsIndexUnderCheckpoints) {
+    SpoolDir dir;
+    SpoolLog *spool = dir.open();
+    uint32_t ref;
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("long job", 500), &ref));
+    for (uint16_t done = 1; done < 200; done++) {
+        ASSERT_TRUE(spool->checkpoint(ref, done));
+        ASSERT_TRUE(spool->indexBytes() <= INDEX_MAX);
+    }
+    delete spool;
+
+    spool = dir.open();
+    std::string text;
+    uint16_t labels_done;
+    ASSERT_TRUE(read_text(spool, spool->liveRef(0), &text, &labels_done));
+    ASSERT_EQ(199, labels_done);
+    delete spool;
+}
+
+TEST(SpoolLogReportsFullWhenLiveRecordsFillIt) {
+    SpoolDir dir;
+    SpoolLog *spool = dir.open();
+    std::string text(500, 'y');
+    uint32_t ref;
+    int accepted = 0;
+    while (spool->append(text_job(text.c_str(), 1), &ref) == SPOOL_APPEND_OK) {
+        accepted++;
+    }
+    ASSERT_EQ(3, accepted);
+    ASSERT_EQ(SPOOL_APPEND_FULL, spool->append(text_job(text.c_str(), 1), &ref));
+    ASSERT_EQ(SPOOL_LOG_NONE, ref);
+
+    // Completing one makes room again
+    ASSERT_TRUE(spool->complete(spool->liveRef(0)));
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job(text.c_str(), 1), &ref));
+
+    std::string huge(SPOOL_LOG_PAYLOAD_MAX + 1, 'z');
+    ASSERT_EQ(SPOOL_APPEND_TOO_LARGE, spool->append(text_job(huge.c_str(), 1), &ref));
+    delete spool;
+}
+
+TEST(SpoolLogFinishesInterruptedCompaction) {
+    SpoolDir dir;
+    SpoolLog *spool = dir.open();
+    uint32_t ref;
+    ASSERT_EQ(SPOOL_APPEND_OK, spool->append(text_job("original", 1), &ref));
+    delete spool;
+
+    // Copies written but the old index still there: the copies are dropped
+    FILE *tmp = fopen((dir.log + ".tmp").c_str(), "wb");
+    fputs("garbage", tmp);
+    fclose(tmp);
+    tmp = fopen((dir.index + ".tmp").c_str(), "wb");
+    fputs("garbage", tmp);
+    fclose(tmp);
+
+    spool = dir.open();
+    ASSERT_EQ(1u, spool->liveCount());
+    ASSERT_EQ(0u, size_of(dir.log + ".tmp"));
+    std::string text;
+    uint16_t labels_done;
+    ASSERT_TRUE(read_text(spool, spool->liveRef(0), &text, &labels_done));
+    ASSERT_STREQ("original", text.c_str());
+    delete spool;
+
+    // Old index removed: the copies are the spool
+    rename(dir.log.c_str(), (dir.log + ".tmp").c_str());
+    rename(dir.index.c_str(), (dir.index + ".tmp").c_str());
+    spool = dir.open();
+    ASSERT_EQ(1u, spool->liveCount());
+    ASSERT_TRUE(read_text(spool, spool->liveRef(0), &text, &labels_done));
+    ASSERT_STREQ("original", text.c_str());
+    delete spool;
+}
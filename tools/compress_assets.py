@@ -0,0 +1,26 @@
+# PlatformIO pre-script: gzip the web UI next to its sources before the
+# filesystem image is built, so the server can send the compressed copies
+# (see src/web_assets.cpp). The output is deterministic, so the ETags only
+# change when the files do.
+import gzip
+import os
+
+Import("env")
+
+ASSETS = ("index.html", "style.css", "script.js")
+
+
+def compress_assets(*args, **kwargs):
+    data_dir = env.subst("$PROJECT_DATA_DIR")
+    for name in ASSETS:
+        src = os.path.join(data_dir, name)
+        dst = src + ".gz"
+        if os.path.exists(dst) and os.path.getmtime(dst) >= os.path.getmtime(src):
+            continue
+        with open(src, "rb") as f_in, open(dst, "wb") as raw:
+            with gzip.GzipFile(filename="", mode="wb", fileobj=raw, compresslevel=9, mtime=0) as f_out:
+                f_out.write(f_in.read())
+        print("Compressed %s: %d -> %d bytes" % (name, os.path.getsize(src), os.path.getsize(dst)))
+
+
+env.AddPreAction("$BUILD_DIR/${ESP32_FS_IMAGE_NAME}.bin", compress_assets)